@@ -83,6 +83,14 @@ void	DGenInterface::DGen::ClearBreakpoints()
 	::ClearBreakpoints();
 }
 
+int DGenInterface::DGen::SetBreakpointCondition(int addr, String^ condition, int hitCount, int logOnly)
+{
+	marshal_context^ context = gcnew marshal_context();
+	int result = ::SetBreakpointCondition(addr, context->marshal_as<const char*>(condition), hitCount, logOnly);
+	delete context;
+	return result;
+}
+
 int DGenInterface::DGen::AddWatchpoint(int fromAddr, int toAddr)
 {
 	return ::AddWatchpoint(fromAddr, toAddr);
@@ -61,6 +61,7 @@ namespace DGenInterface {
 		int		AddBreakpoint(int addr);
 		void	ClearBreakpoint(int addr);
 		void	ClearBreakpoints();
+		int		SetBreakpointCondition(int addr, String^ condition, int hitCount, int logOnly);
 		int		AddWatchpoint(int fromAddr, int toAddr);
 		void	ClearWatchpoint(int fromAddr);
 		void	ClearWatchpoints();
@@ -293,6 +293,15 @@ void Cz80_Set_RETI_Callback(cz80_struc *cpu, CZ80_RETI_CALLBACK *Func)
     cpu->RetI = Func;
 }
 
+#if CZ80_INSTR_HOOK
+// called before each instruction when not NULL, a nonzero return value
+// stops Cz80_Exec() before executing it
+void Cz80_Set_Instr_Hook(cz80_struc *cpu, CZ80_HOOK_CALLBACK *Func)
+{
+    cpu->Instr_Hook = Func;
+}
+#endif
+
 // externals main functions
 ////////////////////////////
 
@@ -51,6 +51,7 @@ extern "C" {
 #define CZ80_USE_WORD_HANDLER   1
 #define CZ80_EXACT              1
 #define CZ80_DEBUG              0
+#define CZ80_INSTR_HOOK         1
 
 // use zR8 for B/C/D/E/H/L registers only
 // use zR16 for BC/DE/HL registers only
@@ -172,6 +173,9 @@ typedef void FASTCALL CZ80_WRITE_WORD(void *ctx, uint16_t adr, uint16_t data);
 
 typedef void FASTCALL CZ80_RETI_CALLBACK(void *ctx);
 typedef uint8_t FASTCALL CZ80_INT_CALLBACK(void *ctx, uint8_t param);
+#if CZ80_INSTR_HOOK
+typedef int FASTCALL CZ80_HOOK_CALLBACK(void *ctx, uint16_t pc);
+#endif
 
 typedef union
 {
@@ -241,6 +245,9 @@ typedef struct
 
         CZ80_RETI_CALLBACK *RetI;
         CZ80_INT_CALLBACK *Interrupt_Ack;
+#if CZ80_INSTR_HOOK
+        CZ80_HOOK_CALLBACK *Instr_Hook;
+#endif
 
         uint8_t *Fetch[CZ80_FETCH_BANK];
 } cz80_struc;
@@ -275,6 +282,9 @@ void    Cz80_Set_OUTPort(cz80_struc *cpu, CZ80_WRITE *Func);
 
 void    Cz80_Set_IRQ_Callback(cz80_struc *cpu, CZ80_INT_CALLBACK *Func);
 void    Cz80_Set_RETI_Callback(cz80_struc *cpu, CZ80_RETI_CALLBACK *Func);
+#if CZ80_INSTR_HOOK
+void    Cz80_Set_Instr_Hook(cz80_struc *cpu, CZ80_HOOK_CALLBACK *Func);
+#endif
 
 uint8_t Cz80_Read_Byte(cz80_struc *cpu, uint16_t adr);
 uint16_t Cz80_Read_Word(cz80_struc *cpu, uint16_t adr);
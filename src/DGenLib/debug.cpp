@@ -3,6 +3,7 @@
 // (C) 2012 Edd Barrett <vext01@gmail.com>
 
 #include <errno.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -75,20 +76,21 @@ void completion(const char *buf, linenoiseCompletions *lc) {
 #endif
 
 #ifdef WITH_MUSA
-/** @{ Callbacks for Musashi. */
+/** @{ Callbacks for Musashi, these must not trigger watchpoints. */
 uint32_t m68k_read_disassembler_8(unsigned int addr)
 {
-	    return m68k_read_memory_8(addr);
+	    return md::md_musa->misc_readbyte(addr);
 }
 
 uint32_t m68k_read_disassembler_16(unsigned int addr)
 {
-	    return m68k_read_memory_16(addr);
+	    return md::md_musa->misc_readword(addr);
 }
 
 uint32_t m68k_read_disassembler_32(unsigned int addr)
 {
-	    return m68k_read_memory_32(addr);
+	    return ((md::md_musa->misc_readword(addr) << 16) |
+		    (md::md_musa->misc_readword(addr + 2) & 0xffff));
 }
 /** @} */
 #endif
@@ -118,6 +120,401 @@ static int debug_strtou32(const char *str, uint32_t *ret)
 	return (0);
 }
 
+/**
+ * Parse a watchpoint type such as "rw", "w.b" or "r.wl".
+ *
+ * Accesses are given first ('r' and/or 'w'), optionally followed by a dot
+ * and access sizes ('b', 'w' and/or 'l'). All sizes are watched when none
+ * are given.
+ *
+ * @param[in] str String to parse.
+ * @param[out] ret WP_FLAG_* flags "str" represents.
+ * @return -1 on error.
+ */
+static int debug_strtowp(const char *str, uint32_t *ret)
+{
+	uint32_t flags = 0;
+
+	for (; ((*str != '\0') && (*str != '.')); ++str) {
+		if (*str == 'r')
+			flags |= WP_FLAG_READ;
+		else if (*str == 'w')
+			flags |= WP_FLAG_WRITE;
+		else
+			return (-1);
+	}
+	if (flags == 0)
+		return (-1);
+	if (*str == '\0') {
+		*ret = (flags | WP_FLAG_SIZE);
+		return (0);
+	}
+	for (++str; (*str != '\0'); ++str) {
+		if (*str == 'b')
+			flags |= WP_FLAG_BYTE;
+		else if (*str == 'w')
+			flags |= WP_FLAG_WORD;
+		else if (*str == 'l')
+			flags |= WP_FLAG_LONG;
+		else
+			return (-1);
+	}
+	if (!(flags & WP_FLAG_SIZE))
+		return (-1);
+	*ret = flags;
+	return (0);
+}
+
+/**
+ * Watchpoint type in a human-readable form.
+ *
+ * @param flags WP_FLAG_* flags of a watchpoint or an access.
+ * @return Static string such as "rw.bwl".
+ */
+static const char *debug_wp_type(uint32_t flags)
+{
+	static thread_local char buf[8];
+	char *p = buf;
+
+	if (flags & WP_FLAG_READ)
+		*(p++) = 'r';
+	if (flags & WP_FLAG_WRITE)
+		*(p++) = 'w';
+	*(p++) = '.';
+	if (flags & WP_FLAG_BYTE)
+		*(p++) = 'b';
+	if (flags & WP_FLAG_WORD)
+		*(p++) = 'w';
+	if (flags & WP_FLAG_LONG)
+		*(p++) = 'l';
+	*p = '\0';
+	return buf;
+}
+
+/**
+ * Breakpoint condition opcodes, evaluated by md::debug_expr_eval() on a
+ * stack of 32-bit values. EXPR_IMM, EXPR_REG, EXPR_JZ and EXPR_JNZ are
+ * followed by an operand.
+ */
+enum expr_op {
+	EXPR_IMM,	/**< Push operand. */
+	EXPR_REG,	/**< Push register, see expr_m68k_regs/expr_z80_regs. */
+	EXPR_MEM8,	/**< Replace address with the byte it points to. */
+	EXPR_MEM16,	/**< Same for a word. */
+	EXPR_MEM32,	/**< Same for a long. */
+	EXPR_NEG,
+	EXPR_NOT,
+	EXPR_LNOT,
+	EXPR_MUL,
+	EXPR_DIV,
+	EXPR_MOD,
+	EXPR_ADD,
+	EXPR_SUB,
+	EXPR_SHL,
+	EXPR_SHR,
+	EXPR_LT,
+	EXPR_LE,
+	EXPR_GT,
+	EXPR_GE,
+	EXPR_EQ,
+	EXPR_NE,
+	EXPR_AND,
+	EXPR_XOR,
+	EXPR_OR,
+	EXPR_JZ,	/**< Jump to operand if zero, otherwise pop. */
+	EXPR_JNZ,	/**< Replace with 1 and jump if nonzero, otherwise pop. */
+	EXPR_BOOL	/**< Replace with 1 if nonzero. */
+};
+
+/** M68K registers in conditions, "sp" is an alias for "a7". */
+static const char *const expr_m68k_regs[] = {
+	"d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7",
+	"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7",
+	"pc", "sr", "sp", NULL
+};
+
+/** Z80 registers in conditions. */
+static const char *const expr_z80_regs[] = {
+	"af", "bc", "de", "hl", "af'", "bc'", "de'", "hl'",
+	"ix", "iy", "sp", "pc",
+	"a", "f", "b", "c", "d", "e", "h", "l", "i", "r", NULL
+};
+
+/** Binary operators, two-character ones must come first. */
+static const struct expr_binop {
+	const char	*op;
+	unsigned int	prec;
+	enum expr_op	code;
+} expr_binops[] = {
+	{ "||", 1, EXPR_JNZ }, { "&&", 2, EXPR_JZ },
+	{ "==", 6, EXPR_EQ }, { "!=", 6, EXPR_NE },
+	{ "<=", 7, EXPR_LE }, { ">=", 7, EXPR_GE },
+	{ "<<", 8, EXPR_SHL }, { ">>", 8, EXPR_SHR },
+	{ "|", 3, EXPR_OR }, { "^", 4, EXPR_XOR }, { "&", 5, EXPR_AND },
+	{ "<", 7, EXPR_LT }, { ">", 7, EXPR_GT },
+	{ "+", 9, EXPR_ADD }, { "-", 9, EXPR_SUB },
+	{ "*", 10, EXPR_MUL }, { "/", 10, EXPR_DIV }, { "%", 10, EXPR_MOD }
+};
+
+/** Breakpoint condition compiler state. */
+struct expr_parser {
+	const char		*p; /**< Next character. */
+	struct dgen_expr	*e; /**< Output. */
+	int			 context; /**< DBG_CONTEXT_M68K or Z80. */
+};
+
+static int expr_binary(struct expr_parser *ps, unsigned int prec);
+
+static int expr_emit(struct expr_parser *ps, uint32_t code)
+{
+	if (ps->e->len == elemof(ps->e->code)) {
+		printf("condition too complex\n");
+		return -1;
+	}
+	ps->e->code[(ps->e->len++)] = code;
+	return 0;
+}
+
+static void expr_space(struct expr_parser *ps)
+{
+	while ((*ps->p == ' ') || (*ps->p == '\t'))
+		++ps->p;
+}
+
+/**
+ * Look up a register name at the current position.
+ *
+ * @param ps Parser state, advanced past the name on success.
+ * @return Register index or -1.
+ */
+static int expr_reg(struct expr_parser *ps)
+{
+	const char *const *regs = ((ps->context == DBG_CONTEXT_Z80) ?
+				   expr_z80_regs : expr_m68k_regs);
+	const char *p = ps->p;
+	size_t len = 0;
+	int i;
+
+	while (isalnum((unsigned char)p[len]))
+		++len;
+	if ((len != 0) && (p[len] == '\'') && (ps->context == DBG_CONTEXT_Z80))
+		++len;
+	if (len == 0)
+		return -1;
+	for (i = 0; (regs[i] != NULL); ++i) {
+		if ((strlen(regs[i]) != len) || (strncasecmp(regs[i], p, len)))
+			continue;
+		ps->p += len;
+		if ((ps->context == DBG_CONTEXT_M68K) && (i == 18))
+			return 15; // sp
+		return i;
+	}
+	return -1;
+}
+
+/**
+ * Check whether a register can be used for indirect memory reads, such
+ * as "(a0)" on M68K or "(hl)" on Z80.
+ */
+static bool expr_indirect(int context, int reg)
+{
+	if (context == DBG_CONTEXT_Z80)
+		return (((reg >= 1) && (reg <= 3)) || // bc, de, hl
+			((reg >= 8) && (reg <= 10))); // ix, iy, sp
+	return ((reg >= 8) && (reg <= 15)); // a0-a7
+}
+
+/**
+ * Emit a memory read, the size is given by an optional ".b", ".w" or ".l"
+ * suffix and defaults to long on M68K, byte on Z80.
+ */
+static int expr_mem(struct expr_parser *ps)
+{
+	uint32_t code = ((ps->context == DBG_CONTEXT_Z80) ?
+			 EXPR_MEM8 : EXPR_MEM32);
+
+	if ((ps->p[0] == '.') && (!isalnum((unsigned char)ps->p[2]))) {
+		switch (tolower((unsigned char)ps->p[1])) {
+		case 'b':
+			code = EXPR_MEM8;
+			break;
+		case 'w':
+			code = EXPR_MEM16;
+			break;
+		case 'l':
+			code = EXPR_MEM32;
+			break;
+		default:
+			printf("bad size: %.2s\n", ps->p);
+			return -1;
+		}
+		ps->p += 2;
+	}
+	return expr_emit(ps, code);
+}
+
+/**
+ * Parse a unary expression: a number, a register, "(reg)" or "[expr]"
+ * memory reads, a parenthesized expression or a unary operator.
+ */
+static int expr_unary(struct expr_parser *ps)
+{
+	const char *start;
+	char *end;
+	int reg;
+
+	expr_space(ps);
+	start = ps->p;
+	switch (*ps->p) {
+	case '-':
+	case '~':
+	case '!':
+		++ps->p;
+		if (expr_unary(ps))
+			return -1;
+		return expr_emit(ps, ((*start == '-') ? EXPR_NEG :
+				      (*start == '~') ? EXPR_NOT : EXPR_LNOT));
+	case '(':
+		++ps->p;
+		expr_space(ps);
+		// Register indirect, as in assembly.
+		if (((reg = expr_reg(ps)) >= 0) &&
+		    (expr_indirect(ps->context, reg))) {
+			expr_space(ps);
+			if (*ps->p == ')') {
+				++ps->p;
+				if ((expr_emit(ps, EXPR_REG)) ||
+				    (expr_emit(ps, reg)))
+					return -1;
+				return expr_mem(ps);
+			}
+		}
+		ps->p = (start + 1);
+		if (expr_binary(ps, 1))
+			return -1;
+		expr_space(ps);
+		if (*ps->p != ')') {
+			printf("missing ')' at: %s\n", ps->p);
+			return -1;
+		}
+		++ps->p;
+		return 0;
+	case '[':
+		++ps->p;
+		if (expr_binary(ps, 1))
+			return -1;
+		expr_space(ps);
+		if (*ps->p != ']') {
+			printf("missing ']' at: %s\n", ps->p);
+			return -1;
+		}
+		++ps->p;
+		return expr_mem(ps);
+	case '$':
+		if (!isxdigit((unsigned char)ps->p[1]))
+			break;
+		if ((expr_emit(ps, EXPR_IMM)) ||
+		    (expr_emit(ps, strtoul((ps->p + 1), &end, 16))))
+			return -1;
+		ps->p = end;
+		return 0;
+	}
+	if (isdigit((unsigned char)*ps->p)) {
+		if ((expr_emit(ps, EXPR_IMM)) ||
+		    (expr_emit(ps, strtoul(ps->p, &end, 0))))
+			return -1;
+		ps->p = end;
+		return 0;
+	}
+	if ((reg = expr_reg(ps)) >= 0)
+		return ((expr_emit(ps, EXPR_REG)) || (expr_emit(ps, reg)));
+	printf("syntax error at: %s\n", ps->p);
+	return -1;
+}
+
+/**
+ * Parse binary operators of at least the given precedence, using
+ * precedence climbing. "&&" and "||" are compiled into short-circuiting
+ * jumps so that the right-hand side isn't evaluated needlessly.
+ */
+static int expr_binary(struct expr_parser *ps, unsigned int prec)
+{
+	if (expr_unary(ps))
+		return -1;
+	while (1) {
+		const struct expr_binop *op = NULL;
+		unsigned int i;
+		unsigned int fix;
+
+		expr_space(ps);
+		for (i = 0; (i != elemof(expr_binops)); ++i) {
+			if (!strncmp(ps->p, expr_binops[i].op,
+				     strlen(expr_binops[i].op))) {
+				op = &expr_binops[i];
+				break;
+			}
+		}
+		if ((op == NULL) || (op->prec < prec))
+			return 0;
+		ps->p += strlen(op->op);
+		if ((op->code != EXPR_JZ) && (op->code != EXPR_JNZ)) {
+			if ((expr_binary(ps, (op->prec + 1))) ||
+			    (expr_emit(ps, op->code)))
+				return -1;
+			continue;
+		}
+		if ((expr_emit(ps, op->code)) || (expr_emit(ps, 0)))
+			return -1;
+		fix = (ps->e->len - 1);
+		if ((expr_binary(ps, (op->prec + 1))) ||
+		    (expr_emit(ps, EXPR_BOOL)))
+			return -1;
+		ps->e->code[fix] = ps->e->len;
+	}
+}
+
+/**
+ * Compile a breakpoint condition such as "d0 == 3 && (a1) > $ff0000".
+ *
+ * Operators and precedence are those of C, values are unsigned 32-bit.
+ * Numbers are decimal, "0x" or "$" prefixed hexadecimal. Registers are
+ * read with their names, memory with "(reg)" or "[expr]" optionally
+ * followed by a size (".b", ".w" or ".l").
+ *
+ * @param[out] e Compiled expression, emptied if str is empty.
+ * @param[in] str Expression to compile.
+ * @param context DBG_CONTEXT_M68K or DBG_CONTEXT_Z80.
+ * @return -1 on error, e is left unchanged.
+ */
+static int debug_expr_compile(struct dgen_expr *e, const char *str,
+			      int context)
+{
+	struct dgen_expr tmp;
+	struct expr_parser ps = { str, &tmp, context };
+
+	tmp.len = 0;
+	expr_space(&ps);
+	if (*ps.p == '\0') {
+		e->len = 0;
+		e->str[0] = '\0';
+		return 0;
+	}
+	if (strlen(str) >= sizeof(tmp.str)) {
+		printf("condition too long\n");
+		return -1;
+	}
+	if (expr_binary(&ps, 1))
+		return -1;
+	expr_space(&ps);
+	if (*ps.p != '\0') {
+		printf("syntax error at: %s\n", ps.p);
+		return -1;
+	}
+	strcpy(tmp.str, str);
+	*e = tmp;
+	return 0;
+}
+
 /**
  * Check if at least one M68K breakpoint is set.
  *
@@ -255,6 +652,13 @@ void md::debug_init()
 	memset(debug_wp_m68k, 0, sizeof(debug_wp_m68k));
 	memset(debug_bp_z80, 0, sizeof(debug_bp_z80));
 	memset(debug_wp_z80, 0, sizeof(debug_wp_z80));
+	memset(debug_wp_m68k_page, 0, sizeof(debug_wp_m68k_page));
+	memset(debug_wp_z80_page, 0, sizeof(debug_wp_z80_page));
+	debug_update_bp_m68k_map();
+	debug_update_bp_z80_map();
+	debug_update_wp_m68k_map();
+	debug_update_wp_z80_map();
+	debug_m68k_hooked = false;
 
 #ifndef NO_COMPLETION
 	linenoiseSetCompletionCallback(completion);
@@ -440,8 +844,9 @@ void md::debug_print_m68k_wp(int idx)
 {
 	struct dgen_wp		*w = &(debug_wp_m68k[idx]);
 
-	printf("#%0d:\t0x%08x-%08x (%u bytes)\n", idx,
-	    w->start_addr, w->end_addr, w->end_addr - w->start_addr + 1);
+	printf("#%0d:\t0x%08x-%08x (%u bytes, %s)\n", idx,
+	    w->start_addr, w->end_addr, w->end_addr - w->start_addr + 1,
+	    debug_wp_type(w->flags));
 
 	debug_print_hex_buf(w->bytes, w->end_addr - w->start_addr + 1, w->start_addr);
 	fflush(stdout);
@@ -456,8 +861,9 @@ void md::debug_print_z80_wp(int idx)
 {
 	struct dgen_wp *w = &debug_wp_z80[idx];
 
-	printf("#%0d:\t0x%04x-%04x (%u bytes)\n", idx, w->start_addr,
-	       w->end_addr, (w->end_addr - w->start_addr + 1));
+	printf("#%0d:\t0x%04x-%04x (%u bytes, %s)\n", idx, w->start_addr,
+	       w->end_addr, (w->end_addr - w->start_addr + 1),
+	       debug_wp_type(w->flags));
 	debug_print_hex_buf(w->bytes, (w->end_addr - w->start_addr + 1),
 			    w->start_addr);
 	fflush(stdout);
@@ -465,7 +871,7 @@ void md::debug_print_z80_wp(int idx)
 
 /**
  * Check the given M68K watchpoint against cached memory to see if it should
- * fire.
+ * fire. Only needed for cores that bypass debug_m68k_wp_access().
  *
  * @param[in] w Watch point to check.
  * @return 1 if true, else 0.
@@ -483,24 +889,6 @@ int md::debug_should_m68k_wp_fire(struct dgen_wp *w)
 	return (0);
 }
 
-/**
- * Check the given Z80 watchpoint against cached memory to see if it should
- * fire.
- *
- * @param[in] w Watch point to check.
- * @return 1 if true, else 0.
- */
-int md::debug_should_z80_wp_fire(struct dgen_wp *w)
-{
-	unsigned int i = w->start_addr;
-	unsigned char *p = w->bytes;
-
-	while (i <= w->end_addr)
-		if (z80_read(i++) != *p++)
-			return 1;
-	return 0;
-}
-
 /**
  * Get M68K PC.
  *
@@ -550,40 +938,628 @@ uint16_t md::z80_get_pc()
 	return le2h16(z80_state.pc);
 }
 
-uint16_t md::debug_z80_get_reg(int reg)
-{
-	z80_state_dump();
+uint16_t md::debug_z80_get_reg(int reg)
+{
+	z80_state_dump();
+
+	switch (reg)
+	{
+	case Z80_REG_FA:
+		return le2h16(z80_state.alt[0].fa);
+	case Z80_REG_CB:
+		return le2h16(z80_state.alt[0].cb);
+	case Z80_REG_ED:
+		return le2h16(z80_state.alt[0].ed);
+	case Z80_REG_LH:
+		return le2h16(z80_state.alt[0].lh);
+	case Z80_REG_FA_ALT:
+		return le2h16(z80_state.alt[1].fa);
+	case Z80_REG_CB_ALT:
+		return le2h16(z80_state.alt[1].cb);
+	case Z80_REG_ED_ALT:
+		return le2h16(z80_state.alt[1].ed);
+	case Z80_REG_LH_ALT:
+		return le2h16(z80_state.alt[1].lh);
+	case Z80_REG_IX:
+		return le2h16(z80_state.ix);
+	case Z80_REG_IY:
+		return le2h16(z80_state.iy);
+	case Z80_REG_SP:
+		return le2h16(z80_state.sp);
+	case Z80_REG_PC:
+		return le2h16(z80_state.pc);
+	}
+
+	return 0;
+};
+
+/**
+ * Bit index of an M68K address in debug_bp_m68k_map[]. Instructions are
+ * word-aligned, bit 0 is ignored and the remaining bits are folded.
+ */
+#define BP_MAP_M68K(addr) ((((addr) >> 1) ^ ((addr) >> 17)) & (BP_MAP_BITS - 1))
+
+/**
+ * Bit index of a Z80 address in debug_bp_z80_map[].
+ */
+#define BP_MAP_Z80(addr) ((addr) & (BP_MAP_BITS - 1))
+
+/**
+ * Rebuild the M68K breakpoints address filter. Must be called each time
+ * debug_bp_m68k[] is modified.
+ */
+void md::debug_update_bp_m68k_map()
+{
+	unsigned int i;
+
+	memset(debug_bp_m68k_map, 0, sizeof(debug_bp_m68k_map));
+	for (i = 0; (i < MAX_BREAKPOINTS); ++i) {
+		uint32_t bit;
+
+		if (!(debug_bp_m68k[i].flags & BP_FLAG_USED))
+			break;
+		bit = BP_MAP_M68K(debug_bp_m68k[i].addr);
+		debug_bp_m68k_map[(bit >> 5)] |= (1 << (bit & 31));
+	}
+}
+
+/**
+ * Rebuild the Z80 breakpoints address filter. Must be called each time
+ * debug_bp_z80[] is modified.
+ */
+void md::debug_update_bp_z80_map()
+{
+	unsigned int i;
+
+	memset(debug_bp_z80_map, 0, sizeof(debug_bp_z80_map));
+	for (i = 0; (i < MAX_BREAKPOINTS); ++i) {
+		uint32_t bit;
+
+		if (!(debug_bp_z80[i].flags & BP_FLAG_USED))
+			break;
+		bit = BP_MAP_Z80(debug_bp_z80[i].addr);
+		debug_bp_z80_map[(bit >> 5)] |= (1 << (bit & 31));
+	}
+}
+
+/**
+ * Rebuild the M68K watched pages filter. Must be called each time
+ * debug_wp_m68k[] is modified.
+ *
+ * RAM is mirrored, watching any of its pages watches all of them. Musashi
+ * accesses ROM and RAM directly, its memory map is updated so that watched
+ * pages go through debug_m68k_wp_access() instead.
+ */
+void md::debug_update_wp_m68k_map()
+{
+	uint8_t prev[WP_PAGES];
+	uint8_t ram = 0;
+	unsigned int i;
+	unsigned int j;
+
+	memcpy(prev, debug_wp_m68k_page, sizeof(prev));
+	memset(debug_wp_m68k_page, 0, sizeof(debug_wp_m68k_page));
+	debug_wp_m68k_hit = -1;
+	for (i = 0; (i < MAX_WATCHPOINTS); ++i) {
+		struct dgen_wp *w = &(debug_wp_m68k[i]);
+		uint8_t type = (w->flags & (WP_FLAG_READ | WP_FLAG_WRITE));
+		uint32_t start;
+		uint32_t end;
+
+		if (!(w->flags & WP_FLAG_USED))
+			break;
+		debug_m68k_wp_range(w, &start, &end);
+		for (j = (start >> 16); (j <= (end >> 16)); ++j) {
+			if (m68k_page[j] == M68K_PAGE_RAM)
+				ram |= type;
+			else
+				debug_wp_m68k_page[j] |= type;
+		}
+	}
+	for (j = 0; (j < WP_PAGES); ++j)
+		if (m68k_page[j] == M68K_PAGE_RAM)
+			debug_wp_m68k_page[j] |= ram;
+#ifdef WITH_MUSA
+	if (memcmp(debug_wp_m68k_page, prev, sizeof(prev))) {
+		md_set_musa(1);
+		musa_memory_map();
+		md_set_musa(0);
+	}
+#endif
+}
+
+/**
+ * Rebuild the Z80 watched pages filter. Must be called each time
+ * debug_wp_z80[] is modified.
+ */
+void md::debug_update_wp_z80_map()
+{
+	unsigned int i;
+	unsigned int j;
+
+	memset(debug_wp_z80_page, 0, sizeof(debug_wp_z80_page));
+	debug_wp_z80_hit = -1;
+	for (i = 0; (i < MAX_WATCHPOINTS); ++i) {
+		struct dgen_wp *w = &(debug_wp_z80[i]);
+
+		if (!(w->flags & WP_FLAG_USED))
+			break;
+		for (j = ((w->start_addr >> 8) & 0xff);
+		     (j <= ((w->end_addr >> 8) & 0xff));
+		     ++j)
+			debug_wp_z80_page[j] |=
+				(w->flags & (WP_FLAG_READ | WP_FLAG_WRITE));
+	}
+}
+
+/**
+ * Get the 24-bit address range covered by a M68K watchpoint. Ranges that
+ * go past the end of the address space stop there.
+ *
+ * @param[in] w Watchpoint.
+ * @param[out] start First address.
+ * @param[out] end Last address.
+ */
+void md::debug_m68k_wp_range(const struct dgen_wp *w, uint32_t *start,
+			     uint32_t *end)
+{
+	*start = (w->start_addr & 0x00ffffff);
+	*end = (w->end_addr & 0x00ffffff);
+	if ((*end < *start) || (w->end_addr > 0x00ffffff))
+		*end = 0x00ffffff;
+}
+
+/**
+ * Match a M68K memory access on a watched page against watchpoints. The
+ * first watchpoint to match is left pending in debug_wp_m68k_hit until
+ * debug_m68k_check_wps() reports it once the instruction is complete.
+ *
+ * RAM accesses match watchpoints set on any of its mirrors.
+ *
+ * @param addr Address accessed.
+ * @param type WP_FLAG_READ or WP_FLAG_WRITE and access size.
+ */
+void md::debug_m68k_match_wps(uint32_t addr, uint32_t type)
+{
+	bool is_ram;
+	uint32_t last;
+	unsigned int i;
+
+	addr &= 0x00ffffff;
+	// Mirrors are reported at their 0xff0000 address.
+	is_ram = (m68k_page[(addr >> 16)] == M68K_PAGE_RAM);
+	if (is_ram)
+		addr = (0xff0000 | (addr & 0xffff));
+	if (type & WP_FLAG_LONG)
+		last = (addr + 3);
+	else if (type & WP_FLAG_WORD)
+		last = (addr + 1);
+	else
+		last = addr;
+	for (i = 0; (i < MAX_WATCHPOINTS); ++i) {
+		struct dgen_wp *w = &(debug_wp_m68k[i]);
+		uint32_t start;
+		uint32_t end;
+		unsigned int page;
+
+		if (!(w->flags & WP_FLAG_USED))
+			break;
+		if ((!(w->flags & type & (WP_FLAG_READ | WP_FLAG_WRITE))) ||
+		    (!(w->flags & type & WP_FLAG_SIZE)))
+			continue;
+		debug_m68k_wp_range(w, &start, &end);
+		if (is_ram) {
+			// Try the access at each RAM page of the range.
+			for (page = (start >> 16); (page <= (end >> 16));
+			     ++page) {
+				uint32_t a = ((page << 16) | (addr & 0xffff));
+
+				if ((m68k_page[page] == M68K_PAGE_RAM) &&
+				    (a <= end) &&
+				    ((a + (last - addr)) >= start))
+					break;
+			}
+			if (page > (end >> 16))
+				continue;
+		}
+		else if ((last < start) || (addr > end))
+			continue;
+		w->flags |= WP_FLAG_FIRED;
+		if (debug_wp_m68k_hit < 0) {
+			w->hit_addr = addr;
+			w->hit_flags = type;
+			debug_wp_m68k_hit = i;
+		}
+		return;
+	}
+}
+
+/**
+ * Z80 counterpart of debug_m68k_match_wps().
+ *
+ * @param addr Address accessed.
+ * @param type WP_FLAG_READ or WP_FLAG_WRITE and access size.
+ */
+void md::debug_z80_match_wps(uint16_t addr, uint32_t type)
+{
+	uint32_t last = (addr + ((type & WP_FLAG_WORD) ? 1 : 0));
+	unsigned int i;
+
+	for (i = 0; (i < MAX_WATCHPOINTS); ++i) {
+		struct dgen_wp *w = &(debug_wp_z80[i]);
+
+		if (!(w->flags & WP_FLAG_USED))
+			break;
+		if ((!(w->flags & type & (WP_FLAG_READ | WP_FLAG_WRITE))) ||
+		    (!(w->flags & type & WP_FLAG_SIZE)))
+			continue;
+		if ((last < w->start_addr) || (addr > w->end_addr))
+			continue;
+		w->flags |= WP_FLAG_FIRED;
+		if (debug_wp_z80_hit < 0) {
+			w->hit_addr = addr;
+			w->hit_flags = type;
+			debug_wp_z80_hit = i;
+		}
+		return;
+	}
+}
+
+/**
+ * Evaluate a compiled breakpoint condition against the current CPU state.
+ * Registers are only dumped when the condition uses them.
+ *
+ * @param e Expression compiled by debug_expr_compile().
+ * @param context DBG_CONTEXT_M68K or DBG_CONTEXT_Z80.
+ * @return Expression value, 1 if empty.
+ */
+uint32_t md::debug_expr_eval(const struct dgen_expr *e, int context)
+{
+	uint32_t st[MAX_EXPR_CODE];
+	unsigned int n = 0;
+	unsigned int i = 0;
+	bool dumped = false;
+	uint32_t v;
+
+	if (e->len == 0)
+		return 1;
+	while (i != e->len) {
+		switch (e->code[(i++)]) {
+		case EXPR_IMM:
+			st[(n++)] = e->code[(i++)];
+			break;
+		case EXPR_REG:
+			v = e->code[(i++)];
+			if (context == DBG_CONTEXT_Z80) {
+				uint16_t r[12];
+
+				if (!dumped)
+					z80_state_dump();
+				dumped = true;
+				r[0] = le2h16(z80_state.alt[0].fa);
+				r[1] = le2h16(z80_state.alt[0].cb);
+				r[2] = le2h16(z80_state.alt[0].ed);
+				r[3] = le2h16(z80_state.alt[0].lh);
+				r[4] = le2h16(z80_state.alt[1].fa);
+				r[5] = le2h16(z80_state.alt[1].cb);
+				r[6] = le2h16(z80_state.alt[1].ed);
+				r[7] = le2h16(z80_state.alt[1].lh);
+				r[8] = le2h16(z80_state.ix);
+				r[9] = le2h16(z80_state.iy);
+				r[10] = le2h16(z80_state.sp);
+				r[11] = le2h16(z80_state.pc);
+				if (v < 12)
+					st[n] = r[v];
+				else if (v < 20) // a, f, b, c, d, e, h, l
+					st[n] = ((r[((v - 12) >> 1)] >>
+						  ((~v & 1) << 3)) & 0xff);
+				else if (v == 20)
+					st[n] = z80_state.i;
+				else
+					st[n] = z80_state.r;
+			}
+			else {
+				if (!dumped)
+					m68k_state_dump();
+				dumped = true;
+				if (v < 8)
+					st[n] = le2h32(m68k_state.d[v]);
+				else if (v < 16)
+					st[n] = le2h32(m68k_state.a[(v - 8)]);
+				else if (v == 16)
+					st[n] = le2h32(m68k_state.pc);
+				else
+					st[n] = le2h16(m68k_state.sr);
+			}
+			++n;
+			break;
+		case EXPR_MEM8:
+			v = st[(n - 1)];
+			if (context == DBG_CONTEXT_Z80)
+				st[(n - 1)] = z80_read(v);
+			else
+				st[(n - 1)] = misc_readbyte(v);
+			break;
+		case EXPR_MEM16:
+			v = st[(n - 1)];
+			if (context == DBG_CONTEXT_Z80)
+				st[(n - 1)] = (z80_read(v) |
+					       (z80_read(v + 1) << 8));
+			else
+				st[(n - 1)] = misc_readword(v);
+			break;
+		case EXPR_MEM32:
+			v = st[(n - 1)];
+			if (context == DBG_CONTEXT_Z80)
+				st[(n - 1)] = (z80_read(v) |
+					       (z80_read(v + 1) << 8) |
+					       (z80_read(v + 2) << 16) |
+					       (z80_read(v + 3) << 24));
+			else
+				st[(n - 1)] = ((misc_readword(v) << 16) |
+					       misc_readword(v + 2));
+			break;
+		case EXPR_NEG:
+			st[(n - 1)] = -st[(n - 1)];
+			break;
+		case EXPR_NOT:
+			st[(n - 1)] = ~st[(n - 1)];
+			break;
+		case EXPR_LNOT:
+			st[(n - 1)] = !st[(n - 1)];
+			break;
+		case EXPR_BOOL:
+			st[(n - 1)] = !!st[(n - 1)];
+			break;
+		case EXPR_JZ:
+			if (st[(n - 1)] == 0)
+				i = e->code[i];
+			else {
+				--n;
+				++i;
+			}
+			break;
+		case EXPR_JNZ:
+			if (st[(n - 1)] != 0) {
+				st[(n - 1)] = 1;
+				i = e->code[i];
+			}
+			else {
+				--n;
+				++i;
+			}
+			break;
+		default:
+			// Binary operators.
+			v = st[(--n)];
+			switch (e->code[(i - 1)]) {
+			case EXPR_MUL:
+				st[(n - 1)] *= v;
+				break;
+			case EXPR_DIV:
+				st[(n - 1)] = (v ? (st[(n - 1)] / v) : 0);
+				break;
+			case EXPR_MOD:
+				st[(n - 1)] = (v ? (st[(n - 1)] % v) : 0);
+				break;
+			case EXPR_ADD:
+				st[(n - 1)] += v;
+				break;
+			case EXPR_SUB:
+				st[(n - 1)] -= v;
+				break;
+			case EXPR_SHL:
+				st[(n - 1)] = ((v < 32) ? (st[(n - 1)] << v) : 0);
+				break;
+			case EXPR_SHR:
+				st[(n - 1)] = ((v < 32) ? (st[(n - 1)] >> v) : 0);
+				break;
+			case EXPR_LT:
+				st[(n - 1)] = (st[(n - 1)] < v);
+				break;
+			case EXPR_LE:
+				st[(n - 1)] = (st[(n - 1)] <= v);
+				break;
+			case EXPR_GT:
+				st[(n - 1)] = (st[(n - 1)] > v);
+				break;
+			case EXPR_GE:
+				st[(n - 1)] = (st[(n - 1)] >= v);
+				break;
+			case EXPR_EQ:
+				st[(n - 1)] = (st[(n - 1)] == v);
+				break;
+			case EXPR_NE:
+				st[(n - 1)] = (st[(n - 1)] != v);
+				break;
+			case EXPR_AND:
+				st[(n - 1)] &= v;
+				break;
+			case EXPR_XOR:
+				st[(n - 1)] ^= v;
+				break;
+			case EXPR_OR:
+				st[(n - 1)] |= v;
+				break;
+			}
+			break;
+		}
+	}
+	return st[0];
+}
+
+/**
+ * Apply the condition and hit count of a breakpoint reached by a CPU.
+ * Tracepoints are logged here and never stop it.
+ *
+ * @param idx Index of the breakpoint.
+ * @param context DBG_CONTEXT_M68K or DBG_CONTEXT_Z80.
+ * @return true if the CPU should stop.
+ */
+bool md::debug_bp_hit(int idx, int context)
+{
+	struct dgen_bp *bp = ((context == DBG_CONTEXT_Z80) ?
+			      &(debug_bp_z80[idx]) : &(debug_bp_m68k[idx]));
+
+	if (debug_expr_eval(&(bp->cond), context) == 0)
+		return false;
+	++bp->hits;
+	if (bp->hits < bp->count)
+		return false;
+	if (!(bp->flags & BP_FLAG_LOG))
+		return true;
+	if (context == DBG_CONTEXT_Z80) {
+		z80_state_dump();
+		printf("z80 tracepoint #%d @ 0x%04x (hit %u):"
+		       " af=%04x bc=%04x de=%04x hl=%04x"
+		       " ix=%04x iy=%04x sp=%04x\n",
+		       idx, bp->addr, bp->hits,
+		       le2h16(z80_state.alt[0].fa),
+		       le2h16(z80_state.alt[0].cb),
+		       le2h16(z80_state.alt[0].ed),
+		       le2h16(z80_state.alt[0].lh),
+		       le2h16(z80_state.ix), le2h16(z80_state.iy),
+		       le2h16(z80_state.sp));
+	}
+	else {
+		unsigned int i;
+
+		m68k_state_dump();
+		printf("m68k tracepoint #%d @ 0x%08x (hit %u):\n\t",
+		       idx, bp->addr, bp->hits);
+		for (i = 0; (i < 8); ++i)
+			printf("d%u=%08x ", i, le2h32(m68k_state.d[i]));
+		printf("\n\t");
+		for (i = 0; (i < 8); ++i)
+			printf("a%u=%08x ", i, le2h32(m68k_state.a[i]));
+		printf("\n");
+	}
+	fflush(stdout);
+	return false;
+}
+
+/**
+ * Check M68K breakpoints for an address and enter the debugger if one
+ * matches.
+ *
+ * @param pc Address of the next instruction.
+ * @return true if a breakpoint fired.
+ */
+bool md::debug_m68k_check_bp(uint32_t pc)
+{
+	uint32_t bit = BP_MAP_M68K(pc);
+	unsigned int i;
+
+	if (!(debug_bp_m68k_map[(bit >> 5)] & (1 << (bit & 31))))
+		return false;
+	for (i = 0; (i < MAX_BREAKPOINTS); i++) {
+		if (!(debug_bp_m68k[i].flags & BP_FLAG_USED))
+			break; // no bps after first disabled one
+		if (pc == debug_bp_m68k[i].addr) {
+			if (debug_bp_m68k[i].flags & BP_FLAG_FIRED) {
+				debug_bp_m68k[i].flags &= ~BP_FLAG_FIRED;
+				continue;
+			}
+			if (!debug_bp_hit(i, DBG_CONTEXT_M68K))
+				continue;
+			debug_bp_m68k[i].flags |= BP_FLAG_FIRED;
+			printf("m68k breakpoint hit @ 0x%08x\n", pc);
+			debug_enter();
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Check Z80 breakpoints for an address and enter the debugger if one
+ * matches.
+ *
+ * @param pc Address of the next instruction.
+ * @return true if a breakpoint fired.
+ */
+bool md::debug_z80_check_bp(uint16_t pc)
+{
+	uint32_t bit = BP_MAP_Z80(pc);
+	unsigned int i;
+
+	if (!(debug_bp_z80_map[(bit >> 5)] & (1 << (bit & 31))))
+		return false;
+	for (i = 0; (i < MAX_BREAKPOINTS); i++) {
+		if (!(debug_bp_z80[i].flags & BP_FLAG_USED))
+			break; // no bps after first disabled one
+		if (pc == debug_bp_z80[i].addr) {
+			if (debug_bp_z80[i].flags & BP_FLAG_FIRED) {
+				debug_bp_z80[i].flags &= ~BP_FLAG_FIRED;
+				continue;
+			}
+			if (!debug_bp_hit(i, DBG_CONTEXT_Z80))
+				continue;
+			debug_bp_z80[i].flags |= BP_FLAG_FIRED;
+			printf("z80 breakpoint hit @ 0x%04x\n", pc);
+			debug_enter();
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Let the M68K core check breakpoints and pending watchpoints from its
+ * instruction hook while running full timeslices, instead of
+ * single-stepping through debug_m68k_check_bps().
+ *
+ * @param enable Whether hook checks should be enabled.
+ * @return false if the current core has no instruction hook.
+ */
+bool md::debug_m68k_hook(bool enable)
+{
+#ifdef WITH_MUSA
+	if ((cpu_emu == CPU_EMU_MUSA) || (cpu_emu == CPU_EMU_MUSA_JIT)) {
+		debug_m68k_hooked = (enable &&
+				     (debug_is_m68k_bp_set() ||
+				      debug_is_m68k_wp_set()));
+		return true;
+	}
+#endif
+	(void)enable;
+	debug_m68k_hooked = false;
+	return false;
+}
+
+#ifdef WITH_CZ80
+
+static int cz80_instr_hook(void *ctx, uint16_t pc)
+{
+	class md* md = (class md*)ctx;
+
+	if ((!md->debug_z80_check_wps()) && (!md->debug_z80_check_bp(pc)))
+		return 0;
+	fflush(stdout);
+	return 1;
+}
+
+#endif
 
-	switch (reg)
-	{
-	case Z80_REG_FA:
-		return le2h16(z80_state.alt[0].fa);
-	case Z80_REG_CB:
-		return le2h16(z80_state.alt[0].cb);
-	case Z80_REG_ED:
-		return le2h16(z80_state.alt[0].ed);
-	case Z80_REG_LH:
-		return le2h16(z80_state.alt[0].lh);
-	case Z80_REG_FA_ALT:
-		return le2h16(z80_state.alt[1].fa);
-	case Z80_REG_CB_ALT:
-		return le2h16(z80_state.alt[1].cb);
-	case Z80_REG_ED_ALT:
-		return le2h16(z80_state.alt[1].ed);
-	case Z80_REG_LH_ALT:
-		return le2h16(z80_state.alt[1].lh);
-	case Z80_REG_IX:
-		return le2h16(z80_state.ix);
-	case Z80_REG_IY:
-		return le2h16(z80_state.iy);
-	case Z80_REG_SP:
-		return le2h16(z80_state.sp);
-	case Z80_REG_PC:
-		return le2h16(z80_state.pc);
+/**
+ * Z80 counterpart of debug_m68k_hook().
+ *
+ * @param enable Whether hook checks should be enabled.
+ * @return false if the current core has no instruction hook.
+ */
+bool md::debug_z80_hook(bool enable)
+{
+#ifdef WITH_CZ80
+	if (z80_core == Z80_CORE_CZ80) {
+		enable = (enable &&
+			  (debug_is_z80_bp_set() || debug_is_z80_wp_set()));
+		Cz80_Set_Instr_Hook(&cz80, (enable ? cz80_instr_hook : NULL));
+		return true;
 	}
-
-	return 0;
-};
+#endif
+	(void)enable;
+	return false;
+}
 
 /**
  * Breakpoint handler fired before every M68K instruction.
@@ -591,7 +1567,6 @@ uint16_t md::debug_z80_get_reg(int reg)
 bool md::debug_m68k_check_bps()
 {
 	uint32_t pc = m68k_get_pc();
-	unsigned int i;
 	bool bp = false;
 
 	if (debug_step_m68k) {
@@ -601,21 +1576,7 @@ bool md::debug_m68k_check_bps()
 		}
 		goto trace;
 	}
-	for (i = 0; (i < MAX_BREAKPOINTS); i++) {
-		if (!(debug_bp_m68k[i].flags & BP_FLAG_USED))
-			break; // no bps after first disabled one
-		if (pc == debug_bp_m68k[i].addr) {
-			if (debug_bp_m68k[i].flags & BP_FLAG_FIRED) {
-				debug_bp_m68k[i].flags &= ~BP_FLAG_FIRED;
-				continue;
-			}
-			debug_bp_m68k[i].flags |= BP_FLAG_FIRED;
-			printf("m68k breakpoint hit @ 0x%08x\n", pc);
-			debug_enter();
-			bp = true;
-			break;
-		}
-	}
+	bp = debug_m68k_check_bp(pc);
 trace:
 	if (debug_trace_m68k) {
 		if (!bp)
@@ -627,28 +1588,45 @@ trace:
 }
 
 /**
- * Watchpoint handler fired after every M68K instruction.
+ * Watchpoint handler fired after M68K instructions, reports the watchpoint
+ * left pending by debug_m68k_match_wps().
  */
 bool md::debug_m68k_check_wps()
 {
-	unsigned int i;
-	bool wp = false;
-
-	for (i = 0; (i < MAX_WATCHPOINTS); i++) {
-		if (!(debug_wp_m68k[i].flags & BP_FLAG_USED))
-			break; // no wps after first disabled one
-		if (debug_should_m68k_wp_fire(&(debug_wp_m68k[i]))) {
-			printf("m68k watchpoint #%d fired\n", i);
-			debug_wp_m68k[i].flags |= WP_FLAG_FIRED;
-			debug_print_m68k_wp(i);
-			debug_enter();
-			debug_update_fired_m68k_wps();
-			wp = true;
-			break;
+	int i = debug_wp_m68k_hit;
+	struct dgen_wp *w;
+
+#ifdef WITH_STAR
+	// Starscream accesses RAM directly, compare it with cached data.
+	if ((i < 0) && (cpu_emu == CPU_EMU_STAR)) {
+		for (i = 0; (i < MAX_WATCHPOINTS); i++) {
+			w = &(debug_wp_m68k[i]);
+			if (!(w->flags & WP_FLAG_USED))
+				break; // no wps after first disabled one
+			if ((w->flags & WP_FLAG_WRITE) &&
+			    (debug_should_m68k_wp_fire(w))) {
+				w->flags |= WP_FLAG_FIRED;
+				w->hit_addr = w->start_addr;
+				w->hit_flags = (WP_FLAG_WRITE | WP_FLAG_SIZE);
+				break;
+			}
 		}
+		if ((i == MAX_WATCHPOINTS) ||
+		    (!(debug_wp_m68k[i].flags & WP_FLAG_FIRED)))
+			return false;
 	}
+#endif
+	if (i < 0)
+		return false;
+	debug_wp_m68k_hit = -1;
+	w = &(debug_wp_m68k[i]);
+	printf("m68k watchpoint #%d fired (%s @ 0x%08x)\n",
+	       i, debug_wp_type(w->hit_flags), w->hit_addr);
+	debug_print_m68k_wp(i);
+	debug_enter();
+	debug_update_fired_m68k_wps();
 	fflush(stdout);
-	return wp;
+	return true;
 }
 
 /**
@@ -657,7 +1635,6 @@ bool md::debug_m68k_check_wps()
 bool md::debug_z80_check_bps()
 {
 	uint16_t pc = z80_get_pc();
-	unsigned int i;
 	bool bp = false;
 
 	if (debug_step_z80) {
@@ -667,21 +1644,7 @@ bool md::debug_z80_check_bps()
 		}
 		goto trace;
 	}
-	for (i = 0; (i < MAX_BREAKPOINTS); i++) {
-		if (!(debug_bp_z80[i].flags & BP_FLAG_USED))
-			break; // no bps after first disabled one
-		if (pc == debug_bp_z80[i].addr) {
-			if (debug_bp_z80[i].flags & BP_FLAG_FIRED) {
-				debug_bp_z80[i].flags &= ~BP_FLAG_FIRED;
-				continue;
-			}
-			debug_bp_z80[i].flags |= BP_FLAG_FIRED;
-			printf("z80 breakpoint hit @ 0x%04x\n", pc);
-			debug_enter();
-			bp = true;
-			break;
-		}
-	}
+	bp = debug_z80_check_bp(pc);
 trace:
 	if (debug_trace_z80) {
 		if (!bp)
@@ -693,28 +1656,25 @@ trace:
 }
 
 /**
- * Watchpoint handler fired after every Z80 instruction.
+ * Watchpoint handler fired after Z80 instructions, reports the watchpoint
+ * left pending by debug_z80_match_wps().
  */
 bool md::debug_z80_check_wps()
 {
-	unsigned int i;
-	bool wp = false;
-
-	for (i = 0; (i < MAX_WATCHPOINTS); i++) {
-		if (!(debug_wp_z80[i].flags & BP_FLAG_USED))
-			break;
-		if (debug_should_z80_wp_fire(&(debug_wp_z80[i]))) {
-			printf("z80 watchpoint #%d fired\n", i);
-			debug_wp_z80[i].flags |= WP_FLAG_FIRED;
-			debug_print_z80_wp(i);
-			debug_enter();
-			debug_update_fired_z80_wps();
-			wp = true;
-			break;
-		}
-	}
+	int i = debug_wp_z80_hit;
+	struct dgen_wp *w;
+
+	if (i < 0)
+		return false;
+	debug_wp_z80_hit = -1;
+	w = &(debug_wp_z80[i]);
+	printf("z80 watchpoint #%d fired (%s @ 0x%04x)\n",
+	       i, debug_wp_type(w->hit_flags), w->hit_addr);
+	debug_print_z80_wp(i);
+	debug_enter();
+	debug_update_fired_z80_wps();
 	fflush(stdout);
-	return wp;
+	return true;
 }
 
 /**
@@ -742,6 +1702,7 @@ void md::debug_rm_bp_m68k(int index)
 		debug_bp_m68k[MAX_BREAKPOINTS - 1].addr = 0;
 		debug_bp_m68k[MAX_BREAKPOINTS - 1].flags = 0;
 	}
+	debug_update_bp_m68k_map();
 }
 
 /**
@@ -768,6 +1729,7 @@ void md::debug_rm_bp_z80(int index)
 		debug_bp_z80[MAX_BREAKPOINTS - 1].addr = 0;
 		debug_bp_z80[MAX_BREAKPOINTS - 1].flags = 0;
 	}
+	debug_update_bp_z80_map();
 }
 
 /**
@@ -792,11 +1754,12 @@ void md::debug_rm_wp_m68k(int index)
 	} else {
 		memmove(&(debug_wp_m68k[index]),
 		    &(debug_wp_m68k[index+1]),
-		    sizeof(struct dgen_bp) * (MAX_WATCHPOINTS - index - 1));
+		    sizeof(struct dgen_wp) * (MAX_WATCHPOINTS - index - 1));
 		// disable last slot
 		debug_wp_m68k[MAX_WATCHPOINTS - 1].start_addr = 0;
 		debug_wp_m68k[MAX_WATCHPOINTS - 1].flags = 0;
 	}
+	debug_update_wp_m68k_map();
 }
 
 /**
@@ -819,11 +1782,30 @@ void md::debug_rm_wp_z80(int index)
 	else {
 		memmove(&debug_wp_z80[index],
 			&debug_wp_z80[index + 1],
-			(sizeof(struct dgen_bp) *
+			(sizeof(struct dgen_wp) *
 			 (MAX_WATCHPOINTS - index - 1)));
 		debug_wp_z80[MAX_WATCHPOINTS - 1].start_addr = 0;
 		debug_wp_z80[MAX_WATCHPOINTS - 1].flags = 0;
 	}
+	debug_update_wp_z80_map();
+}
+
+/**
+ * Print the condition, hit count and type of a breakpoint, then end the
+ * line.
+ *
+ * @param bp Breakpoint.
+ */
+static void debug_print_bp(const struct dgen_bp *bp)
+{
+	if (bp->flags & BP_FLAG_LOG)
+		printf(" (trace)");
+	printf(" hits %u", bp->hits);
+	if (bp->count)
+		printf("/%u", bp->count);
+	if (bp->cond.len)
+		printf(" if %s", bp->cond.str);
+	printf("\n");
 }
 
 /**
@@ -838,7 +1820,8 @@ void md::debug_list_bps_m68k()
 		if (!(debug_bp_m68k[i].flags & BP_FLAG_USED))
 			break; // can be no more after first disabled bp
 
-		printf("#%0d:\t0x%08x\n", i, debug_bp_m68k[i].addr);
+		printf("#%0d:\t0x%08x", i, debug_bp_m68k[i].addr);
+		debug_print_bp(&(debug_bp_m68k[i]));
 	}
 
 	if (i == 0)
@@ -857,7 +1840,8 @@ void md::debug_list_bps_z80()
 	for (i = 0; (i < MAX_BREAKPOINTS); i++) {
 		if (!(debug_bp_z80[i].flags & BP_FLAG_USED))
 			break;
-		printf("#%0d:\t0x%04x\n", i, debug_bp_z80[i].addr);
+		printf("#%0d:\t0x%04x", i, debug_bp_z80[i].addr);
+		debug_print_bp(&(debug_bp_z80[i]));
 	}
 	if (i == 0)
 		printf("\tno z80 breakpoints set\n");
@@ -922,8 +1906,10 @@ int md::debug_set_bp_m68k(uint32_t addr)
 		goto out;
 	}
 
+	memset(&(debug_bp_m68k[slot]), 0, sizeof(debug_bp_m68k[slot]));
 	debug_bp_m68k[slot].addr = addr;
 	debug_bp_m68k[slot].flags = BP_FLAG_USED;
+	debug_update_bp_m68k_map();
 	printf("m68k breakpoint #%d set @ 0x%08x\n", slot, addr);
 out:
 	fflush(stdout);
@@ -937,6 +1923,7 @@ out:
 void md::debug_clear_bp_m68k()
 {
 	memset(debug_bp_m68k, 0, sizeof(debug_bp_m68k));
+	debug_update_bp_m68k_map();
 }
 
 void md::debug_clear_bp_m68k(uint32_t addr)
@@ -959,6 +1946,7 @@ void md::debug_clear_bp_m68k(uint32_t addr)
 		memcpy(temp, &debug_bp_m68k[shuffleIndex], sizeof(dgen_bp) * (MAX_BREAKPOINTS - shuffleIndex));
 		memcpy(&debug_bp_m68k[shuffleIndex-1], temp, sizeof(dgen_bp) * (MAX_BREAKPOINTS - shuffleIndex));
 	}
+	debug_update_bp_m68k_map();
 }
 
 /**
@@ -980,14 +1968,54 @@ int md::debug_set_bp_z80(uint16_t addr)
 		printf("No space for another break point\n");
 		goto out;
 	}
+	memset(&(debug_bp_z80[slot]), 0, sizeof(debug_bp_z80[slot]));
 	debug_bp_z80[slot].addr = addr;
 	debug_bp_z80[slot].flags = BP_FLAG_USED;
+	debug_update_bp_z80_map();
 	printf("z80 breakpoint #%d set @ 0x%04x\n", slot, addr);
 out:
 	fflush(stdout);
 	return 1;
 }
 
+/**
+ * Set the condition, hit count and type of an existing breakpoint.
+ * Its hit counter is reset.
+ *
+ * @param context DBG_CONTEXT_M68K or DBG_CONTEXT_Z80.
+ * @param index Breakpoint index.
+ * @param cond Condition expression, NULL to leave it unchanged, empty to
+ * remove it.
+ * @param count Number of hits before firing, 0 or 1 to fire every time.
+ * @param log Nonzero to log instead of stopping (tracepoint).
+ * @return 0 on success, -1 on error.
+ */
+int md::debug_set_bp_cond(int context, int index, const char *cond,
+			  uint32_t count, int log)
+{
+	struct dgen_bp *bp;
+
+	if ((index < 0) || (index >= MAX_BREAKPOINTS))
+		return -1;
+	if (context == DBG_CONTEXT_M68K)
+		bp = &(debug_bp_m68k[index]);
+	else if (context == DBG_CONTEXT_Z80)
+		bp = &(debug_bp_z80[index]);
+	else
+		return -1;
+	if (!(bp->flags & BP_FLAG_USED))
+		return -1;
+	if ((cond != NULL) && (debug_expr_compile(&(bp->cond), cond, context)))
+		return -1;
+	bp->count = count;
+	bp->hits = 0;
+	if (log)
+		bp->flags |= BP_FLAG_LOG;
+	else
+		bp->flags &= ~BP_FLAG_LOG;
+	return 0;
+}
+
 /**
  * Convert a core name to a context ID.
  *
@@ -1037,8 +2065,10 @@ static int debug_parse_cpu(char *arg)
  *
  * @param start_addr Start address of watchpoint range.
  * @param end_addr End address of watchpoint range.
+ * @param flags Accesses and sizes to watch, see WP_FLAG*.
  */
-void md::debug_set_wp_m68k(uint32_t start_addr, uint32_t end_addr)
+void md::debug_set_wp_m68k(uint32_t start_addr, uint32_t end_addr,
+			   uint32_t flags)
 {
 	int		slot;
 
@@ -1050,17 +2080,19 @@ void md::debug_set_wp_m68k(uint32_t start_addr, uint32_t end_addr)
 
 	debug_wp_m68k[slot].start_addr = start_addr;
 	debug_wp_m68k[slot].end_addr = end_addr;
-	debug_wp_m68k[slot].flags = WP_FLAG_USED;
 	debug_wp_m68k[slot].bytes = (unsigned char *) malloc(end_addr - start_addr + 1);
 	if (debug_wp_m68k[slot].bytes == NULL) {
 		perror("malloc");
 		goto out;
 	}
+	debug_wp_m68k[slot].flags = (WP_FLAG_USED | flags);
 
 	debug_update_m68k_wp_cache(&(debug_wp_m68k[slot]));
+	debug_update_wp_m68k_map();
 
-	printf("m68k watchpoint #%d set @ 0x%08x-0x%08x (%u bytes)\n",
-	    slot, start_addr, end_addr, end_addr - start_addr + 1);
+	printf("m68k watchpoint #%d set @ 0x%08x-0x%08x (%u bytes, %s)\n",
+	    slot, start_addr, end_addr, end_addr - start_addr + 1,
+	    debug_wp_type(flags));
 out:
 	fflush(stdout);
 }
@@ -1068,6 +2100,7 @@ out:
 void md::debug_clear_wp_m68k()
 {
 	memset(debug_wp_m68k, 0, sizeof(debug_wp_m68k));
+	debug_update_wp_m68k_map();
 }
 
 void md::debug_clear_wp_m68k(uint32_t start_addr)
@@ -1092,6 +2125,7 @@ void md::debug_clear_wp_m68k(uint32_t start_addr)
 		memcpy(temp, &debug_wp_m68k[shuffleIndex], sizeof(dgen_wp) * (MAX_WATCHPOINTS - shuffleIndex));
 		memcpy(&debug_wp_m68k[shuffleIndex-1], temp, sizeof(dgen_wp) * (MAX_WATCHPOINTS - shuffleIndex));
 	}
+	debug_update_wp_m68k_map();
 }
 
 /**
@@ -1135,8 +2169,10 @@ void md::debug_update_fired_m68k_wps()
  *
  * @param start_addr Start address of watchpoint range.
  * @param end_addr End address of watchpoint range.
+ * @param flags Accesses and sizes to watch, see WP_FLAG*.
  */
-void md::debug_set_wp_z80(uint16_t start_addr, uint16_t end_addr)
+void md::debug_set_wp_z80(uint16_t start_addr, uint16_t end_addr,
+			  uint32_t flags)
 {
 	int slot;
 
@@ -1147,16 +2183,18 @@ void md::debug_set_wp_z80(uint16_t start_addr, uint16_t end_addr)
 	}
 	debug_wp_z80[slot].start_addr = start_addr;
 	debug_wp_z80[slot].end_addr = end_addr;
-	debug_wp_z80[slot].flags = WP_FLAG_USED;
 	debug_wp_z80[slot].bytes =
 		(unsigned char *)malloc(end_addr - start_addr + 1);
 	if (debug_wp_z80[slot].bytes == NULL) {
 		perror("malloc");
 		goto out;
 	}
+	debug_wp_z80[slot].flags = (WP_FLAG_USED | flags);
 	debug_update_z80_wp_cache(&(debug_wp_z80[slot]));
-	printf("z80 watchpoint #%d set @ 0x%04x-0x%04x (%u bytes)\n",
-	       slot, start_addr, end_addr, (end_addr - start_addr + 1));
+	debug_update_wp_z80_map();
+	printf("z80 watchpoint #%d set @ 0x%04x-0x%04x (%u bytes, %s)\n",
+	       slot, start_addr, end_addr, (end_addr - start_addr + 1),
+	       debug_wp_type(flags));
 out:
 	fflush(stdout);
 }
@@ -1200,6 +2238,8 @@ void md::debug_update_fired_z80_wps()
  *   defined in args[0].
  * - If n_args == 2 then add a watch point with start address args[0] and
  *   length args[1].
+ * - If n_args == 3 then args[2] is the watchpoint type, see
+ *   debug_strtowp(). Writes of any size are watched otherwise.
  *
  * @param n_args Number of arguments.
  * @param args Arguments, see above.
@@ -1208,14 +2248,22 @@ void md::debug_update_fired_z80_wps()
 int md::debug_cmd_watch(int n_args, char **args)
 {
 	uint32_t		start, len = 1;
+	uint32_t		flags = WP_FLAG_DEFAULT;
 
-	if (debug_context != DBG_CONTEXT_M68K){
+	if ((debug_context != DBG_CONTEXT_M68K) &&
+	    (debug_context != DBG_CONTEXT_Z80)) {
 		printf("watchpoints not supported on %s core\n",
 		    CURRENT_DEBUG_CONTEXT_NAME);
 		goto out;
 	}
 
 	switch (n_args) {
+	case 3:
+		if ((debug_strtowp(args[2], &flags)) < 0) {
+			printf("type malformed: %s\n", args[2]);
+			goto out;
+		}
+		// fallthru
 	case 2:
 		if ((debug_strtou32(args[1], &len)) < 0) {
 			printf("length malformed: %s\n", args[1]);
@@ -1227,11 +2275,21 @@ int md::debug_cmd_watch(int n_args, char **args)
 			printf("address malformed: %s\n", args[0]);
 			goto out;
 		}
-		debug_set_wp_m68k(start, start+len-1); // one byte
+		if (len == 0) {
+			printf("length malformed: %s\n", args[1]);
+			goto out;
+		}
+		if (debug_context == DBG_CONTEXT_Z80)
+			debug_set_wp_z80(start, (start + len - 1), flags);
+		else
+			debug_set_wp_m68k(start, (start + len - 1), flags);
 		break;
 	case 0:
 		// listing wps
-		debug_list_wps_m68k();
+		if (debug_context == DBG_CONTEXT_Z80)
+			debug_list_wps_z80();
+		else
+			debug_list_wps_m68k();
 		break;
 	};
 out:
@@ -1680,6 +2738,10 @@ int md::debug_cmd_help(int n_args, char **args)
 	    "\t-b/-break <#num/addr>\tremove breakpoint for current cpu\n"
 	    "\tb/break <addr>\t\tset breakpoint for current cpu\n"
 	    "\tb/break\t\t\tshow breakpoints for current cpu\n"
+	    "\tcond <#num/addr> [expr]\tbreak only when 'expr' is true\n"
+	    "\t\t\t\t(e.g. \"d0 == 3 && (a1).b > $80\")\n"
+	    "\thits <#num/addr> <num>\tbreak after 'num' hits\n"
+	    "\ttp/tracepoint <addr> [expr]\tlog registers at 'addr'\n"
 	    "\tc/cont\t\t\texit debugger and continue execution\n"
 	    "\td/dis <addr> <num>\tdisasm 'num' instrs starting at 'addr'\n"
 	    "\td/dis <addr>\t\tdisasm %u instrs starting at 'addr'\n"
@@ -1697,6 +2759,8 @@ int md::debug_cmd_help(int n_args, char **args)
 	    "\ts/step <num>\t\tstep 'num' instructions\n"
 	    "\tt/trace [bool|num]\ttoggle instructions tracing\n"
 	    "\t-w/-watch <#num/addr>\tremove watchpoint for current cpu\n"
+	    "\tw/watch <addr> <len> <type>\tset watchpoint on accesses 'type'\n"
+	    "\t\t\t\t(r, w or rw, then sizes e.g. \"w.bw\")\n"
 	    "\tw/watch <addr> <len>\tset multi-byte watchpoint for current cpu\n"
 	    "\tw/watch <addr>\t\tset 1-byte watchpoint for current cpu\n"
 	    "\tw/watch\t\t\tshow watchpoints for current cpu\n"
@@ -1732,7 +2796,7 @@ int md::debug_cmd_reg(int n_args, char **args)
 		debug_show_z80_regs();
 		break;
 	case DBG_CONTEXT_YM2612:
-		debug_show_ym2612_regs();
+		debug_show_ym2612_regs(ctx_ym2612);
 		break;
 	default:
 		printf("register dump not implemented on %s core\n",
@@ -1843,6 +2907,166 @@ out:
 	return (1);
 }
 
+/**
+ * Join arguments back into a single expression string.
+ *
+ * @param[out] buf Output buffer.
+ * @param size Size of buf.
+ * @param n_args Number of arguments.
+ * @param[in] args List of arguments.
+ * @return -1 if the result does not fit.
+ */
+static int debug_join_args(char *buf, size_t size, int n_args, char **args)
+{
+	size_t len = 0;
+	int i;
+
+	buf[0] = '\0';
+	for (i = 0; (i < n_args); ++i) {
+		size_t n = strlen(args[i]);
+
+		if ((len + n + 2) > size) {
+			printf("condition too long\n");
+			return -1;
+		}
+		if (i)
+			buf[(len++)] = ' ';
+		memcpy(&buf[len], args[i], (n + 1));
+		len += n;
+	}
+	return 0;
+}
+
+/**
+ * Breakpoint condition (cond) command handler.
+ *
+ * - args[0] is a breakpoint index ("#n") or address.
+ * - If more arguments follow, they form the condition expression,
+ *   otherwise the condition is removed.
+ *
+ * @param n_args Number of arguments.
+ * @param[in] args List of arguments.
+ * @return Always 1.
+ */
+int md::debug_cmd_cond(int n_args, char **args)
+{
+	char expr[MAX_EXPR_LEN];
+	struct dgen_bp *bp;
+	int index;
+
+	if ((debug_context != DBG_CONTEXT_M68K) &&
+	    (debug_context != DBG_CONTEXT_Z80)) {
+		printf("breakpoints are not supported on %s\n",
+		       CURRENT_DEBUG_CONTEXT_NAME);
+		goto out;
+	}
+	if (((index = debug_parse_bp(args[0])) < 0) ||
+	    (debug_join_args(expr, sizeof(expr), (n_args - 1), &args[1])))
+		goto out;
+	bp = ((debug_context == DBG_CONTEXT_M68K) ?
+	      &(debug_bp_m68k[index]) : &(debug_bp_z80[index]));
+	if (debug_set_bp_cond(debug_context, index, expr, bp->count,
+			      (bp->flags & BP_FLAG_LOG))) {
+		printf("cannot set condition on breakpoint #%d\n", index);
+		goto out;
+	}
+	if (expr[0] == '\0')
+		printf("breakpoint #%d is now unconditional\n", index);
+	else
+		printf("breakpoint #%d condition: %s\n", index, expr);
+out:
+	fflush(stdout);
+	return 1;
+}
+
+/**
+ * Breakpoint hit count (hits) command handler.
+ * The breakpoint at args[0] ("#n" or address) only fires after being
+ * reached args[1] times, its counter is reset.
+ *
+ * @param n_args Number of arguments (always 2).
+ * @param[in] args List of arguments.
+ * @return Always 1.
+ */
+int md::debug_cmd_hits(int n_args, char **args)
+{
+	struct dgen_bp *bp;
+	uint32_t num;
+	int index;
+
+	(void)n_args;
+	if ((debug_context != DBG_CONTEXT_M68K) &&
+	    (debug_context != DBG_CONTEXT_Z80)) {
+		printf("breakpoints are not supported on %s\n",
+		       CURRENT_DEBUG_CONTEXT_NAME);
+		goto out;
+	}
+	if ((index = debug_parse_bp(args[0])) < 0)
+		goto out;
+	if (debug_strtou32(args[1], &num) < 0) {
+		printf("invalid count: %s\n", args[1]);
+		goto out;
+	}
+	bp = ((debug_context == DBG_CONTEXT_M68K) ?
+	      &(debug_bp_m68k[index]) : &(debug_bp_z80[index]));
+	if (debug_set_bp_cond(debug_context, index, NULL, num,
+			      (bp->flags & BP_FLAG_LOG))) {
+		printf("cannot set hit count on breakpoint #%d\n", index);
+		goto out;
+	}
+	printf("breakpoint #%d fires after %u hit(s)\n", index, num);
+out:
+	fflush(stdout);
+	return 1;
+}
+
+/**
+ * Tracepoint (tp) command handler.
+ * Set a breakpoint at address args[0] which logs registers instead of
+ * stopping, optionally only when the condition made of the remaining
+ * arguments is true.
+ *
+ * @param n_args Number of arguments.
+ * @param[in] args List of arguments.
+ * @return Always 1.
+ */
+int md::debug_cmd_tp(int n_args, char **args)
+{
+	char expr[MAX_EXPR_LEN];
+	uint32_t num;
+	int index;
+
+	if ((debug_context != DBG_CONTEXT_M68K) &&
+	    (debug_context != DBG_CONTEXT_Z80)) {
+		printf("tracepoints are not supported on %s\n",
+		       CURRENT_DEBUG_CONTEXT_NAME);
+		goto out;
+	}
+	if ((debug_strtou32(args[0], &num)) < 0) {
+		printf("address malformed: %s\n", args[0]);
+		goto out;
+	}
+	if (debug_join_args(expr, sizeof(expr), (n_args - 1), &args[1]))
+		goto out;
+	if (debug_context == DBG_CONTEXT_M68K) {
+		debug_set_bp_m68k(num);
+		index = debug_find_bp_m68k(num);
+	}
+	else {
+		debug_set_bp_z80(num);
+		index = debug_find_bp_z80(num);
+	}
+	if ((index < 0) ||
+	    (debug_set_bp_cond(debug_context, index, expr, 0, 1))) {
+		printf("cannot set tracepoint @ %s\n", args[0]);
+		goto out;
+	}
+	printf("breakpoint #%d is now a tracepoint\n", index);
+out:
+	fflush(stdout);
+	return 1;
+}
+
 /**
  * Quit (quit) command handler.
  * This command makes DGen/SDL quit.
@@ -2049,61 +3273,76 @@ out:
 
 
 /**
- * Breakpoint removal (-break) command handler.
+ * Find a breakpoint of the current context by "#index" or by address.
  *
- * If args[0] starts with a #, remove a breakpoint by ID. Otherwise, remove
- * it by address.
- *
- * @param n_args Number of arguments (always 1).
- * @param args List of arguments.
- * @return Always 1.
+ * @param[in] arg Breakpoint index or address.
+ * @return Breakpoint index or -1 on error.
  */
-int md::debug_cmd_minus_break(int n_args, char **args)
+int md::debug_parse_bp(const char *arg)
 {
 	int			index = -1;
 	uint32_t		num;
 
-	(void) n_args;
-
-	if ((debug_context != DBG_CONTEXT_M68K) &&
-	    (debug_context != DBG_CONTEXT_Z80)) {
-		printf("breakpoints not supported on %s\n",
-		       CURRENT_DEBUG_CONTEXT_NAME);
-		goto out;
-	}
-
-	if (args[0][0] == '#') { // remove by index
+	if (arg[0] == '#') { // by index
 
-		if (strlen(args[0]) < 2) {
+		if (strlen(arg) < 2) {
 		    printf("parse error\n");
-		    goto out;
+		    return -1;
 		}
 
-		if ((debug_strtou32(args[0]+1, &num)) < 0) {
-			printf("address malformed: %s\n", args[0]);
-			goto out;
+		if ((debug_strtou32(arg+1, &num)) < 0) {
+			printf("address malformed: %s\n", arg);
+			return -1;
 		}
 		index = num;
 
 		if ((index < 0) || (index >= MAX_BREAKPOINTS)) {
 			printf("breakpoint out of range\n");
-			goto out;
+			return -1;
 		}
 
-	} else { // remove by address
-		if ((debug_strtou32(args[0], &num)) < 0) {
-			printf("address malformed: %s\n", args[0]);
-			goto out;
+	} else { // by address
+		if ((debug_strtou32(arg, &num)) < 0) {
+			printf("address malformed: %s\n", arg);
+			return -1;
 		}
 		if (debug_context == DBG_CONTEXT_M68K)
 			index = debug_find_bp_m68k(num);
 		else if (debug_context == DBG_CONTEXT_Z80)
 			index = debug_find_bp_z80(num);
 		if (index < 0) {
-			printf("no breakpoint here: %s\n", args[0]);
-			goto out;
+			printf("no breakpoint here: %s\n", arg);
+			return -1;
 		}
 	}
+	return index;
+}
+
+/**
+ * Breakpoint removal (-break) command handler.
+ *
+ * If args[0] starts with a #, remove a breakpoint by ID. Otherwise, remove
+ * it by address.
+ *
+ * @param n_args Number of arguments (always 1).
+ * @param args List of arguments.
+ * @return Always 1.
+ */
+int md::debug_cmd_minus_break(int n_args, char **args)
+{
+	int			index;
+
+	(void) n_args;
+
+	if ((debug_context != DBG_CONTEXT_M68K) &&
+	    (debug_context != DBG_CONTEXT_Z80)) {
+		printf("breakpoints not supported on %s\n",
+		       CURRENT_DEBUG_CONTEXT_NAME);
+		goto out;
+	}
+
+	if ((index = debug_parse_bp(args[0])) < 0)
+		goto out;
 	// we now have an index into our bp array
 	if (debug_context == DBG_CONTEXT_M68K)
 		debug_rm_bp_m68k(index);
@@ -2130,7 +3369,10 @@ int md::debug_despatch_cmd(int n_toks, char **toks)
 	if (n_toks == 0)
 		return 1;
 	while (d->cmd != NULL) {
-		if ((strcmp(toks[0], d->cmd) == 0) && (n_toks-1 == d->n_args)) {
+		// negative n_args means at least -n_args arguments
+		if ((strcmp(toks[0], d->cmd) == 0) &&
+		    ((n_toks-1 == d->n_args) ||
+		     ((d->n_args < 0) && (n_toks-1 >= -d->n_args)))) {
 			found = d;
 			break;
 		}
@@ -2297,6 +3539,10 @@ const struct md::dgen_debugger_cmd md::debug_cmd_list[] = {
 		{(char *) "b",		0,	&md::debug_cmd_break},
 		{(char *) "-break",	1,	&md::debug_cmd_minus_break},
 		{(char *) "-b",		1,	&md::debug_cmd_minus_break},
+		{(char *) "cond",	-1,	&md::debug_cmd_cond},
+		{(char *) "hits",	2,	&md::debug_cmd_hits},
+		{(char *) "tracepoint",	-1,	&md::debug_cmd_tp},
+		{(char *) "tp",		-1,	&md::debug_cmd_tp},
 		// switch debug context
 		{(char *) "C",		1,	&md::debug_cmd_cpu},
 		{(char *) "cpu",	1,	&md::debug_cmd_cpu},
@@ -2344,6 +3590,8 @@ const struct md::dgen_debugger_cmd md::debug_cmd_list[] = {
 		{(char *) "trace",	0,	&md::debug_cmd_trace},
 		{(char *) "t",		0,	&md::debug_cmd_trace},
 		// watch points
+		{(char *) "watch",	3,	&md::debug_cmd_watch},
+		{(char *) "w",		3,	&md::debug_cmd_watch},
 		{(char *) "watch",	2,	&md::debug_cmd_watch},
 		{(char *) "w",		2,	&md::debug_cmd_watch},
 		{(char *) "watch",	1,	&md::debug_cmd_watch},
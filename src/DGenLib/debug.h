@@ -10,8 +10,16 @@
 #define MAX_BREAKPOINTS			64
 /** Maximum number of watchpoints supported. */
 #define MAX_WATCHPOINTS			64
+/** Number of bits in breakpoint address filters. */
+#define BP_MAP_BITS			0x10000
+/** Number of pages in watchpoint filters (64KiB on M68K, 256B on Z80). */
+#define WP_PAGES			0x100
+/** Maximum number of words in a compiled breakpoint condition. */
+#define MAX_EXPR_CODE			64
+/** Maximum length of a breakpoint condition. */
+#define MAX_EXPR_LEN			80
 /** Maximum number of tokens on the debugger command line. */
-#define MAX_DEBUG_TOKS			8
+#define MAX_DEBUG_TOKS			24
 /** Default number of instructions to disassemble. */
 #define DEBUG_DFLT_DASM_LEN		16
 /** Default number of bytes to display while dumping memory. */
@@ -22,12 +30,23 @@
 #define DBG_CONTEXT_YM2612		2
 #define DBG_CONTEXT_SN76489		3
 
+/** Compiled breakpoint condition, see debug_expr_compile(). */
+struct dgen_expr {
+	unsigned int	len; /**< Number of words in code, 0 if none. */
+	uint32_t	code[MAX_EXPR_CODE]; /**< Opcodes and operands. */
+	char		str[MAX_EXPR_LEN]; /**< Source expression. */
+};
+
 /** Breakpoint structure. */
 struct dgen_bp {
 	uint32_t	addr; /**< Address to break on. */
 #define BP_FLAG_USED		(1<<0) /**< Breakpoint enabled. */
 #define BP_FLAG_FIRED		(1<<1) /**< Set when breakpoint fires. */
+#define BP_FLAG_LOG		(1<<2) /**< Tracepoint, log without stopping. */
 	uint32_t	flags; /**< Flags for breakpoint, see BP_FLAG*. */
+	uint32_t	hits; /**< Number of times the condition held. */
+	uint32_t	count; /**< Hits needed before stopping, 0 for any. */
+	struct dgen_expr cond; /**< Condition, always true when empty. */
 };
 
 /** Watchpoint structure. */
@@ -36,10 +55,19 @@ struct dgen_wp {
 	uint32_t	 end_addr;   /**< Address to stop watching to. */
 #define WP_FLAG_USED		(1<<0) /**< Watchpoint enabled. */
 #define WP_FLAG_FIRED		(1<<1) /**< Set when watchpoint fires. */
+#define WP_FLAG_READ		(1<<2) /**< Fire on reads. */
+#define WP_FLAG_WRITE		(1<<3) /**< Fire on writes. */
+#define WP_FLAG_BYTE		(1<<4) /**< Fire on byte accesses. */
+#define WP_FLAG_WORD		(1<<5) /**< Fire on word accesses. */
+#define WP_FLAG_LONG		(1<<6) /**< Fire on long accesses. */
+#define WP_FLAG_SIZE		(WP_FLAG_BYTE | WP_FLAG_WORD | WP_FLAG_LONG)
+#define WP_FLAG_DEFAULT		(WP_FLAG_WRITE | WP_FLAG_SIZE)
 	uint32_t	 flags;     /**< Flags for watchpoint, see WP_FLAG*. */
+	uint32_t	 hit_addr;  /**< Address of the access that fired. */
+	uint32_t	 hit_flags; /**< Type and size of that access. */
 	unsigned char	*bytes;
 };
 
-extern "C" void		debug_show_ym2612_regs(void); // fm.c
+extern "C" void		debug_show_ym2612_regs(struct ym2612 *chips); // fm.c
 
 #endif
@@ -10,6 +10,8 @@ extern "C"
 #include "md.h"
 }
 
+#include "frames.h"
+#include "sound_ring.h"
 #include "sdl/pd-defs.h"
 #include "sdl_pad.h"
 
@@ -42,70 +44,15 @@ int sdlWindowHeight;
 
 static unsigned char*	mdpal = NULL;
 static struct sndinfo	sndi;
-static struct bmap		mdscr;
+static md_frames*		s_Frames = NULL;
+static md_sound_ring*	s_Sound = NULL;
+static unsigned int		s_ShownSerial[256]; // What each texture row shows
+static int				s_FramesSkipped = 0; // Since the last one drawn
 
-sdl::Gamepad* g_sdlGamepad = NULL;
-
-/// Circular buffer and related functions.
-typedef struct
-{
-	size_t i; ///< data start index
-	size_t s; ///< data size
-	size_t size; ///< buffer size
-	union
-	{
-		uint8_t *u8;
-		int16_t *i16;
-	} data; ///< storage
-} cbuf_t;
-
-cbuf_t cbuf;
-
-size_t cbuf_write(cbuf_t *cbuf, uint8_t *src, size_t size)
-{
-	size_t j;
-	size_t k;
-
-	if(size > cbuf->size) {
-		src += (size - cbuf->size);
-		size = cbuf->size;
-	}
-	k = (cbuf->size - cbuf->s);
-	j = ((cbuf->i + cbuf->s) % cbuf->size);
-	if(size > k) {
-		cbuf->i = ((cbuf->i + (size - k)) % cbuf->size);
-		cbuf->s = cbuf->size;
-	}
-	else
-		cbuf->s += size;
-	k = (cbuf->size - j);
-	if(k >= size) {
-		memcpy(&cbuf->data.u8[j], src, size);
-	}
-	else {
-		memcpy(&cbuf->data.u8[j], src, k);
-		memcpy(&cbuf->data.u8[0], &src[k], (size - k));
-	}
-	return size;
-}
-
-size_t cbuf_read(uint8_t *dst, cbuf_t *cbuf, size_t size)
-{
-	if(size > cbuf->s)
-		size = cbuf->s;
-	if((cbuf->i + size) > cbuf->size) {
-		size_t k = (cbuf->size - cbuf->i);
-
-		memcpy(&dst[0], &cbuf->data.u8[(cbuf->i)], k);
-		memcpy(&dst[k], &cbuf->data.u8[0], (size - k));
-	}
-	else
-		memcpy(&dst[0], &cbuf->data.u8[(cbuf->i)], size);
-	cbuf->i = ((cbuf->i + size) % cbuf->size);
-	cbuf->s -= size;
-	return size;
-}
+//	Maximum number of frames emulated per update when catching up
+#define FRAMESKIP_MAX	8
 
+sdl::Gamepad* g_sdlGamepad = NULL;
 
 struct SDLInputMapping
 {
@@ -152,12 +99,8 @@ void pd_message(const char *msg, ...)
 
 void DGenAudioCallback(void *userdata, Uint8 * stream, int len)
 {
-	size_t wrote = cbuf_read(stream, &cbuf, len);
-	if(wrote != (size_t)len)
-	{
-		//Fill remainder with silence
-		memset(&stream[wrote], 0, ((size_t)len - wrote));
-	}
+	//	Never waits for the emulation thread, silence if it fell behind
+	s_Sound->read((int16_t*)stream, (len / (AUDIO_CHANNELS * sizeof(int16_t))));
 }
 
 int InitDGen(int windowWidth, int windowHeight, HWND parent, int pal, char region)
@@ -177,12 +120,15 @@ int InitDGen(int windowWidth, int windowHeight, HWND parent, int pal, char regio
 	// Init gamepad
 	g_sdlGamepad = sdl::Gamepad::FindAvailableController(0);
 
-	//<	Init  screen
-	mdscr.bpp	= 32;
-	mdscr.w		= windowWidth;
-	mdscr.h		= windowHeight;
-	mdscr.pitch	= mdscr.w*4;
-	mdscr.data	= (unsigned char*)malloc(mdscr.pitch * mdscr.h);
+	//<	Init  screen, frames are drawn directly into these buffers
+	s_Frames	= new md_frames(windowWidth, windowHeight, 32, dgen_frame_buffers);
+
+	//	Later updates only cover the rows that changed, start from blank
+	unsigned char* blank = (unsigned char*)calloc(windowHeight, (windowWidth * 4));
+
+	SDL_UpdateTexture(g_BackBuffer, NULL, blank, (windowWidth * 4));
+	free(blank);
+	memset(s_ShownSerial, 0, sizeof(s_ShownSerial));
 
 	mdpal		= NULL;
 
@@ -216,11 +162,8 @@ int InitDGen(int windowWidth, int windowHeight, HWND parent, int pal, char regio
 	sndi.len = (dgen_soundrate / dgen_hz);
 	sndi.lr = (int16_t *)calloc(2, (sndi.len * sizeof(sndi.lr[0])));
 
-	// Alloc ringbuffer
-	cbuf.size = (dgen_soundsegs * (dgen_soundrate / dgen_hz)) + (g_AudioSpec.samples * (2 * (16 / 8)));
-	cbuf.data.i16 = (int16_t *)calloc(1, cbuf.size);
-	cbuf.i = 0;
-	cbuf.s = 0;
+	// Alloc ringbuffer, kept filled with a callback's worth plus a frame
+	s_Sound = new md_sound_ring(((dgen_soundsegs * sndi.len) + g_AudioSpec.samples), (g_AudioSpec.samples + sndi.len));
 
 	return 1;
 }
@@ -303,8 +246,11 @@ int		Shutdown()
 	SDL_CloseAudio();
 
 	delete s_DGenInstance;
+	delete s_Frames;
+	s_Frames = NULL;
 	free(sndi.lr);
-	free(cbuf.data.i16);
+	delete s_Sound;
+	s_Sound = NULL;
 
 	if (g_sdlGamepad)
 	{
@@ -333,11 +279,7 @@ void	EndFrame()
 	src.x = src.y = 0;
 	src.h = 240;
 
-#if VDP_H56_MODE
-	src.w = 448;
-#else
-	src.w = 320;
-#endif
+	src.w = (dgen_vdp_h56 ? 448 : 320);
 
 	dst.x = dst.y = 0;
 	dst.w = sdlWindowWidth;
@@ -453,6 +395,66 @@ void	ProcessInputs()
 	}
 }
 
+/**
+ *	Upload the latest frame to the back buffer, only rows that differ from
+ *	what it already shows, in contiguous runs
+ */
+static void PresentFrame()
+{
+	const unsigned int*	serials = NULL;
+	struct bmap*		frame = s_Frames->present(&serials);
+
+	if (frame == NULL)
+		return;
+
+	for (int line = 0; line < 256; )
+	{
+		SDL_Rect	rows;
+		int			end = line;
+
+		while ((end < 256) && (serials[end] != s_ShownSerial[end]))
+		{
+			s_ShownSerial[end] = serials[end];
+			++end;
+		}
+		if (end == line)
+		{
+			++line;
+			continue;
+		}
+		//	Scanlines start 8 rows down in the frame
+		rows.x = 0;
+		rows.y = (line + 8);
+		rows.w = frame->w;
+		rows.h = (end - line);
+		if ((rows.y + rows.h) > frame->h)
+			rows.h = (frame->h - rows.y);
+		if (rows.h > 0)
+			SDL_UpdateTexture(g_BackBuffer, &rows, (frame->data + (rows.y * frame->pitch)), frame->pitch);
+		line = end;
+	}
+
+	s_Frames->release();
+}
+
+/**
+ *	Emulate a frame and queue its sound
+ *	@param draw false to skip drawing it, VDP state still advances
+ */
+static void RunFrame(bool draw)
+{
+	if (draw)
+	{
+		s_DGenInstance->one_frame(s_Frames->draw(), mdpal, &sndi);
+		s_Frames->publish(s_DGenInstance->vdp);
+	}
+	else
+		s_DGenInstance->one_frame(NULL, NULL, &sndi);
+
+	//Write sound buffer to ringbuffer, adjusting its rate to keep latency low
+	s_Sound->write(sndi.lr, sndi.len);
+}
+
 /**
  *	Update a frame of DGEN
  *	@return success
@@ -504,20 +506,28 @@ int UpdateDGen()
 		// 				pc += instrsize;
 		// 			}
 
-		s_DGenInstance->one_frame(&mdscr, mdpal, &sndi);
+		//	Catch up on late frames without drawing them, only the
+		//	last one is (unless dgen_frameskip_fixed says otherwise)
+		int todo = 1;
+
+		if (dgen_frameskip)
+			todo = ((frames_todo < FRAMESKIP_MAX) ? frames_todo : FRAMESKIP_MAX);
+
+		while (todo != 0)
+		{
+			bool draw = ((--todo == 0) && (s_FramesSkipped >= dgen_frameskip_fixed));
+
+			RunFrame(draw);
+			s_FramesSkipped = (draw ? 0 : (s_FramesSkipped + 1));
+
+			//	Stop at breakpoints
+			if (s_DGenInstance->debug_trap)
+				break;
+		}
 		//pd_sound_write();
 	}
 
-	void*	pixels = NULL;
-	int		pitch = 0;
-	SDL_LockTexture(g_BackBuffer, NULL, &pixels, &pitch);
-	memcpy(pixels, mdscr.data, mdscr.h * mdscr.pitch);
-	SDL_UnlockTexture(g_BackBuffer);
-
-	//Write sound buffer to ringbuffer
-	SDL_LockAudio();
-	cbuf_write(&cbuf, (uint8_t*)sndi.lr, (sndi.len * 4));
-	SDL_UnlockAudio();
+	PresentFrame();
 
 	EndFrame();
 	return 1;
@@ -543,6 +553,30 @@ void	ClearBreakpoints()
 	s_DGenInstance->debug_clear_bp_m68k();
 }
 
+/**
+ *	Set the condition of the code breakpoint at the specified address,
+ *	adding the breakpoint if needed
+ *	@param condition expression, NULL or empty to break unconditionally
+ *	@param hitCount number of hits before breaking
+ *	@param logOnly log registers instead of breaking
+ *	@return success
+ */
+int		SetBreakpointCondition(int addr, const char* condition, int hitCount, int logOnly)
+{
+	int index = s_DGenInstance->debug_find_bp_m68k(addr);
+
+	if (index < 0)
+	{
+		s_DGenInstance->debug_set_bp_m68k(addr);
+		index = s_DGenInstance->debug_find_bp_m68k(addr);
+	}
+
+	if (s_DGenInstance->debug_set_bp_cond(DBG_CONTEXT_M68K, index, (condition ? condition : ""), hitCount, logOnly) < 0)
+		return 0;
+
+	return 1;
+}
+
 int AddWatchpoint(int fromAddr, int toAddr)
 {
 	s_DGenInstance->debug_set_wp_m68k(fromAddr, toAddr);
@@ -37,6 +37,7 @@ extern void		HideSDLWindow();
 extern int		AddBreakpoint(int addr);
 extern void		ClearBreakpoint(int addr);
 extern void		ClearBreakpoints();
+extern int		SetBreakpointCondition(int addr, const char* condition, int hitCount, int logOnly);
 extern int		AddWatchpoint(int fromAddr, int toAddr);
 extern void		ClearWatchpoint(int fromAddr);
 extern void		ClearWatchpoints();
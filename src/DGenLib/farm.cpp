@@ -0,0 +1,187 @@
+// DGen test farm
+// Runs batches of headless emulation jobs on a pool of worker threads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "md.h"
+#include "system.h"
+#include "rc-vars.h"
+#include "farm.h"
+
+/**
+ * Read a value from the M68K bus for a memory check.
+ * @param megad MD object.
+ * @param addr Address to read.
+ * @param size Access size in bytes (1, 2 or 4).
+ * @return Value.
+ */
+static uint32_t farm_read(md &megad, uint32_t addr, unsigned int size)
+{
+	switch (size) {
+	case 1:
+		return megad.misc_readbyte(addr);
+	case 2:
+		return megad.misc_readword(addr);
+	}
+	return ((megad.misc_readword(addr) << 16) |
+		(megad.misc_readword(addr + 2) & 0xffff));
+}
+
+/**
+ * Run a single job in the calling thread.
+ * The job gets its own MD object so that results never depend on which
+ * worker ran it or what ran before.
+ * @param job Job to run, its result member is overwritten.
+ */
+void farm_run_job(struct farm_job *job)
+{
+	struct farm_result *res = &job->result;
+	char region = (job->region ? job->region : 'U');
+	bool pal = (region == 'E');
+	FILE *input = NULL;
+	md *megad;
+	std::vector<uint8_t> pic;
+	std::vector<int16_t> snd;
+	struct bmap mdscr;
+	struct sndinfo sndi;
+	struct bmap *bm = NULL;
+	struct sndinfo *si = NULL;
+	uint32_t pad[2];
+	unsigned int i, frame;
+
+	memset(res, 0, sizeof(*res));
+	res->first_failed = -1;
+	if ((job->input != NULL) &&
+	    ((input = fopen(job->input, "rb")) == NULL)) {
+		res->status = FARM_ERROR;
+		snprintf(res->error, sizeof(res->error),
+			 "cannot open input \"%s\"", job->input);
+		return;
+	}
+	megad = new md(pal, region);
+	if (!megad->okay()) {
+		res->status = FARM_ERROR;
+		snprintf(res->error, sizeof(res->error),
+			 "cannot initialize emulator");
+		goto end;
+	}
+	if (megad->load(job->rom)) {
+		res->status = FARM_ERROR;
+		snprintf(res->error, sizeof(res->error),
+			 "cannot load ROM \"%s\"", job->rom);
+		goto end;
+	}
+	// Output is only generated when it is going to be hashed.
+	if (job->flags & FARM_RENDER) {
+		pic.resize(336 * 256 * 4);
+		mdscr.data = pic.data();
+		mdscr.w = 336;
+		mdscr.h = 256;
+		mdscr.pitch = (336 * 4);
+		mdscr.bpp = 32;
+		bm = &mdscr;
+		res->video_hash = FNV1A64_INIT;
+		res->audio_hash = FNV1A64_INIT;
+		sndi.len = (dgen_soundrate / (pal ? PAL_HZ : NTSC_HZ));
+		snd.resize(sndi.len * 2);
+		sndi.lr = snd.data();
+		si = &sndi;
+	}
+	{
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		double secs;
+
+		for (frame = 1; (frame <= job->frames); ++frame) {
+			// Same format as DGen demos, pads stay as they are
+			// once the input log runs out.
+			if ((input != NULL) &&
+			    (fread(pad, sizeof(pad), 1, input) == 1)) {
+				megad->pad[0] = be2h32(pad[0]);
+				megad->pad[1] = be2h32(pad[1]);
+			}
+			megad->one_frame(bm, NULL, si);
+			if (bm != NULL) {
+				res->video_hash = fnv1a64(res->video_hash,
+							  pic.data(),
+							  pic.size());
+				res->audio_hash = fnv1a64(res->audio_hash,
+							  snd.data(),
+							  (snd.size() *
+							   sizeof(snd[0])));
+			}
+			for (i = 0; (i != job->n_checks); ++i) {
+				struct farm_check *c = &job->checks[i];
+				unsigned int when = c->frame;
+				uint32_t value;
+
+				if ((when == 0) || (when > job->frames))
+					when = job->frames;
+				if (when != frame)
+					continue;
+				value = farm_read(*megad, c->addr, c->size);
+				if (value == c->value)
+					continue;
+				if (res->checks_failed++ == 0) {
+					res->first_failed = i;
+					res->failed_value = value;
+				}
+			}
+		}
+		res->frames = job->frames;
+		secs = std::chrono::duration<double>
+			(std::chrono::steady_clock::now() - start).count();
+		if (secs > 0.0)
+			res->fps = (res->frames / secs);
+	}
+	res->state_hash = megad->state_hash();
+	res->status = (res->checks_failed ? FARM_FAILED : FARM_OK);
+end:
+	delete megad;
+	if (input != NULL)
+		fclose(input);
+}
+
+/**
+ * Run jobs concurrently.
+ * Each worker thread takes the next pending job until none remain, so
+ * jobs of different lengths keep all workers busy.
+ * @param jobs Jobs to run, their results are filled in.
+ * @param n_jobs Number of jobs.
+ * @param threads Number of worker threads, 0 for one per CPU core.
+ * @return Number of jobs that did not pass.
+ */
+unsigned int farm_run(struct farm_job *jobs, unsigned int n_jobs,
+		      unsigned int threads)
+{
+	std::atomic<unsigned int> next(0);
+	std::vector<std::thread> workers;
+	unsigned int i;
+	unsigned int failed = 0;
+
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	if (threads > n_jobs)
+		threads = n_jobs;
+	for (i = 0; (i != threads); ++i)
+		workers.push_back(std::thread([&]() {
+			unsigned int n;
+
+			while ((n = next++) < n_jobs)
+				farm_run_job(&jobs[n]);
+		}));
+	for (i = 0; (i != workers.size()); ++i)
+		workers[i].join();
+	for (i = 0; (i != n_jobs); ++i)
+		if (jobs[i].result.status != FARM_OK)
+			++failed;
+	return failed;
+}
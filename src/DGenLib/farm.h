@@ -0,0 +1,56 @@
+// DGen test farm
+// Runs batches of headless emulation jobs on a pool of worker threads.
+
+#ifndef FARM_H_
+#define FARM_H_
+
+#include <stdint.h>
+
+/** Maximum number of checks per job. */
+#define FARM_MAX_CHECKS			32
+/** Size of the error message in job results. */
+#define FARM_ERROR_LEN			80
+
+/** Memory check, compares a value on the M68K bus after a given frame. */
+struct farm_check {
+	unsigned int	frame; /**< Check after this frame, 0 for the last. */
+	uint32_t	addr;  /**< M68K address to read. */
+	unsigned int	size;  /**< Access size in bytes (1, 2 or 4). */
+	uint32_t	value; /**< Expected value. */
+};
+
+/** Job outcome, filled in by farm_run(). */
+struct farm_result {
+#define FARM_OK				0 /**< All checks passed. */
+#define FARM_FAILED			1 /**< At least one check failed. */
+#define FARM_ERROR			2 /**< Job could not run, see error. */
+	int		status;
+	uint64_t	state_hash; /**< md::state_hash() after last frame. */
+	uint64_t	video_hash; /**< All frames, 0 without FARM_RENDER. */
+	uint64_t	audio_hash; /**< All frames, 0 without FARM_RENDER. */
+	unsigned int	frames; /**< Number of frames emulated. */
+	unsigned int	checks_failed; /**< Number of failed checks. */
+	int		first_failed; /**< Index of first failed check or -1. */
+	uint32_t	failed_value; /**< Value read by that check. */
+	double		fps; /**< Emulation speed in frames per second. */
+	char		error[FARM_ERROR_LEN];
+};
+
+/** Job description. */
+struct farm_job {
+	const char	*rom; /**< ROM file to load. */
+	const char	*input; /**< DGen demo to play back, NULL for none. */
+	unsigned int	frames; /**< Number of frames to emulate. */
+	char		region; /**< 'J', 'U' or 'E' (PAL), 0 for 'U'. */
+#define FARM_RENDER			(1<<0) /**< Render and hash output. */
+	uint32_t	flags; /**< See FARM_*. */
+	unsigned int	n_checks; /**< Number of entries in checks. */
+	struct farm_check checks[FARM_MAX_CHECKS];
+	struct farm_result result;
+};
+
+extern unsigned int farm_run(struct farm_job *jobs, unsigned int n_jobs,
+			     unsigned int threads);
+extern void farm_run_job(struct farm_job *job);
+
+#endif // FARM_H_
@@ -0,0 +1,204 @@
+// DGen test farm command-line driver
+// Not part of the library build, link it with DGenLib as a console program.
+//
+// Usage: dgen_farm [-j threads] [-r] JOBLIST
+//
+// Each non-empty line of JOBLIST that does not start with '#' is a job:
+//
+//   ROM INPUT FRAMES [region=J|U|E] [render] [FRAME:ADDR[.b|.w|.l]=VALUE ...]
+//
+// INPUT is a DGen demo file or "-" for none. ADDR and VALUE are hexadecimal,
+// FRAME 0 checks after the last frame. Paths cannot contain spaces.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "farm.h"
+
+/**
+ * Parse a memory check.
+ * @param check Check to fill.
+ * @param arg Check in FRAME:ADDR[.b|.w|.l]=VALUE format.
+ * @return 0 on success, -1 on error.
+ */
+static int parse_check(struct farm_check *check, const char *arg)
+{
+	char *end;
+
+	check->frame = strtoul(arg, &end, 10);
+	if ((end == arg) || (*end != ':'))
+		return -1;
+	arg = (end + 1);
+	check->addr = strtoul(arg, &end, 16);
+	if (end == arg)
+		return -1;
+	check->size = 2;
+	if (*end == '.') {
+		switch (end[1]) {
+		case 'b':
+			check->size = 1;
+			break;
+		case 'w':
+			check->size = 2;
+			break;
+		case 'l':
+			check->size = 4;
+			break;
+		default:
+			return -1;
+		}
+		end += 2;
+	}
+	if (*end != '=')
+		return -1;
+	arg = (end + 1);
+	check->value = strtoul(arg, &end, 16);
+	if ((end == arg) || (*end != '\0'))
+		return -1;
+	return 0;
+}
+
+/**
+ * Parse a job line.
+ * @param job Job to fill, keeps pointers to line.
+ * @param line Line to parse, modified.
+ * @return 1 on success, 0 for an empty line, -1 on error.
+ */
+static int parse_job(struct farm_job *job, char *line)
+{
+	const char *sep = " \t\r\n";
+	char *tok[3];
+	char *arg;
+	unsigned int i;
+
+	memset(job, 0, sizeof(*job));
+	if ((line[strspn(line, sep)] == '#') ||
+	    ((tok[0] = strtok(line, sep)) == NULL))
+		return 0;
+	for (i = 1; (i != 3); ++i)
+		if ((tok[i] = strtok(NULL, sep)) == NULL)
+			return -1;
+	job->rom = tok[0];
+	if (strcmp(tok[1], "-"))
+		job->input = tok[1];
+	job->frames = strtoul(tok[2], NULL, 10);
+	while ((arg = strtok(NULL, sep)) != NULL) {
+		if (!strncmp(arg, "region=", 7) &&
+		    (strchr("JUE", arg[7]) != NULL) && (arg[8] == '\0'))
+			job->region = arg[7];
+		else if (!strcmp(arg, "render"))
+			job->flags |= FARM_RENDER;
+		else if ((job->n_checks == FARM_MAX_CHECKS) ||
+			 (parse_check(&job->checks[job->n_checks], arg)))
+			return -1;
+		else
+			++job->n_checks;
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int threads = 0;
+	bool render = false;
+	FILE *file;
+	char buf[1024];
+	std::vector<char *> lines;
+	std::vector<struct farm_job> jobs;
+	unsigned int i, line = 0;
+	unsigned int failed;
+	unsigned long long frames = 0;
+	double secs;
+	int c;
+
+	for (c = 1; (c < argc) && (argv[c][0] == '-'); ++c) {
+		if ((!strcmp(argv[c], "-j")) && ((c + 1) < argc))
+			threads = strtoul(argv[++c], NULL, 10);
+		else if (!strcmp(argv[c], "-r"))
+			render = true;
+		else
+			break;
+	}
+	if ((c + 1) != argc) {
+		fprintf(stderr,
+			"usage: %s [-j threads] [-r] JOBLIST\n"
+			"  -j threads  worker threads (default: one per core)\n"
+			"  -r          render all jobs and hash video/audio\n",
+			argv[0]);
+		return 2;
+	}
+	if ((file = fopen(argv[c], "r")) == NULL) {
+		fprintf(stderr, "%s: cannot open job list\n", argv[c]);
+		return 2;
+	}
+	while (fgets(buf, sizeof(buf), file) != NULL) {
+		struct farm_job job;
+		char *copy = _strdup(buf);
+		int ret;
+
+		++line;
+		if ((copy == NULL) || ((ret = parse_job(&job, copy)) < 0)) {
+			fprintf(stderr, "%s:%u: invalid job\n", argv[c], line);
+			fclose(file);
+			free(copy);
+			for (i = 0; (i != lines.size()); ++i)
+				free(lines[i]);
+			return 2;
+		}
+		if (ret == 0) {
+			free(copy);
+			continue;
+		}
+		if (render)
+			job.flags |= FARM_RENDER;
+		lines.push_back(copy);
+		jobs.push_back(job);
+	}
+	fclose(file);
+	if (jobs.empty()) {
+		fprintf(stderr, "%s: no jobs\n", argv[c]);
+		return 2;
+	}
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	failed = farm_run(jobs.data(), jobs.size(), threads);
+	secs = std::chrono::duration<double>
+		(std::chrono::steady_clock::now() - start).count();
+	for (i = 0; (i != jobs.size()); ++i) {
+		struct farm_job *job = &jobs[i];
+		struct farm_result *res = &job->result;
+		static const char *status[] = { "PASS", "FAIL", "ERROR" };
+
+		printf("%u %s %s", i, status[res->status], job->rom);
+		if (res->status == FARM_ERROR) {
+			printf(": %s\n", res->error);
+			continue;
+		}
+		frames += res->frames;
+		printf(" frames %u fps %.1f state %016llx", res->frames,
+		       res->fps, (unsigned long long)res->state_hash);
+		if (job->flags & FARM_RENDER)
+			printf(" video %016llx audio %016llx",
+			       (unsigned long long)res->video_hash,
+			       (unsigned long long)res->audio_hash);
+		if (res->status == FARM_FAILED) {
+			struct farm_check *check =
+				&job->checks[res->first_failed];
+
+			printf(" (%u checks failed, first: %u:%06x=%x,"
+			       " expected %x)", res->checks_failed,
+			       check->frame, check->addr, res->failed_value,
+			       check->value);
+		}
+		printf("\n");
+	}
+	printf("%u/%u jobs passed, %llu frames in %.2f s (%.1f fps)\n",
+	       (unsigned int)(jobs.size() - failed),
+	       (unsigned int)jobs.size(), frames, secs,
+	       ((secs > 0.0) ? (frames / secs) : 0.0));
+	for (i = 0; (i != lines.size()); ++i)
+		free(lines[i]);
+	return (failed != 0);
+}
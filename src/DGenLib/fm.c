@@ -108,6 +108,12 @@
 #include "dgen.h"
 #include "fm.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define FM_SSE2
+#endif
+
 
 #ifndef PI
 #define PI 3.14159265358979323846
@@ -694,29 +700,29 @@ typedef struct
 	UINT32	lfo_inc;
 
 	UINT32	lfo_freq[8];	/* LFO FREQ table */
+
+	/* working state, kept per chip so that chips can be updated concurrently */
+	INT32	m2,c1,c2;		/* Phase Modulation input for operators 2,3,4 */
+	INT32	mem;			/* one sample delay memory */
+	INT32	out_fm[8];		/* outputs of working channels */
+	UINT32	LFO_AM;			/* runtime LFO calculations helper */
+	INT32	LFO_PM;			/* runtime LFO calculations helper */
 } FM_OPN;
 
 
 
-/* current chip state */
+/* current chip state (YM2612 keeps it in FM_OPN) */
+#if (BUILD_YM2203||BUILD_YM2608||BUILD_YM2610||BUILD_YM2610B)
 static void		*cur_chip = 0;	/* pointer of current chip struct */
 static FM_ST	*State;			/* basic status */
 static FM_CH	*cch[8];		/* pointer of FM channels */
-
-
-static INT32	m2,c1,c2;		/* Phase Modulation input for operators 2,3,4 */
-static INT32	mem;			/* one sample delay memory */
-
-static INT32	out_fm[8];		/* outputs of working channels */
+#endif
 
 #if (BUILD_YM2608||BUILD_YM2610||BUILD_YM2610B)
 static INT32	out_adpcm[4];	/* channel output NONE,LEFT,RIGHT or CENTER for YM2608/YM2610 ADPCM */
 static INT32	out_delta[4];	/* channel output NONE,LEFT,RIGHT or CENTER for YM2608/YM2610 DELTAT*/
 #endif
 
-static UINT32	LFO_AM;			/* runtime LFO calculations helper */
-static INT32	LFO_PM;			/* runtime LFO calculations helper */
-
 /* log output level */
 #define LOG_ERR  3      /* ERROR       */
 #define LOG_WAR  2      /* WARNING     */
@@ -942,9 +948,9 @@ INLINE void FM_KEYOFF(FM_CH *CH , int s )
 }
 
 /* set algorithm connection */
-static void setup_connection( FM_CH *CH, int ch )
+static void setup_connection( FM_OPN *OPN, FM_CH *CH, int ch )
 {
-	INT32 *carrier = &out_fm[ch];
+	INT32 *carrier = &OPN->out_fm[ch];
 
 	INT32 **om1 = &CH->connect1;
 	INT32 **om2 = &CH->connect3;
@@ -955,43 +961,43 @@ static void setup_connection( FM_CH *CH, int ch )
 	switch( CH->ALGO ){
 	case 0:
 		/* M1---C1---MEM---M2---C2---OUT */
-		*om1 = &c1;
-		*oc1 = &mem;
-		*om2 = &c2;
-		*memc= &m2;
+		*om1 = &OPN->c1;
+		*oc1 = &OPN->mem;
+		*om2 = &OPN->c2;
+		*memc= &OPN->m2;
 		break;
 	case 1:
 		/* M1------+-MEM---M2---C2---OUT */
 		/*      C1-+                     */
-		*om1 = &mem;
-		*oc1 = &mem;
-		*om2 = &c2;
-		*memc= &m2;
+		*om1 = &OPN->mem;
+		*oc1 = &OPN->mem;
+		*om2 = &OPN->c2;
+		*memc= &OPN->m2;
 		break;
 	case 2:
 		/* M1-----------------+-C2---OUT */
 		/*      C1---MEM---M2-+          */
-		*om1 = &c2;
-		*oc1 = &mem;
-		*om2 = &c2;
-		*memc= &m2;
+		*om1 = &OPN->c2;
+		*oc1 = &OPN->mem;
+		*om2 = &OPN->c2;
+		*memc= &OPN->m2;
 		break;
 	case 3:
 		/* M1---C1---MEM------+-C2---OUT */
 		/*                 M2-+          */
-		*om1 = &c1;
-		*oc1 = &mem;
-		*om2 = &c2;
-		*memc= &c2;
+		*om1 = &OPN->c1;
+		*oc1 = &OPN->mem;
+		*om2 = &OPN->c2;
+		*memc= &OPN->c2;
 		break;
 	case 4:
 		/* M1---C1-+-OUT */
 		/* M2---C2-+     */
 		/* MEM: not used */
-		*om1 = &c1;
+		*om1 = &OPN->c1;
 		*oc1 = carrier;
-		*om2 = &c2;
-		*memc= &mem;	/* store it anywhere where it will not be used */
+		*om2 = &OPN->c2;
+		*memc= &OPN->mem;	/* store it anywhere where it will not be used */
 		break;
 	case 5:
 		/*    +----C1----+     */
@@ -1000,17 +1006,17 @@ static void setup_connection( FM_CH *CH, int ch )
 		*om1 = 0;	/* special mark */
 		*oc1 = carrier;
 		*om2 = carrier;
-		*memc= &m2;
+		*memc= &OPN->m2;
 		break;
 	case 6:
 		/* M1---C1-+     */
 		/*      M2-+-OUT */
 		/*      C2-+     */
 		/* MEM: not used */
-		*om1 = &c1;
+		*om1 = &OPN->c1;
 		*oc1 = carrier;
 		*om2 = carrier;
-		*memc= &mem;	/* store it anywhere where it will not be used */
+		*memc= &OPN->mem;	/* store it anywhere where it will not be used */
 		break;
 	case 7:
 		/* M1-+     */
@@ -1021,7 +1027,7 @@ static void setup_connection( FM_CH *CH, int ch )
 		*om1 = carrier;
 		*oc1 = carrier;
 		*om2 = carrier;
-		*memc= &mem;	/* store it anywhere where it will not be used */
+		*memc= &OPN->mem;	/* store it anywhere where it will not be used */
 		break;
 	}
 
@@ -1173,9 +1179,9 @@ INLINE void advance_lfo(FM_OPN *OPN)
 			/* triangle */
 			/* AM: 0 to 126 step +2, 126 to 0 step -2 */
 			if (pos<64)
-				LFO_AM = (pos&63) * 2;
+				OPN->LFO_AM = (pos&63) * 2;
 			else
-				LFO_AM = 126 - ((pos&63) * 2);
+				OPN->LFO_AM = 126 - ((pos&63) * 2);
 		}
 
 		/* PM works with 4 times slower clock */
@@ -1183,14 +1189,14 @@ INLINE void advance_lfo(FM_OPN *OPN)
 		/* update PM when LFO output changes */
 		/*if (prev_pos != pos)*/ /* can't use global lfo_pm for this optimization, must be chip->lfo_pm instead*/
 		{
-			LFO_PM = pos;
+			OPN->LFO_PM = pos;
 		}
 
 	}
 	else
 	{
-		LFO_AM = 0;
-		LFO_PM = 0;
+		OPN->LFO_AM = 0;
+		OPN->LFO_PM = 0;
 	}
 }
 
@@ -1399,7 +1405,7 @@ INLINE void advance_eg_channel(FM_OPN *OPN, FM_SLOT *SLOT)
 INLINE void update_phase_lfo_slot(FM_OPN *OPN, FM_SLOT *SLOT, INT32 pms, UINT32 block_fnum)
 {
 	UINT32 fnum_lfo  = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
-	INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + pms + LFO_PM ];
+	INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + pms + OPN->LFO_PM ];
 
 	if (lfo_fn_table_index_offset)    /* LFO phase modulation active */
 	{
@@ -1435,7 +1441,7 @@ INLINE void update_phase_lfo_channel(FM_OPN *OPN, FM_CH *CH)
 	UINT32 block_fnum = CH->block_fnum;
 
 	UINT32 fnum_lfo  = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
-	INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + CH->pms + LFO_PM ];
+	INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + CH->pms + OPN->LFO_PM ];
 
 	if (lfo_fn_table_index_offset)    /* LFO phase modulation active */
 	{
@@ -1485,10 +1491,10 @@ INLINE void chan_calc(FM_OPN *OPN, FM_CH *CH, int chnum)
 {
 	unsigned int eg_out;
 
-	UINT32 AM = LFO_AM >> CH->ams;
+	UINT32 AM = OPN->LFO_AM >> CH->ams;
 
 
-	m2 = c1 = c2 = mem = 0;
+	OPN->m2 = OPN->c1 = OPN->c2 = OPN->mem = 0;
 
 	*CH->mem_connect = CH->mem_value;	/* restore delayed sample (MEM) value to m2 or c2 */
 
@@ -1499,7 +1505,7 @@ INLINE void chan_calc(FM_OPN *OPN, FM_CH *CH, int chnum)
 
 		if( !CH->connect1 ){
 			/* algorithm 5  */
-			mem = c1 = c2 = CH->op1_out[0];
+			OPN->mem = OPN->c1 = OPN->c2 = CH->op1_out[0];
 		}
 		else
 		{
@@ -1519,19 +1525,19 @@ INLINE void chan_calc(FM_OPN *OPN, FM_CH *CH, int chnum)
 
 	eg_out = volume_calc(&CH->SLOT[SLOT3]);
 	if( eg_out < ENV_QUIET )		/* SLOT 3 */
-		*CH->connect3 += op_calc(CH->SLOT[SLOT3].phase, eg_out, m2);
+		*CH->connect3 += op_calc(CH->SLOT[SLOT3].phase, eg_out, OPN->m2);
 
 	eg_out = volume_calc(&CH->SLOT[SLOT2]);
 	if( eg_out < ENV_QUIET )		/* SLOT 2 */
-		*CH->connect2 += op_calc(CH->SLOT[SLOT2].phase, eg_out, c1);
+		*CH->connect2 += op_calc(CH->SLOT[SLOT2].phase, eg_out, OPN->c1);
 
 	eg_out = volume_calc(&CH->SLOT[SLOT4]);
 	if( eg_out < ENV_QUIET )		/* SLOT 4 */
-		*CH->connect4 += op_calc(CH->SLOT[SLOT4].phase, eg_out, c2);
+		*CH->connect4 += op_calc(CH->SLOT[SLOT4].phase, eg_out, OPN->c2);
 
 
 	/* store current MEM */
-	CH->mem_value = mem;
+	CH->mem_value = OPN->mem;
 
 	/* update phase counters AFTER output calculations */
 	if(CH->pms)
@@ -1677,10 +1683,14 @@ static void reset_channels( FM_ST *ST , FM_CH *CH , int num )
 /* initialize generic tables */
 static int init_tables(void)
 {
+	static int tables_built = 0;
 	signed int i,x;
 	signed int n;
 	double o,m;
 
+	if (tables_built)
+		return 1;
+
 	for (x=0; x<TL_RES_LEN; x++)
 	{
 		m = (1<<16) / pow(2, (x+1) * (ENV_STEP/4.0) / 8.0);
@@ -1787,6 +1797,7 @@ static int init_tables(void)
 	sample[0]=fopen("sampsum.pcm","wb");
 #endif
 
+	tables_built = 1;
 	return 1;
 
 }
@@ -2163,7 +2174,7 @@ static void OPNWriteReg(FM_OPN *OPN, int r, int v)
 				int feedback = (v>>3)&7;
 				CH->ALGO = v&7;
 				CH->FB   = feedback ? feedback+6 : 0;
-				setup_connection( CH, c );
+				setup_connection( OPN, CH, c );
 			}
 			break;
 		case 1:		/* 0xb4-0xb6 : L , R , AMS , PMS (YM2612/YM2610B/YM2610/YM2608) */
@@ -4719,7 +4730,7 @@ int YM2610TimerOver(int n,int c)
 /*		YM2612 local section                                                   */
 /*******************************************************************************/
 /* here's the virtual YM2612 */
-typedef struct
+typedef struct ym2612
 {
 	UINT8		REGS[512];			/* registers			*/
 	FM_OPN		OPN;				/* OPN state			*/
@@ -4731,33 +4742,397 @@ typedef struct
 	INT32		dacout;
 } YM2612;
 
-static int YM2612NumChips;	/* total chip */
-static YM2612 *FM2612=NULL;	/* array of YM2612's */
+#ifdef FM_SSE2
+/*******************************************************************************/
+/*		SSE2 synthesis                                                         */
+/*******************************************************************************/
+/* Channels are evaluated at once, one per lane (6 out of 8), operator after */
+/* operator in the same order as chan_calc(). Algorithms become masks telling */
+/* where each operator output goes. Table lookups remain done lane by lane. */
+/* Results are identical to the scalar path, which is still used for 3 slot */
+/* and CSM modes as well as SSG-EG. */
+
+#define FM_LANES 8
+
+typedef union
+{
+	__m128i	v[(FM_LANES / 4)];
+	INT32	i[FM_LANES];
+} FM_LANE;
+
+/* connection masks (all bits set when connected), see setup_connection() */
+typedef struct
+{
+	FM_LANE	mem_m2, mem_c2, mem_mem;	/* mem_connect */
+	FM_LANE	op1_c1, op1_c2, op1_mem, op1_out;	/* connect1 */
+	FM_LANE	op3_c2, op3_out;	/* connect3 */
+	FM_LANE	op2_mem, op2_out;	/* connect2 */
+} FM_ROUTE;
+
+/* Phase increments of a channel's slots with LFO PM, in the same order as */
+/* FM_CH, see update_phase_lfo_channel() */
+INLINE void lfo_phase_incr_channel(FM_OPN *OPN, FM_CH *CH, UINT32 incr[4])
+{
+	UINT32 block_fnum = CH->block_fnum;
+	UINT32 fnum_lfo  = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
+	INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + CH->pms + OPN->LFO_PM ];
+	unsigned int s;
+
+	if (lfo_fn_table_index_offset)    /* LFO phase modulation active */
+	{
+		UINT8 blk;
+		UINT32 fn;
+		int kc, fc, finc;
+
+		block_fnum = block_fnum*2 + lfo_fn_table_index_offset;
+		blk = (block_fnum&0x7000) >> 12;
+		fn  = block_fnum & 0xfff;
+		kc = (blk<<2) | opn_fktable[fn >> 8];
+		fc = (OPN->fn_table[fn]>>(7-blk));
+		for (s = 0; (s != 4); ++s)
+		{
+			finc = fc + CH->SLOT[s].DT[kc];
+			if (finc < 0) finc += OPN->fn_max;
+			incr[s] = (finc*CH->SLOT[s].mul) >> 1;
+		}
+	}
+	else
+		for (s = 0; (s != 4); ++s)
+			incr[s] = CH->SLOT[s].Incr;
+}
+
+/* Operator output for a lane, see op_calc() */
+INLINE INT32 lane_op_calc(UINT32 index, unsigned int env)
+{
+	UINT32 p;
+
+	if (env >= ENV_QUIET)
+		return 0;
+	p = (env<<3) + sin_tab[ index & SIN_MASK ];
+	if (p >= TL_TAB_LEN)
+		return 0;
+	return tl_tab[p];
+}
+
+/* Evaluate an operator on all lanes, see op_calc(). Lanes with a quiet */
+/* envelope output zero. Results are gathered in registers, writing lanes */
+/* one by one then reading them at once would stall. */
+INLINE void lanes_op_calc(FM_LANE *out, const FM_LANE *phase,
+			  const FM_LANE *env, const FM_LANE *pm)
+{
+	const __m128i freq = _mm_set1_epi32(~FREQ_MASK);
+	FM_LANE index;
+	unsigned int h;
+
+	for (h = 0; (h != (FM_LANES / 4)); ++h)
+		index.v[h] = _mm_srli_epi32(_mm_add_epi32(_mm_and_si128(phase->v[h], freq),
+							  _mm_slli_epi32(pm->v[h], 15)),
+					    FREQ_SH);
+	out->v[0] = _mm_set_epi32(lane_op_calc(index.i[3], env->i[3]),
+				  lane_op_calc(index.i[2], env->i[2]),
+				  lane_op_calc(index.i[1], env->i[1]),
+				  lane_op_calc(index.i[0], env->i[0]));
+	out->v[1] = _mm_set_epi32(0, 0,
+				  lane_op_calc(index.i[5], env->i[5]),
+				  lane_op_calc(index.i[4], env->i[4]));
+}
 
-static int dacen;
+/* SLOT 1 output for a lane, with feedback, see op_calc1() */
+INLINE INT32 lane_op_calc1(UINT32 phase, unsigned int env, INT32 in, int fb)
+{
+	UINT32 p;
+
+	if (env >= ENV_QUIET)
+		return 0;
+	if (!fb)
+		in = 0;
+	p = (env<<3) + sin_tab[ ( ((signed int)((phase & ~FREQ_MASK) + (in << fb))) >> FREQ_SH ) & SIN_MASK ];
+	if (p >= TL_TAB_LEN)
+		return 0;
+	return tl_tab[p];
+}
 
-/* Generate samples for one of the YM2612s */
-void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
-		     unsigned int volume, int loud)
+/* Generate raw samples with SSE2, see YM2612Generate(). */
+/* Returns 0 when the current mode isn't supported. */
+static int generate_sse2(FM_OPN *OPN, FM_CH *cch[6], int dacen, INT32 dacout,
+			 INT32 *buffer, unsigned int length)
+{
+	FM_ROUTE route;
+	FM_LANE phase[4], incr[4], vol_out[4], ammask[4], env[4];
+	FM_LANE op1_out[2], mem_value, panl, panr, am;
+	int fb[6];
+	UINT8 ams[6];
+	unsigned int pms = 0; /* channels with LFO PM */
+	unsigned int chans = (dacen ? 5 : 6); /* channels computed */
+	UINT32 am_last = ~0u;
+	INT32 pm_last = -1; /* LFO_PM is never negative */
+	unsigned int c, s, h, i;
+
+	if (OPN->ST.mode & 0xc0)
+		return 0;
+	for (c = 0; (c != 6); ++c)
+		for (s = 0; (s != 4); ++s)
+			if (cch[c]->SLOT[s].ssg & 0x08)
+				return 0;
+	memset(&route, 0, sizeof(route));
+	memset(phase, 0, sizeof(phase));
+	memset(incr, 0, sizeof(incr));
+	memset(ammask, 0, sizeof(ammask));
+	memset(op1_out, 0, sizeof(op1_out));
+	memset(&mem_value, 0, sizeof(mem_value));
+	memset(&panl, 0, sizeof(panl));
+	memset(&panr, 0, sizeof(panr));
+	memset(&am, 0, sizeof(am));
+	for (s = 0; (s != 4); ++s)
+		for (i = 0; (i != FM_LANES); ++i)
+			vol_out[s].i[i] = ENV_QUIET;
+	for (c = 0; (c != chans); ++c)
+	{
+		FM_CH *CH = cch[c];
+		INT32 *carrier = &OPN->out_fm[c];
+
+		for (s = 0; (s != 4); ++s)
+		{
+			phase[s].i[c] = CH->SLOT[s].phase;
+			vol_out[s].i[c] = CH->SLOT[s].vol_out;
+			ammask[s].i[c] = CH->SLOT[s].AMmask;
+			if (!CH->pms)
+				incr[s].i[c] = CH->SLOT[s].Incr;
+		}
+		if (CH->pms)
+			pms |= (1 << c);
+		op1_out[0].i[c] = CH->op1_out[0];
+		op1_out[1].i[c] = CH->op1_out[1];
+		mem_value.i[c] = CH->mem_value;
+		fb[c] = CH->FB;
+		ams[c] = CH->ams;
+		route.mem_m2.i[c] = -(CH->mem_connect == &OPN->m2);
+		route.mem_c2.i[c] = -(CH->mem_connect == &OPN->c2);
+		route.mem_mem.i[c] = -(CH->mem_connect == &OPN->mem);
+		if (CH->connect1 == NULL)
+		{
+			/* algorithm 5 */
+			route.op1_c1.i[c] = -1;
+			route.op1_c2.i[c] = -1;
+			route.op1_mem.i[c] = -1;
+		}
+		else
+		{
+			route.op1_c1.i[c] = -(CH->connect1 == &OPN->c1);
+			route.op1_c2.i[c] = -(CH->connect1 == &OPN->c2);
+			route.op1_mem.i[c] = -(CH->connect1 == &OPN->mem);
+			route.op1_out.i[c] = -(CH->connect1 == carrier);
+		}
+		route.op3_c2.i[c] = -(CH->connect3 == &OPN->c2);
+		route.op3_out.i[c] = -(CH->connect3 == carrier);
+		route.op2_mem.i[c] = -(CH->connect2 == &OPN->mem);
+		route.op2_out.i[c] = -(CH->connect2 == carrier);
+	}
+	for (c = 0; (c != 6); ++c)
+	{
+		panl.i[c] = OPN->pan[(c * 2)];
+		panr.i[c] = OPN->pan[((c * 2) + 1)];
+	}
+
+	for (i = 0; (i != length); ++i)
+	{
+		FM_LANE m2, c1, c2, mem, out, pm, op;
+		__m128i lt, rt;
+
+		advance_lfo(OPN);
+		if (OPN->LFO_AM != am_last)
+		{
+			am_last = OPN->LFO_AM;
+			for (c = 0; (c != chans); ++c)
+				am.i[c] = (am_last >> ams[c]);
+		}
+		if ((pms) && (OPN->LFO_PM != pm_last))
+		{
+			/* phase increments only change with LFO PM */
+			pm_last = OPN->LFO_PM;
+			for (c = 0; (c != chans); ++c)
+			{
+				UINT32 inc[4];
+
+				if (!(pms & (1 << c)))
+					continue;
+				lfo_phase_incr_channel(OPN, cch[c], inc);
+				for (s = 0; (s != 4); ++s)
+					incr[s].i[c] = inc[s];
+			}
+		}
+		for (h = 0; (h != (FM_LANES / 4)); ++h)
+		{
+			__m128i mv = mem_value.v[h];
+			__m128i o = op1_out[1].v[h];
+
+			for (s = 0; (s != 4); ++s)
+				env[s].v[h] = _mm_add_epi32(vol_out[s].v[h],
+							    _mm_and_si128(am.v[h], ammask[s].v[h]));
+			/* restore delayed sample (MEM) value to m2 or c2 */
+			m2.v[h] = _mm_and_si128(mv, route.mem_m2.v[h]);
+			c2.v[h] = _mm_and_si128(mv, route.mem_c2.v[h]);
+			mem.v[h] = _mm_and_si128(mv, route.mem_mem.v[h]);
+			/* SLOT 1 output from the previous sample */
+			c1.v[h] = _mm_and_si128(o, route.op1_c1.v[h]);
+			c2.v[h] = _mm_add_epi32(c2.v[h], _mm_and_si128(o, route.op1_c2.v[h]));
+			mem.v[h] = _mm_add_epi32(mem.v[h], _mm_and_si128(o, route.op1_mem.v[h]));
+			out.v[h] = _mm_and_si128(o, route.op1_out.v[h]);
+			/* feedback input, op1_out[0] + op1_out[1] */
+			pm.v[h] = _mm_add_epi32(op1_out[0].v[h], o);
+			op1_out[0].v[h] = o;
+		}
+		/* SLOT 1 */
+#define OP1(c) lane_op_calc1(phase[SLOT1].i[c], env[SLOT1].i[c], pm.i[c], fb[c])
+		op1_out[1].v[0] = _mm_set_epi32(OP1(3), OP1(2), OP1(1), OP1(0));
+		op1_out[1].v[1] = _mm_set_epi32(0, 0, OP1(5), OP1(4));
+#undef OP1
+		/* SLOT 3 */
+		lanes_op_calc(&op, &phase[SLOT3], &env[SLOT3], &m2);
+		for (h = 0; (h != (FM_LANES / 4)); ++h)
+		{
+			c2.v[h] = _mm_add_epi32(c2.v[h], _mm_and_si128(op.v[h], route.op3_c2.v[h]));
+			out.v[h] = _mm_add_epi32(out.v[h], _mm_and_si128(op.v[h], route.op3_out.v[h]));
+		}
+		/* SLOT 2 */
+		lanes_op_calc(&op, &phase[SLOT2], &env[SLOT2], &c1);
+		for (h = 0; (h != (FM_LANES / 4)); ++h)
+		{
+			mem.v[h] = _mm_add_epi32(mem.v[h], _mm_and_si128(op.v[h], route.op2_mem.v[h]));
+			out.v[h] = _mm_add_epi32(out.v[h], _mm_and_si128(op.v[h], route.op2_out.v[h]));
+		}
+		/* SLOT 4 */
+		lanes_op_calc(&op, &phase[SLOT4], &env[SLOT4], &c2);
+		for (h = 0; (h != (FM_LANES / 4)); ++h)
+		{
+			out.v[h] = _mm_add_epi32(out.v[h], op.v[h]);
+			/* store current MEM */
+			mem_value.v[h] = mem.v[h];
+			/* update phase counters AFTER output calculations */
+			for (s = 0; (s != 4); ++s)
+				phase[s].v[h] = _mm_add_epi32(phase[s].v[h], incr[s].v[h]);
+		}
+		if (dacen)
+			out.i[5] = dacout;
+
+		/* advance envelope generator */
+		OPN->eg_timer += OPN->eg_timer_add;
+		if (OPN->eg_timer >= OPN->eg_timer_overflow)
+		{
+			do
+			{
+				OPN->eg_timer -= OPN->eg_timer_overflow;
+				OPN->eg_cnt++;
+				for (c = 0; (c != 6); ++c)
+					advance_eg_channel(OPN, &cch[c]->SLOT[SLOT1]);
+			}
+			while (OPN->eg_timer >= OPN->eg_timer_overflow);
+			for (s = 0; (s != 4); ++s)
+			{
+#define VOL(c) ((c < chans) ? (INT32)cch[c]->SLOT[s].vol_out : ENV_QUIET)
+				vol_out[s].v[0] = _mm_set_epi32(VOL(3), VOL(2), VOL(1), VOL(0));
+				vol_out[s].v[1] = _mm_set_epi32(ENV_QUIET, ENV_QUIET, VOL(5), VOL(4));
+#undef VOL
+			}
+		}
+
+		/* pan and mix */
+		lt = _mm_add_epi32(_mm_and_si128(out.v[0], panl.v[0]),
+				   _mm_and_si128(out.v[1], panl.v[1]));
+		rt = _mm_add_epi32(_mm_and_si128(out.v[0], panr.v[0]),
+				   _mm_and_si128(out.v[1], panr.v[1]));
+		/* (l0 + l2, r0 + r2, l1 + l3, r1 + r3) */
+		lt = _mm_add_epi32(_mm_unpacklo_epi32(lt, rt),
+				   _mm_unpackhi_epi32(lt, rt));
+		lt = _mm_add_epi32(lt, _mm_srli_si128(lt, 8));
+		buffer[0] = (_mm_cvtsi128_si32(lt) >> FINAL_SH);
+		buffer[1] = (_mm_cvtsi128_si32(_mm_srli_si128(lt, 4)) >> FINAL_SH);
+		buffer += 2;
+
+		/* timer A control */
+		INTERNAL_TIMER_A(OPN->type, (&OPN->ST), cch[2])
+	}
+
+	for (c = 0; (c != chans); ++c)
+	{
+		FM_CH *CH = cch[c];
+
+		for (s = 0; (s != 4); ++s)
+			CH->SLOT[s].phase = phase[s].i[c];
+		CH->op1_out[0] = op1_out[0].i[c];
+		CH->op1_out[1] = op1_out[1].i[c];
+		CH->mem_value = mem_value.i[c];
+	}
+	return 1;
+}
+
+/* Mix raw samples with SSE2, see YM2612Mix(). */
+/* Returns the number of values (not stereo samples) processed. */
+static unsigned int mix_sse2(INT16 *buffer, const INT32 *fm, unsigned int count,
+			     unsigned int volume, int loud)
+{
+	const __m128i max = _mm_set1_epi32(32767);
+	const __m128i min = _mm_set1_epi32(-32767);
+	const __m128d div = _mm_set1_pd(100.0);
+	const __m128d vol = _mm_set1_pd((double)volume);
+	unsigned int i;
+
+	for (i = 0; ((i + 4) <= count); i += 4)
+	{
+		__m128i in = _mm_loadl_epi64((const __m128i *)&buffer[i]);
+		__m128i v = _mm_loadu_si128((const __m128i *)&fm[i]);
+		__m128i mask;
+
+		/* Mix with buffer. */
+		v = _mm_add_epi32(v, _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+		/* Make it louder. */
+		if (loud)
+			v = _mm_srai_epi32(_mm_add_epi32(v, _mm_slli_epi32(v, 1)), 1);
+		/* Lower volume? Exact, quotients are never close enough */
+		/* to an integer to be rounded to it. */
+		if (volume != 100)
+		{
+			__m128d lo = _mm_cvtepi32_pd(v);
+			__m128d hi = _mm_cvtepi32_pd(_mm_srli_si128(v, 8));
+
+			lo = _mm_div_pd(_mm_mul_pd(lo, vol), div);
+			hi = _mm_div_pd(_mm_mul_pd(hi, vol), div);
+			v = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo),
+					       _mm_cvttpd_epi32(hi));
+		}
+		/* Hard clipping for signed 16-bit output. */
+		mask = _mm_cmpgt_epi32(v, max);
+		v = _mm_or_si128(_mm_and_si128(mask, max),
+				 _mm_andnot_si128(mask, v));
+		mask = _mm_cmplt_epi32(v, min);
+		v = _mm_or_si128(_mm_and_si128(mask, min),
+				 _mm_andnot_si128(mask, v));
+		_mm_storel_epi64((__m128i *)&buffer[i], _mm_packs_epi32(v, v));
+	}
+	return i;
+}
+#endif /* FM_SSE2 */
+
+/* Generate raw samples for one of the YM2612s, interleaved left and right */
+/* channels, to be mixed by YM2612Mix(). May be called several times per */
+/* frame, so that register writes take effect where they happen. */
+void YM2612Generate(YM2612 *FM2612, int num, INT32 *buffer,
+		    unsigned int length)
 {
 	YM2612 *F2612 = &(FM2612[num]);
 	FM_OPN *OPN   = &(FM2612[num].OPN);
+	FM_ST *State  = &OPN->ST;
+	FM_CH *cch[6];
 	unsigned int i;
 	INT32 dacout  = F2612->dacout;
-	
-	if( (void *)F2612 != cur_chip ){
-		cur_chip = (void *)F2612;
-		State = &OPN->ST;
-		cch[0]   = &F2612->CH[0];
-		cch[1]   = &F2612->CH[1];
-		cch[2]   = &F2612->CH[2];
-		cch[3]   = &F2612->CH[3];
-		cch[4]   = &F2612->CH[4];
-		cch[5]   = &F2612->CH[5];
-		/* DAC mode */
-		dacen = F2612->dacen;
+	int dacen     = F2612->dacen;
 
-	}
+	cch[0]   = &F2612->CH[0];
+	cch[1]   = &F2612->CH[1];
+	cch[2]   = &F2612->CH[2];
+	cch[3]   = &F2612->CH[3];
+	cch[4]   = &F2612->CH[4];
+	cch[5]   = &F2612->CH[5];
 
 	/* refresh PG and EG */
 	refresh_fc_eg_chan( OPN, cch[0] );
@@ -4777,6 +5152,14 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 	refresh_fc_eg_chan( OPN, cch[4] );
 	refresh_fc_eg_chan( OPN, cch[5] );
 
+#ifdef FM_SSE2
+	if (generate_sse2(OPN, cch, dacen, dacout, buffer, length))
+	{
+		INTERNAL_TIMER_B(State,length)
+		return;
+	}
+#endif
+
 	/* buffering */
 	for(i=0; i < length ; i++)
 	{
@@ -4784,12 +5167,12 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 		advance_lfo(OPN);
 
 		/* clear outputs */
-		out_fm[0] = 0;
-		out_fm[1] = 0;
-		out_fm[2] = 0;
-		out_fm[3] = 0;
-		out_fm[4] = 0;
-		out_fm[5] = 0;
+		OPN->out_fm[0] = 0;
+		OPN->out_fm[1] = 0;
+		OPN->out_fm[2] = 0;
+		OPN->out_fm[3] = 0;
+		OPN->out_fm[4] = 0;
+		OPN->out_fm[5] = 0;
 		
 		/* calculate FM */
 		chan_calc(OPN, cch[0], 0 );
@@ -4820,18 +5203,18 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 		{
 			int32_t lt, rt;
 
-			lt  = ((out_fm[0]>>0) & OPN->pan[0]);
-			rt  = ((out_fm[0]>>0) & OPN->pan[1]);
-			lt += ((out_fm[1]>>0) & OPN->pan[2]);
-			rt += ((out_fm[1]>>0) & OPN->pan[3]);
-			lt += ((out_fm[2]>>0) & OPN->pan[4]);
-			rt += ((out_fm[2]>>0) & OPN->pan[5]);
-			lt += ((out_fm[3]>>0) & OPN->pan[6]);
-			rt += ((out_fm[3]>>0) & OPN->pan[7]);
-			lt += ((out_fm[4]>>0) & OPN->pan[8]);
-			rt += ((out_fm[4]>>0) & OPN->pan[9]);
-			lt += ((out_fm[5]>>0) & OPN->pan[10]);
-			rt += ((out_fm[5]>>0) & OPN->pan[11]);
+			lt  = ((OPN->out_fm[0]>>0) & OPN->pan[0]);
+			rt  = ((OPN->out_fm[0]>>0) & OPN->pan[1]);
+			lt += ((OPN->out_fm[1]>>0) & OPN->pan[2]);
+			rt += ((OPN->out_fm[1]>>0) & OPN->pan[3]);
+			lt += ((OPN->out_fm[2]>>0) & OPN->pan[4]);
+			rt += ((OPN->out_fm[2]>>0) & OPN->pan[5]);
+			lt += ((OPN->out_fm[3]>>0) & OPN->pan[6]);
+			rt += ((OPN->out_fm[3]>>0) & OPN->pan[7]);
+			lt += ((OPN->out_fm[4]>>0) & OPN->pan[8]);
+			rt += ((OPN->out_fm[4]>>0) & OPN->pan[9]);
+			lt += ((OPN->out_fm[5]>>0) & OPN->pan[10]);
+			rt += ((OPN->out_fm[5]>>0) & OPN->pan[11]);
 			
 			lt >>= FINAL_SH;
 			rt >>= FINAL_SH;
@@ -4845,24 +5228,7 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 				SAVE_ALL_CHANNELS
 			#endif
 
-			/* Mix with buffer. */
-			lt += *buffer;
-			/* Make it louder. */
-			if (loud)
-				lt = ((lt * 3) >> 1);
-			/* Lower volume? */
-			if (volume != 100)
-				lt = ((lt * (int)volume) / 100);
-			/* Hard clipping for signed 16-bit output. */
-			lt = ((abs(lt + 32767) - abs(lt - 32767)) >> 1);
 			*(buffer++) = lt;
-
-			rt += *buffer;
-			if (loud)
-				rt = ((rt * 3) >> 1);
-			if (volume != 100)
-				rt = ((rt * (int)volume) / 100);
-			rt = ((abs(rt + 32767) - abs(rt - 32767)) >> 1);
 			*(buffer++) = rt;
 		}
 
@@ -4873,85 +5239,83 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 
 }
 
-#ifdef _STATE_H
-static void YM2612_postload(void)
+
+/* Mix raw samples from YM2612Generate() with a buffer. */
+void YM2612Mix(INT16 *buffer, const INT32 *fm, unsigned int length,
+	       unsigned int volume, int loud)
 {
-	int num , r;
+	unsigned int i = 0;
 
-	for(num=0;num<YM2612NumChips;num++)
-	{
-		/* DAC data & port */
-		FM2612[num].dacout = ((int)FM2612[num].REGS[0x2a] - 0x80) << 6;	/* level unknown */
-		FM2612[num].dacen  = FM2612[num].REGS[0x2d] & 0x80;
-		/* OPN registers */
-		/* DT / MULTI , TL , KS / AR , AMON / DR , SR , SL / RR , SSG-EG */
-		for(r=0x30;r<0x9e;r++)
-			if((r&3) != 3)
-			{
-				OPNWriteReg(&FM2612[num].OPN,r,FM2612[num].REGS[r]);
-				OPNWriteReg(&FM2612[num].OPN,r|0x100,FM2612[num].REGS[r|0x100]);
-			}
-		/* FB / CONNECT , L / R / AMS / PMS */
-		for(r=0xb0;r<0xb6;r++)
-			if((r&3) != 3)
-			{
-				OPNWriteReg(&FM2612[num].OPN,r,FM2612[num].REGS[r]);
-				OPNWriteReg(&FM2612[num].OPN,r|0x100,FM2612[num].REGS[r|0x100]);
-			}
-		/* channels */
-		/*FM_channel_postload(FM2612[num].CH,6);*/
+#ifdef FM_SSE2
+	i = mix_sse2(buffer, fm, (length * 2), volume, loud);
+	buffer += i;
+	fm += i;
+	i /= 2;
+#endif
+	for (; (i != length); ++i) {
+		int32_t lt = *(fm++);
+		int32_t rt = *(fm++);
+
+		/* Mix with buffer. */
+		lt += *buffer;
+		/* Make it louder. */
+		if (loud)
+			lt = ((lt * 3) >> 1);
+		/* Lower volume? */
+		if (volume != 100)
+			lt = ((lt * (int)volume) / 100);
+		/* Hard clipping for signed 16-bit output. */
+		lt = ((abs(lt + 32767) - abs(lt - 32767)) >> 1);
+		*(buffer++) = lt;
+
+		rt += *buffer;
+		if (loud)
+			rt = ((rt * 3) >> 1);
+		if (volume != 100)
+			rt = ((rt * (int)volume) / 100);
+		rt = ((abs(rt + 32767) - abs(rt - 32767)) >> 1);
+		*(buffer++) = rt;
 	}
-	cur_chip = NULL;
 }
 
-static void YM2612_save_state(void)
+/* Generate samples for one of the YM2612s and mix them with a buffer */
+void YM2612UpdateOne(YM2612 *FM2612, int num, INT16 *buffer,
+		     unsigned int length, unsigned int volume, int loud)
 {
-	int num;
-	const char statename[] = "YM2612";
+	INT32 fm[(256 * 2)];
 
-	for(num=0;num<YM2612NumChips;num++)
-	{
-		state_save_register_UINT8 (statename, num, "regs"   , FM2612[num].REGS   , 512);
-		FMsave_state_st(statename,num,&FM2612[num].OPN.ST);
-		FMsave_state_channel(statename,num,FM2612[num].CH,6);
-		/* 3slots */
-		state_save_register_UINT32 (statename, num, "slot3fc" , FM2612[num].OPN.SL3.fc ,   3);
-		state_save_register_UINT8  (statename, num, "slot3fh" , &FM2612[num].OPN.SL3.fn_h, 1);
-		state_save_register_UINT8  (statename, num, "slot3kc" , FM2612[num].OPN.SL3.kcode, 3);
-		/* address register1 */
-		state_save_register_UINT8 (statename, num, "addr_A1" , &FM2612[num].addr_A1, 1);
+	while (length != 0) {
+		unsigned int n = ((length < 256) ? length : 256);
+
+		YM2612Generate(FM2612, num, fm, n);
+		YM2612Mix(buffer, fm, n, volume, loud);
+		buffer += (n * 2);
+		length -= n;
 	}
-	state_save_register_func_postload(YM2612_postload);
 }
-#endif /* _STATE_H */
 
-/* initialize YM2612 emulator(s) */
-int YM2612Init(int num, int clock, int rate, int mjazz,
+
+/* initialize YM2612 emulator(s), returns an array of num chips owned by */
+/* the caller or NULL on error */
+YM2612 *YM2612Init(int num, int clock, int rate, int mjazz,
                FM_TIMERHANDLER TimerHandler,FM_IRQHANDLER IRQHandler)
 {
+	YM2612 *FM2612;
 	int i;
 
-	if (FM2612) return (-1);	/* duplicate init. */
-	cur_chip = NULL;	/* hiro-shi!! */
-
-	YM2612NumChips = num;
-
 	/* allocate extend state space */
-	if( (FM2612 = (YM2612 *)malloc(sizeof(YM2612) * YM2612NumChips))==NULL)
-		return (-1);
+	if( (FM2612 = (YM2612 *)malloc(sizeof(YM2612) * num))==NULL)
+		return NULL;
 	/* clear */
-	memset(FM2612,0,sizeof(YM2612) * YM2612NumChips);
-	/* allocate total level table (128kb space) */
+	memset(FM2612,0,sizeof(YM2612) * num);
+	/* fill the shared tables on first use */
 	if( !init_tables() )
 	{
-		if (FM2612) {
-			free( FM2612 );
-			FM2612 = NULL;
-		}
-		return (-1);
+		free( FM2612 );
+		return NULL;
 	}
 
-	for ( i = 0 ; i < YM2612NumChips; i++ ) {
+	for ( i = 0 ; i < num; i++ ) {
 		FM2612[i].OPN.ST.index = i;
 		FM2612[i].OPN.type = TYPE_YM2612;
 		FM2612[i].OPN.P_CH = FM2612[i].CH;
@@ -4964,28 +5328,22 @@ int YM2612Init(int num, int clock, int rate, int mjazz,
 		/* Extend handler */
 		FM2612[i].OPN.ST.Timer_Handler = TimerHandler;
 		FM2612[i].OPN.ST.IRQ_Handler   = IRQHandler;
-		YM2612ResetChip(i);
+		YM2612ResetChip(FM2612, i);
 	}
-#ifdef _STATE_H
-	YM2612_save_state();
-#endif
-	return 0;
+	return FM2612;
 }
 
 /* shut down emulator */
-void YM2612Shutdown()
+void YM2612Shutdown(YM2612 *FM2612)
 {
 	if (!FM2612) return;
 
 	FMCloseTable();
-	if (FM2612) {
-		free(FM2612);
-		FM2612 = NULL;
-	}
+	free(FM2612);
 }
 
 /* reset one of chip */
-void YM2612ResetChip(int num)
+void YM2612ResetChip(YM2612 *FM2612, int num)
 {
 	int i;
 	YM2612 *F2612 = &(FM2612[num]);
@@ -5022,7 +5380,7 @@ void YM2612ResetChip(int num)
 /* n = number  */
 /* a = address */
 /* v = value   */
-int YM2612Write(int n, int a, UINT8 v)
+int YM2612Write(YM2612 *FM2612, int n, int a, UINT8 v)
 {
 	YM2612 *F2612 = &(FM2612[n]);
 	int addr;
@@ -5055,7 +5413,6 @@ int YM2612Write(int n, int a, UINT8 v)
 			case 0x2b:	/* DAC Sel  (YM2612) */
 				/* b7 = dac enable */
 				F2612->dacen = v & 0x80;
-				cur_chip = NULL;
 				break;
 			default:	/* OPN section */
 				YM2612UpdateReq(n);
@@ -5090,7 +5447,7 @@ int YM2612Write(int n, int a, UINT8 v)
 	return F2612->OPN.ST.irq;
 }
 
-UINT8 YM2612Read(int n,int a)
+UINT8 YM2612Read(YM2612 *FM2612, int n,int a)
 {
 	YM2612 *F2612 = &(FM2612[n]);
 
@@ -5106,7 +5463,7 @@ UINT8 YM2612Read(int n,int a)
 	return 0;
 }
 
-int YM2612TimerOver(int n,int c)
+int YM2612TimerOver(YM2612 *FM2612, int n,int c)
 {
 	YM2612 *F2612 = &(FM2612[n]);
 
@@ -5129,7 +5486,7 @@ int YM2612TimerOver(int n,int c)
 }
 
 /* Implemented by zamaz for dgen */
-void YM2612_dump(int num, uint8_t buf[512])
+void YM2612_dump(YM2612 *FM2612, int num, uint8_t buf[512])
 {
 	YM2612 *F2612 = &(FM2612[num]);
 
@@ -5137,13 +5494,13 @@ void YM2612_dump(int num, uint8_t buf[512])
 }
 
 /* Implemented by zamaz for dgen */
-void YM2612_restore(int num, uint8_t buf[512])
+void YM2612_restore(YM2612 *FM2612, int num, uint8_t buf[512])
 {
 	YM2612 *F2612 = &(FM2612[num]);
 	unsigned int r;
 
 	memcpy(F2612->REGS, buf, 512);
-	/* See YM2612_postload(). */
+	/* Same as MAME's YM2612_postload(). */
 	F2612->dacout = ((buf[0x2a] - 0x80) << 6);
 	F2612->dacen  = (buf[0x2d] & 0x80);
 	for (r = 0x30; (r != 0x9e); ++r) {
@@ -5379,11 +5736,11 @@ void debug_show_ym2612_chan_regs(uint8_t regs[512], uint8_t ch)
 }
 
 #define DEBUG_MAX_CHAN				6
-void debug_show_ym2612_regs()
+void debug_show_ym2612_regs(YM2612 *FM2612)
 {
 	uint8_t			regs[512], chan;
 
-	YM2612_dump(0, regs);
+	YM2612_dump(FM2612, 0, regs);
 
 	printf("ym2612:\n");
 	debug_show_ym2612_global_regs(regs);
@@ -203,19 +203,26 @@ int YM2610TimerOver(int n, int c );
 #endif /* BUILD_YM2610 */
 
 #if BUILD_YM2612
-int YM2612Init(int num, int baseclock, int rate, int mjazz,
-               FM_TIMERHANDLER TimerHandler,FM_IRQHANDLER IRQHandler);
-void YM2612Shutdown(void);
-void YM2612ResetChip(int num);
-void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
-		     unsigned int volume, int loud);
-
-int YM2612Write(int n, int a,unsigned char v);
-unsigned char YM2612Read(int n,int a);
-int YM2612TimerOver(int n, int c );
+/* chip state is opaque, each emulator instance owns its own chips */
+struct ym2612;
 
-void YM2612_dump(int num, uint8_t buf[512]);
-void YM2612_restore(int num, uint8_t buf[512]);
+struct ym2612 *YM2612Init(int num, int baseclock, int rate, int mjazz,
+               FM_TIMERHANDLER TimerHandler,FM_IRQHANDLER IRQHandler);
+void YM2612Shutdown(struct ym2612 *chips);
+void YM2612ResetChip(struct ym2612 *chips, int num);
+void YM2612UpdateOne(struct ym2612 *chips, int num, INT16 *buffer,
+		     unsigned int length, unsigned int volume, int loud);
+void YM2612Generate(struct ym2612 *chips, int num, INT32 *buffer,
+		    unsigned int length);
+void YM2612Mix(INT16 *buffer, const INT32 *fm, unsigned int length,
+	       unsigned int volume, int loud);
+
+int YM2612Write(struct ym2612 *chips, int n, int a,unsigned char v);
+unsigned char YM2612Read(struct ym2612 *chips, int n,int a);
+int YM2612TimerOver(struct ym2612 *chips, int n, int c );
+
+void YM2612_dump(struct ym2612 *chips, int num, uint8_t buf[512]);
+void YM2612_restore(struct ym2612 *chips, int num, uint8_t buf[512]);
 #endif /* BUILD_YM2612 */
 
 #if 0 //BUILD_YM2151
@@ -0,0 +1,140 @@
+// DGen frame buffers
+// Frames are drawn directly into one of several buffers and handed over to
+// the presenter once complete, instead of being copied.
+//
+// The emulation thread draws into a buffer nobody else uses, then publishes
+// it as the latest frame. The presenter takes the latest frame and gives it
+// back once done. When the presenter falls behind, unpresented frames are
+// drawn over instead of stopping emulation.
+//
+// Buffers keep their contents, which the VDP relies on to skip scanlines
+// that haven't changed since they were last drawn into the same buffer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "md.h"
+#include "system.h"
+#include "frames.h"
+
+/**
+ * Allocate frame buffers.
+ * @param w Width in pixels.
+ * @param h Height in pixels.
+ * @param bpp Bits per pixel.
+ * @param count Number of buffers, 2 for double buffering, 3 for triple.
+ */
+md_frames::md_frames(int w, int h, int bpp, unsigned int count):
+	drops(0)
+{
+	size_t pitch = ((size_t)w * BITS_TO_BYTES(bpp));
+	size_t size = (pitch * h);
+	unsigned int i;
+
+	if (count < 2)
+		count = 2;
+	else if (count > FRAMES_MAX)
+		count = FRAMES_MAX;
+	frames.resize(count);
+	memory.resize(size * count);
+	for (i = 0; (i != count); ++i) {
+		struct frame *f = &frames[i];
+
+		f->bm.data = &memory[(size * i)];
+		f->bm.w = w;
+		f->bm.h = h;
+		f->bm.pitch = pitch;
+		f->bm.bpp = bpp;
+		f->state = FRAME_FREE;
+		memset(f->serial, 0, sizeof(f->serial));
+	}
+}
+
+/**
+ * Find a buffer in a given state.
+ * @param state State to look for.
+ * @return Buffer, NULL if none.
+ */
+struct md_frames::frame *md_frames::find(enum frame_state state)
+{
+	unsigned int i;
+
+	for (i = 0; (i != frames.size()); ++i)
+		if (frames[i].state == state)
+			return &frames[i];
+	return NULL;
+}
+
+/**
+ * Get a buffer to draw the next frame into.
+ * The previous one must have been published.
+ * @return Buffer.
+ */
+struct bmap *md_frames::draw()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	struct frame *f;
+
+	if ((f = find(FRAME_DRAWING)) != NULL)
+		return &f->bm;
+	// Draw over the latest frame if the presenter didn't take it.
+	if ((f = find(FRAME_FREE)) == NULL) {
+		f = find(FRAME_READY);
+		++drops;
+	}
+	f->state = FRAME_DRAWING;
+	return &f->bm;
+}
+
+/**
+ * Make the frame being drawn the latest one.
+ * @param vdp VDP that drew it, to know which scanlines changed.
+ */
+void md_frames::publish(md_vdp &vdp)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	struct frame *f = find(FRAME_DRAWING);
+	struct frame *ready = find(FRAME_READY);
+	unsigned int i;
+
+	if (f == NULL)
+		return;
+	for (i = 0; (i != 256); ++i)
+		f->serial[i] = vdp.line_serial(&f->bm, i);
+	if (ready != NULL) {
+		ready->state = FRAME_FREE;
+		++drops;
+	}
+	f->state = FRAME_READY;
+}
+
+/**
+ * Take the latest frame for presentation, release() must be called once
+ * done with it.
+ * @param[out] serials What each scanline holds, rows for which it
+ * differs from the previous frame presented must be updated.
+ * @return Latest frame, NULL if no new one is ready.
+ */
+struct bmap *md_frames::present(const unsigned int **serials)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	struct frame *f = find(FRAME_READY);
+
+	if (f == NULL)
+		return NULL;
+	f->state = FRAME_PRESENTING;
+	*serials = f->serial;
+	return &f->bm;
+}
+
+/**
+ * Give the presented frame back.
+ */
+void md_frames::release()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	struct frame *f = find(FRAME_PRESENTING);
+
+	if (f != NULL)
+		f->state = FRAME_FREE;
+}
@@ -0,0 +1,47 @@
+// DGen frame buffers
+// Frames are drawn directly into one of several buffers and handed over to
+// the presenter once complete, instead of being copied.
+
+#ifndef FRAMES_H_
+#define FRAMES_H_
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include "md.h"
+
+/** Maximum number of frame buffers, triple buffering. */
+#define FRAMES_MAX		LINE_STATE_BITMAPS
+
+class md_frames
+{
+public:
+	md_frames(int w, int h, int bpp, unsigned int count);
+	struct bmap *draw();
+	void publish(md_vdp &vdp);
+	struct bmap *present(const unsigned int **serials);
+	void release();
+	unsigned int dropped() const { return drops; }
+
+private:
+	enum frame_state {
+		FRAME_FREE,
+		FRAME_DRAWING, /**< Owned by the emulation thread. */
+		FRAME_READY, /**< Latest complete frame, not presented yet. */
+		FRAME_PRESENTING /**< Owned by the presenter. */
+	};
+	struct frame {
+		struct bmap	bm;
+		enum frame_state state;
+		/** What each scanline holds, see md_vdp::line_serial(). */
+		unsigned int	serial[256];
+	};
+	std::vector<struct frame> frames;
+	std::vector<unsigned char> memory;
+	std::mutex mutex;
+	unsigned int drops; // Frames replaced before being presented
+
+	struct frame *find(enum frame_state state);
+};
+
+#endif // FRAMES_H_
@@ -15,6 +15,7 @@
 #include "rc-vars.h"
 #include "debug.h"
 #include "decode.h"
+#include "vdp_render.h"
 
 #include "dgen.h"
 
@@ -169,8 +170,19 @@ void md::musa_memory_map()
 	unsigned int rom0_len = romlen;
 	unsigned int rom1_sta = 0;
 	unsigned int rom1_len = 0;
+	unsigned int ram_wp = 0;
+	uint8_t rom_wp[0x100] = { 0 };
 
 	m68k_register_memory(NULL, 0);
+#ifdef WITH_DEBUGGER
+	// Watched RAM must go through m68k_read/write_memory_*(). Also keep
+	// it away from the translator which doesn't expect external writes.
+	ram_wp = debug_wp_m68k_page[0xff];
+	// Same for reads from watched ROM pages, it can still be executed
+	// directly since instruction fetches aren't watched.
+	for (unsigned int p = 0; (p != elemof(rom_wp)); ++p)
+		rom_wp[p] = (debug_wp_m68k_page[p] & WP_FLAG_READ);
+#endif
 	if (save_len) {
 		DEBUG(("[%06x-%06x] ???? (SAVE)",
 		       save_start, (save_start + save_len - 1)));
@@ -194,25 +206,50 @@ void md::musa_memory_map()
 	const m68k_mem_t mem[3] = {
 		// r, w, x, swab, addr, size, mask, mem
 		{ 1, 0, 1, S, 0x000000, rom0_len, 0x7fffff, rom }, // M68K ROM
-		{ 1, 1, 1, 1, 0xe00000, 0x200000, 0x00ffff, ram }, // M68K RAM
+		{ !(ram_wp & WP_FLAG_READ), !(ram_wp & WP_FLAG_WRITE),
+		  !(ram_wp & WP_FLAG_WRITE), 1,
+		  0xe00000, 0x200000, 0x00ffff, ram }, // M68K RAM
 		{ 1, 0, 1, S, rom1_sta, rom1_len, 0x7fffff, &rom[rom1_sta] }
 	};
 	unsigned int i;
 	unsigned int j = 0;
 
-	for (i = 0; ((i < elemof(mem)) && (j < elemof(musa_memory))); ++i) {
-		if (mem[i].size == 0)
-			continue;
-		DEBUG(("[%06x-%06x] %c%c%c%c (%s)",
-		       mem[i].addr,
-		       (mem[i].addr + mem[i].size - 1),
-		       (mem[i].r ? 'r' : '-'),
-		       (mem[i].w ? 'w' : '-'),
-		       (mem[i].x ? 'x' : '-'),
-		       (mem[i].swab ? 's' : '-'),
-		       (mem[i].w ? "RAM" : "ROM")));
-		musa_memory[j] = mem[i];
-		++j;
+	for (i = 0; (i < elemof(mem)); ++i) {
+		unsigned int addr = mem[i].addr;
+		unsigned int end = (mem[i].addr + mem[i].size);
+
+		// ROM is split into runs of 64KB pages with the same watched
+		// state.
+		while ((addr < end) && (j < elemof(musa_memory))) {
+			m68k_mem_t *m = &musa_memory[j];
+			unsigned int next = end;
+
+			*m = mem[i];
+			if (mem[i].mem != ram) {
+				uint8_t wp = rom_wp[((addr >> 16) & 0xff)];
+
+				next = ((addr | 0xffff) + 1);
+				while ((next < end) &&
+				       (rom_wp[((next >> 16) & 0xff)] == wp))
+					next += 0x10000;
+				if (next > end)
+					next = end;
+				m->r = !wp;
+				m->mem = &rom[addr];
+			}
+			m->addr = addr;
+			m->size = (next - addr);
+			DEBUG(("[%06x-%06x] %c%c%c%c (%s)",
+			       m->addr,
+			       (m->addr + m->size - 1),
+			       (m->r ? 'r' : '-'),
+			       (m->w ? 'w' : '-'),
+			       (m->x ? 'x' : '-'),
+			       (m->swab ? 's' : '-'),
+			       ((m->mem == ram) ? "RAM" : "ROM")));
+			addr = next;
+			++j;
+		}
 	}
 	if (j)
 		m68k_register_memory(musa_memory, j);
@@ -302,6 +339,10 @@ int md::reset()
 
   memset(&odo, 0, sizeof(odo));
   ras = 0;
+  pic_line = 0;
+  pic_skip = false;
+  pad_line = 0;
+  dma_end = 0;
 
   z80_st_running = 0;
   m68k_st_running = 0;
@@ -487,10 +528,9 @@ void md::z80_reset()
  */
 bool md::init_sound()
 {
-	if (lock == false)
-		return false;
 	if (ok_ym2612) {
-		YM2612Shutdown();
+		YM2612Shutdown(ctx_ym2612);
+		ctx_ym2612 = NULL;
 		ok_ym2612 = false;
 	}
 	if (ok_sn76496) {
@@ -498,12 +538,14 @@ bool md::init_sound()
 		ok_sn76496 = false;
 	}
 	// Initialize two additional chips when MJazz is enabled.
-	if (YM2612Init((dgen_mjazz ? 3 : 1),
-		       (((pal) ? PAL_MCLK : NTSC_MCLK) / 7),
-		       dgen_soundrate, dgen_mjazz, NULL, NULL))
+	ctx_ym2612 = YM2612Init((dgen_mjazz ? 3 : 1),
+				(((pal) ? PAL_MCLK : NTSC_MCLK) / 7),
+				dgen_soundrate, dgen_mjazz, NULL, NULL);
+	if (ctx_ym2612 == NULL)
 		return false;
 	ok_ym2612 = true;
-	if (SN76496_init(0,
+	memset(&ctx_sn76496, 0, sizeof(ctx_sn76496));
+	if (SN76496_init(&ctx_sn76496,
 			 (((pal) ? PAL_MCLK : NTSC_MCLK) / 15),
 			 dgen_soundrate, 16))
 		return false;
@@ -541,7 +583,20 @@ void md::init_pal()
 	}
 }
 
-bool md::lock = false;
+/**
+ * Build the lookup tables shared by all MD objects.
+ * Only the first constructor calls this, see md::md().
+ * @return True (always).
+ */
+bool md::init_shared()
+{
+#ifdef WITH_MUSA
+	m68k_init();
+#endif
+	YM2612Shutdown(YM2612Init(1, (NTSC_MCLK / 7), 44100, 0, NULL, NULL));
+	SN76496_init_tables();
+	return true;
+}
 
 /**
  * MD constructor.
@@ -549,6 +604,9 @@ bool md::lock = false;
  * @param region Region to emulate ('J', 'U', or 'E').
  */
 md::md(bool pal, char region):
+#ifdef WITH_PROFILER
+	md_profiler_instr_run_counts(NULL), md_profiler_instr_count(0),
+#endif
 #ifdef WITH_MUSA
 	md_musa_ref(0), md_musa_prev(0),
 #endif
@@ -564,13 +622,14 @@ md::md(bool pal, char region):
 #ifdef WITH_MZ80
 	md_mz80_ref(0), md_mz80_prev(0),
 #endif
-	pal(pal), ok_ym2612(false), ok_sn76496(false),
-	vdp(*this), region(region), plugged(false)
+	pal(pal), ok_ym2612(false), ok_sn76496(false), ctx_ym2612(NULL),
+	vdp(*this), vdp_render(NULL), region(region), plugged(false)
 {
-	// Only one MD object is allowed to exist at once.
-	if (lock)
-		return;
-	lock = true;
+	// Several MD objects may exist at once, each driven by its own
+	// thread. Initialization of local statics is thread-safe.
+	static const bool shared = init_shared();
+
+	(void)shared;
 
 	// PAL or NTSC.
 	init_pal();
@@ -584,6 +643,14 @@ md::md(bool pal, char region):
   mem=ram=z80ram=saveram=NULL;
   save_start=save_len=save_prot=save_active=0;
 
+  fm_data = NULL;
+  fm_size = 0;
+  fm_max = 0;
+  fm_len = 0;
+  fm_chips = 1;
+  sound_len = 0;
+  dac_ring = NULL;
+  dac_size = 0;
   fm_reset();
 
 #ifdef WITH_VGMDUMP
@@ -603,13 +670,19 @@ md::md(bool pal, char region):
 
 #ifdef WITH_MUSA
 	ctx_musa = calloc(1, m68k_context_size());
-	if (ctx_musa == NULL)
+	ctx_musa_dcache = malloc(m68k_decode_cache_size());
+	if ((ctx_musa == NULL) || (ctx_musa_dcache == NULL))
 		goto cleanup;
 	md_set_musa(1);
 	m68k_init();
+	m68k_set_decode_cache(ctx_musa_dcache);
+	// Not fatal, m68k_execute_jit() interprets everything without it.
+	ctx_musa_jit = m68k_jit_create();
+	m68k_set_jit(ctx_musa_jit);
 	m68k_set_cpu_type(M68K_CPU_TYPE_68000);
 	m68k_register_memory(NULL, 0);
 	m68k_set_int_ack_callback(musa_irq_callback);
+	m68k_set_instr_hook_callback(musa_instr_hook_callback);
 	md_set_musa(0);
 #endif
 
@@ -673,6 +746,7 @@ md::md(bool pal, char region):
   z80ram[0x10006] = 0x00;
   z80ram[0x10007] = 0x00;
 
+	m68k_page_map();
 #ifdef WITH_MUSA
 	md_set_musa(1);
 	musa_memory_map();
@@ -711,7 +785,8 @@ md::md(bool pal, char region):
 	md_set_star(0);
 #endif
 
-	// M68K: 0 = none, 1 = StarScream, 2 = Musashi, 3 = Cyclone
+	// M68K: 0 = none, 1 = StarScream, 2 = Musashi, 3 = Cyclone,
+	// 4 = Musashi with block translator (x86-64 only)
 	switch (dgen_emu_m68k) {
 #ifdef WITH_STAR
 	case 1:
@@ -719,6 +794,13 @@ md::md(bool pal, char region):
 		break;
 #endif
 #ifdef WITH_MUSA
+#if M68K_JIT
+	case 4:
+		cpu_emu = CPU_EMU_MUSA_JIT;
+		break;
+#else
+	case 4: // Block translator compiled out
+#endif
 	case 2:
 		cpu_emu = CPU_EMU_MUSA;
 		break;
@@ -775,11 +857,13 @@ md::md(bool pal, char region):
 	return;
 cleanup:
 	if (ok_ym2612)
-		YM2612Shutdown();
+		YM2612Shutdown(ctx_ym2612);
 	if (ok_sn76496)
 		(void)0;
 #ifdef WITH_MUSA
 	free(ctx_musa);
+	free(ctx_musa_dcache);
+	m68k_jit_destroy(ctx_musa_jit);
 #endif
 #ifdef WITH_STAR
 	delete [] fetch;
@@ -790,11 +874,11 @@ cleanup:
 #endif
 	free(mem);
 	memset(this, 0, sizeof(*this));
-	lock = false;
 }
 
 md::~md()
 {
+	delete vdp_render;
 #ifdef WITH_VGMDUMP
 	vgm_dump_stop();
 #endif
@@ -811,6 +895,8 @@ md::~md()
 #endif
 #ifdef WITH_MUSA
 	free(ctx_musa);
+	free(ctx_musa_dcache);
+	m68k_jit_destroy(ctx_musa_jit);
 #endif
 #ifdef WITH_STAR
 	delete [] fetch;
@@ -821,12 +907,16 @@ md::~md()
 #endif
 
 	if (ok_ym2612)
-		YM2612Shutdown();
+		YM2612Shutdown(ctx_ym2612);
 	if (ok_sn76496)
 		(void)0;
+	free(fm_data);
+	free(dac_ring);
+#ifdef WITH_PROFILER
+	md_profiler_end();
+#endif
 	ok=0;
 	memset(this, 0, sizeof(*this));
-	lock = false;
 }
 
 #ifdef ROM_BYTESWAP
@@ -898,6 +988,7 @@ int md::plug_in(unsigned char *cart,int len)
       save_start = save_len = 0;
       saveram = NULL;
     }
+	m68k_page_map();
 #ifdef WITH_MUSA
 	md_set_musa(1);
 	musa_memory_map();
@@ -952,6 +1043,7 @@ int md::unplug()
   free(saveram);
   saveram = NULL;
   save_start = save_len = 0;
+	m68k_page_map();
 #ifdef WITH_MUSA
 	md_set_musa(1);
 	musa_memory_map();
@@ -1180,6 +1272,10 @@ int md::patch(const char *list, unsigned int *errors,
       }
       dest[((p.addr + 0) ^ swap) & mask] = (uint8_t)(p.data >> 8);
       dest[((p.addr + 1) ^ swap) & mask] = (uint8_t)(p.data & 0xff);
+#ifdef WITH_MUSA
+      m68k_decode_cache_invalidate(ctx_musa_dcache, p.addr);
+      m68k_jit_flush(ctx_musa_jit);
+#endif
     }
   // Done!
   free(worklist);
@@ -131,9 +131,35 @@ enum DrawPlane
 	PLANE_W
 };
 
+// Display widths, scanlines are drawn by a renderer specialized for each
+enum DisplayMode
+{
+	DISPLAY_H32, // 256 dots
+	DISPLAY_H40, // 320 dots
+	DISPLAY_H56 // 448 dots, 16:9 enhanced mode (H40 with reg 1 bit 0)
+};
+
+#if VRAM_128KB
+#define VRAM_SIZE 0x20000
+#else
+#define VRAM_SIZE 0x10000
+#endif
+
+// Sprites processed on a single line, no more than the per-line limit
+// (36 in H56 mode)
+#define SPRITE_LINE_MAX 36
+
+// Bitmaps whose scanlines are remembered at once, for triple buffering
+#define LINE_STATE_BITMAPS 3
+
+#define LAYER_MARGIN 16
+#define LAYER_WIDTH (448 + (LAYER_MARGIN * 2))
+
 class md;
+class md_vdp_render;
 class md_vdp
 {
+  friend class md_vdp_render;
 public:
   // Next three lines are the state of the VDP
   // They have to be public so we can save and load states
@@ -157,23 +183,74 @@ private:
   int dma_len();
   int dma_addr();
   unsigned char dma_mem_read(int addr);
+  void dma_68k(uint32_t addr, unsigned int len);
   int putword(unsigned short d);
   int putbyte(unsigned char d);
+  // Decoded tiles, one byte per dot, normal and x flipped. Tiles are
+  // decoded when first drawn and invalidated by poke_vram().
+  uint8_t tile_cache[2][(VRAM_SIZE >> 5)][64];
+  uint8_t tile_valid[(VRAM_SIZE >> 5)]; // Bit 0: normal, bit 1: x flipped
+  // VRAM (one bit per 256 bytes) and CRAM changed since md_vdp_render
+  // last logged them.
+  uint8_t log_vram[(VRAM_SIZE >> 11)];
+  bool log_cram;
+  // Incremented when VRAM or CRAM changes, so that scanlines drawn before
+  // are drawn again.
+  unsigned int changes;
+  // What each scanline was last drawn from in the last few bitmaps, to skip
+  // drawing it again when nothing it depends on has changed since.
+  struct line_state {
+    const unsigned char *dest; // Where it was drawn, NULL if not yet
+    unsigned int serial; // Unique to that drawing, the oldest is replaced
+    int bpp;
+    unsigned int changes;
+    int masking_sprite_index;
+    int dots;
+    uint8_t collision; // Status bit it raised
+    uint8_t reg[0x20];
+    uint8_t vsram[0x80];
+  } drawn[256][LINE_STATE_BITMAPS];
+  uint8_t drawn_last[256]; // Entry of the last drawing of each line
+  unsigned int drawn_serial;
+  template <bool INTERLACE>
+  inline unsigned int tile_line_addr(unsigned int bank, int which, int line);
+  inline const uint8_t *tile_line(unsigned int addr, unsigned int xflip);
   // Used by draw_scanline to render the different display components
-  void draw_tile1(int plane, int which, int line, unsigned char *where);
-  void draw_tile1_solid(int plane, int which, int line, unsigned char *where);
-  void draw_tile2(int plane, int which, int line, unsigned char *where);
-  void draw_tile2_solid(int plane, int which, int line, unsigned char *where);
-  void draw_tile3(int plane, int which, int line, unsigned char *where);
-  void draw_tile3_solid(int plane, int which, int line, unsigned char *where);
-  void draw_tile4(int plane, int which, int line, unsigned char *where);
-  void draw_tile4_solid(int plane, int which, int line, unsigned char *where);
-  void draw_window(int line, int front);
-  void draw_sprites(int line, bool front);
-  void draw_plane_back0(int line);
-  void draw_plane_back1(int line);
-  void draw_plane_front0(int line);
-  void draw_plane_front1(int line);
+  // into their layer, then merge them into the destination. These are
+  // specialized for each DisplayMode, interlace setting and number of
+  // bytes per pixel.
+  template <bool INTERLACE>
+  inline void draw_tile(unsigned int bank, int which, int line,
+			uint8_t *where);
+  template <bool INTERLACE>
+  inline void draw_tile_sprite(unsigned int bank, int which, int line,
+			       uint8_t *where);
+  template <unsigned int MODE, bool INTERLACE>
+  void draw_window(int line);
+  template <unsigned int MODE, bool INTERLACE>
+  void draw_sprites(int line);
+  template <unsigned int MODE, bool INTERLACE>
+  void draw_plane0(int line);
+  template <unsigned int MODE, bool INTERLACE>
+  void draw_plane1(int line);
+  template <unsigned int BPP, unsigned int MODE>
+  void draw_merge();
+  template <unsigned int BPP, unsigned int MODE, bool INTERLACE>
+  void render_line(int line);
+  // Renderer for the current registers and depth, NULL when one must be
+  // selected from render_table again. Same for the sprites-only collide
+  // from collide_table.
+  typedef void (md_vdp::*render_func)(int line);
+  static const render_func render_table[4][3][2]; // [Bpp - 1][mode][il]
+  static const render_func collide_table[3][2]; // [mode][il]
+  render_func render;
+  render_func collide;
+  intptr_t render_h56; // dgen_vdp_h56 they were selected for
+  void render_select();
+  void render_h56_check();
+#ifdef WITH_DEBUG_VDP
+  void draw_sprites_boxing(int line);
+#endif
   struct sprite_info {
     uint8_t* sprite; // sprite location
     uint32_t* tile; // array of tiles (th * tw)
@@ -189,15 +266,19 @@ private:
     unsigned int yflip:1; // Y-flipped
   };
   inline void get_sprite_info(struct sprite_info&, int);
-  inline void sprite_mask_add(uint8_t*, int, struct sprite_info&, int);
   // Working variables for the above
   unsigned char sprite_order[0x101], *sprite_base;
-  uint8_t sprite_mask[512][512];
+  // Sprites found on each line, as sprite_order indices, in order
+  uint8_t sprite_line[256][SPRITE_LINE_MAX];
+  uint8_t sprite_line_count[256];
   int sprite_count;
-  int masking_sprite_index_cache;
+  int masking_sprite_index_cache; // Last sprite_line entry to draw
   int dots_cache;
+  // One line of each DrawPlane layer, indexed by dot position plus
+  // LAYER_MARGIN so tiles can be drawn partially off-screen.
+  // Each byte holds a palette index (bits 0-5) and the priority bit (7).
+  uint8_t layer[4][LAYER_WIDTH];
   unsigned int Bpp;
-  unsigned int Bpp_times8;
   struct bmap *bmap;
   unsigned char *dest;
   md& belongs;
@@ -217,13 +298,26 @@ public:
   int writebyte(unsigned char d);
 
   unsigned char *dirt; // Bitfield: what has changed VRAM/CRAM/VSRAM/Reg
+  // Set each time the palette is updated, for the thread owning the frame.
+  // Handy for the 8bpp implementation, so we don't waste time changing the
+  // palette unnecessarily.
+  bool pal_dirty;
   void reset();
+  void tile_cache_flush();
 
-  uint32_t highpal[64];
+  // Colors for normal, shadowed and highlighted palette indices
+  uint32_t highpal[192];
   // Draw a scanline
+  uint8_t status; // Status bits (sprite overflow, collision) found drawing
   void sprite_masking_overflow(int line);
-  void sprite_mask_generate();
+  void sprite_lines_generate();
+  void sprite_line_update(int line);
   void draw_scanline(struct bmap *bits, int line);
+  void skip_scanline(int line);
+  bool scanline_changed(struct bmap *bits, int line);
+  void render_scanline(struct bmap *bits, int line);
+  void collide_scanline(int line);
+  unsigned int line_serial(const struct bmap *bits, int line);
   void draw_pixel(struct bmap *bits, int x, int y, uint32_t rgb);
   void write_reg(uint8_t addr, uint8_t data);
 };
@@ -368,16 +462,18 @@ public:
 	static int md_profiler_instr_hook_callback(void);
 	unsigned int *md_profiler_get_instr_run_counts(int* instr_count);
 	unsigned int md_profiler_get_instr_num_cycles(unsigned int address);
-	static unsigned int *md_profiler_instr_run_counts;
-	static int md_profiler_instr_count;
+	unsigned int *md_profiler_instr_run_counts;
+	int md_profiler_instr_count;
 #endif
 #ifdef WITH_MUSA
-	static class md* md_musa;
+	// Musashi's state is thread-local, so is the MD object it belongs to.
+	static thread_local class md* md_musa;
 	unsigned int md_musa_ref;
 	class md* md_musa_prev;
 
 	bool md_set_musa(bool set);
 	void md_set_musa_sync(bool push);
+	static int musa_instr_hook_callback(void);
 #endif
 #ifdef WITH_CYCLONE
 	static class md* md_cyclone;
@@ -430,11 +526,12 @@ public:
 	unsigned int vblank(); // Return first vblank line
 
 private:
-	static bool lock; // Prevent other MD objects
-
 	unsigned int ok: 1;
 	unsigned int ok_ym2612: 1; // YM2612
 	unsigned int ok_sn76496: 1; // SN76496
+	struct ym2612 *ctx_ym2612; // YM2612 (3 of them with MJazz)
+	struct SN76496 ctx_sn76496;
+	static bool init_shared();
 
   unsigned int romlen;
   unsigned char *mem,*rom,*ram,*z80ram;
@@ -444,6 +541,7 @@ private:
   int save_prot, save_active; // Flags set from $A130F1
 public:
   md_vdp vdp;
+  md_vdp_render *vdp_render; // Threaded renderer, NULL when disabled
   m68k_state_t m68k_state;
   z80_state_t z80_state;
   void m68k_state_dump();
@@ -475,8 +573,11 @@ private:
 #endif
 #ifdef WITH_MUSA
 	void *ctx_musa;
+	void *ctx_musa_dcache;
+	void *ctx_musa_jit;
 	void musa_memory_map();
-	m68k_mem_t musa_memory[3];
+	// ROM (split around read-watched pages, save RAM hole) and RAM
+	m68k_mem_t musa_memory[(0x80 + 3)];
 	friend int musa_irq_callback(int);
 #endif
 #ifdef WITH_CYCLONE
@@ -497,6 +598,22 @@ private:
 		int z80;
 		int z80_max;
 	} odo;
+	// Frame events, processed in this order when they coincide.
+	enum md_event {
+		MD_EV_VBLANK, // V-blank flag goes up
+		MD_EV_HINT, // H-blank interrupt
+		MD_EV_LINE, // Next line must be rendered
+		MD_EV_VINT_FLAG, // VINT flag goes up
+		MD_EV_VINT, // V-blank interrupt, Z80 IRQ asserted
+		MD_EV_Z80_IRQ_CLEAR, // Z80 IRQ released
+		MD_EV_FRAME_END, // Last cycle of the frame
+		MD_EV_NUM
+	};
+	// Event times in M68K cycles since the beginning of the frame,
+	// INT_MAX when not scheduled.
+	int event_time[MD_EV_NUM];
+	void event_schedule(enum md_event ev, int when);
+	int event_next(); // Time of the next event
 
   int ras;
 
@@ -505,9 +622,15 @@ private:
 
   int aoo3_toggle,aoo5_toggle,aoo3_six,aoo5_six;
   int aoo3_six_timeout, aoo5_six_timeout;
+  unsigned int pad_line; // Lines already counted by pad_update()
+  unsigned int frame_line(); // Current line
+  unsigned char  calculate_coo5();
   unsigned char  calculate_coo8();
   unsigned char  calculate_coo9();
   int may_want_to_get_pic(struct bmap *bm,unsigned char retpal[256],int mark);
+  unsigned int pic_line; // Next line pic_catch_up() goes through
+  bool pic_skip; // Frame isn't drawn, lines are gone through on demand
+  void pic_catch_up();
   int may_want_to_get_sound(struct sndinfo *sndi);
 
 	// Horizontal counter table
@@ -516,6 +639,16 @@ private:
 	unsigned int m68k_read_pc(); // PC data
 	int m68k_odo(); // M68K odometer
 	void m68k_run(); // Run M68K to odo.m68k_max
+#ifdef WITH_MUSA
+	bool m68k_idle_ea(unsigned int ea, unsigned int size, uint32_t *pc,
+			  bool *status);
+	unsigned int m68k_idle_loop(uint32_t start, uint32_t pc,
+				    bool *status);
+	void m68k_idle_skip(); // Fast-forward idle loops
+#endif
+	void m68k_freeze(int cycles); // Stop M68K while it can't use its bus
+	int dma_end; // M68K odometer value when the current DMA ends
+	int dma_cycles(unsigned int slots); // DMA duration from now
 	void m68k_busreq_request(); // Issue BUSREQ
 	void m68k_busreq_cancel(); // Cancel BUSREQ
 	void m68k_irq(int i); // Trigger M68K IRQ
@@ -524,6 +657,11 @@ private:
 
 	int z80_odo(); // Z80 odometer
 	void z80_run(); // Run Z80 to odo.z80_max
+#ifdef WITH_CZ80
+	unsigned int z80_idle_loop(uint16_t start, uint16_t pc);
+	int z80_idle_exec(int cycles); // Cz80_Exec() skipping idle loops
+	void z80_refresh(int prev); // Count R from the odometer
+#endif
 	void z80_sync(int fake); // Synchronize Z80 with M68K
 	void z80_irq(int vector); // Trigger Z80 IRQ
 	void z80_irq_clear(); // Clear Z80 IRQ
@@ -540,17 +678,63 @@ private:
   int fm_ticker[4];
   signed short fm_reg[2][0x100]; // All of them (-1 = not def'd yet)
 
-	uint8_t dac_data[0x400];
-	unsigned int dac_len;
+	// FM output is generated along the frame, up to each register write
+	// so that it takes effect at the right time, then mixed with the
+	// other sources once the frame is complete.
+	int32_t *fm_data; // Interleaved stereo samples, fm_max per chip
+	unsigned int fm_size; // Samples allocated per chip
+	unsigned int fm_max; // Samples in this frame, 0 when not generating
+	unsigned int fm_len; // Samples generated so far
+	unsigned int fm_chips; // Chips generated in this frame (MJazz)
+	void fm_start(unsigned int len);
+	void fm_generate(unsigned int len);
+	void fm_catch_up();
+	// PSG and DAC output changes are recorded as they happen, then turned
+	// into samples once the frame is complete.
+	unsigned int sound_len; // Samples in this frame, 0 when not recording
+	void psg_catch_up();
+	uint64_t sound_pos(unsigned int len, unsigned int shift);
+
+	// DAC level changes, in a ring that grows as needed.
+	struct dac_write {
+		uint32_t pos; // Samples into the frame (16.16 fixed point)
+		int16_t level;
+	};
+	struct dac_write *dac_ring;
+	unsigned int dac_size; // Power of two
+	unsigned int dac_head; // Oldest change
+	unsigned int dac_count;
+	int16_t dac_level; // Level before the oldest change
+	uint8_t dac_data; // Last value written
 	bool dac_enabled;
 	void dac_init();
 	void dac_submit(uint8_t d);
 	void dac_enable(uint8_t d);
+	void dac_push(int16_t level);
+	void dac_mix(int16_t *lr, unsigned int len);
+
+	// Handler type for each 64KB page of the M68K address space.
+	enum m68k_page_type {
+		M68K_PAGE_EMPTY,
+		M68K_PAGE_ROM,
+		M68K_PAGE_SRAM, // ROM page overlapped by save RAM
+		M68K_PAGE_Z80,
+		M68K_PAGE_IO,
+		M68K_PAGE_VDP,
+		M68K_PAGE_RAM,
+#ifdef WITH_PICO
+		M68K_PAGE_PICO,
+#endif
+	};
+	uint8_t m68k_page[0x100];
+	void m68k_page_map();
 
   uint8_t m68k_ROM_read(uint32_t a);
+  uint8_t m68k_Z80_read(uint32_t a);
   uint8_t m68k_IO_read(uint32_t a);
   uint8_t m68k_VDP_read(uint32_t a);
   void m68k_ROM_write(uint32_t, uint8_t);
+  void m68k_Z80_write(uint32_t, uint8_t);
   void m68k_IO_write(uint32_t, uint8_t);
 
 
@@ -621,6 +805,9 @@ public:
 	void misc_writebyte(uint32_t a, uint8_t d);
 	uint16_t misc_readword(uint32_t a);
 	void misc_writeword(uint32_t a, uint16_t d);
+	const uint8_t *dma_source(uint32_t a, unsigned int *len,
+				  unsigned int *swap);
+	void dma_start(unsigned int slots, bool freeze);
 
 	void z80_init();
 	void z80_reset();
@@ -654,6 +841,9 @@ public:
 #endif
 #ifdef WITH_CYCLONE
     CPU_EMU_CYCLONE,
+#endif
+#ifdef WITH_MUSA
+    CPU_EMU_MUSA_JIT,
 #endif
     CPU_EMU_TOTAL
   } cpu_emu; // OK to read it but call cycle_cpu() to change it
@@ -664,6 +854,7 @@ public:
 #endif
   int import_gst(FILE *hand);
   int export_gst(FILE *hand);
+  uint64_t state_hash();
 
   char romname[256];
 
@@ -725,6 +916,13 @@ public:
 	unsigned int debug_trace_m68k;
 	struct dgen_bp debug_bp_z80[MAX_BREAKPOINTS];
 	struct dgen_wp debug_wp_z80[MAX_WATCHPOINTS];
+	uint32_t debug_bp_m68k_map[(BP_MAP_BITS / 32)];
+	uint32_t debug_bp_z80_map[(BP_MAP_BITS / 32)];
+	uint8_t debug_wp_m68k_page[WP_PAGES];
+	uint8_t debug_wp_z80_page[WP_PAGES];
+	int debug_wp_m68k_hit;
+	int debug_wp_z80_hit;
+	bool debug_m68k_hooked;
 	unsigned int debug_step_z80;
 	unsigned int debug_trace_z80;
 	int debug_context;
@@ -751,7 +949,6 @@ public:
 	int debug_find_bp_z80(uint16_t);
 	int debug_find_wp_z80(uint16_t);
 	void debug_print_z80_wp(int);
-	int debug_should_z80_wp_fire(struct dgen_wp *w);
 	uint32_t m68k_get_pc();
 	uint16_t z80_get_pc();
 	uint32_t debug_m68k_get_reg(m68k_register_t reg);
@@ -760,6 +957,23 @@ public:
 	bool debug_m68k_check_wps();
 	bool debug_z80_check_bps();
 	bool debug_z80_check_wps();
+	bool debug_m68k_check_bp(uint32_t pc);
+	bool debug_z80_check_bp(uint16_t pc);
+	uint32_t debug_expr_eval(const struct dgen_expr *e, int context);
+	bool debug_bp_hit(int idx, int context);
+	int debug_parse_bp(const char *arg);
+	bool debug_m68k_hook(bool enable);
+	bool debug_z80_hook(bool enable);
+	void debug_update_bp_m68k_map();
+	void debug_update_bp_z80_map();
+	void debug_update_wp_m68k_map();
+	void debug_update_wp_z80_map();
+	inline void debug_m68k_wp_access(uint32_t addr, uint32_t type);
+	inline void debug_z80_wp_access(uint16_t addr, uint32_t type);
+	void debug_m68k_match_wps(uint32_t addr, uint32_t type);
+	void debug_m68k_wp_range(const struct dgen_wp *w, uint32_t *start,
+				 uint32_t *end);
+	void debug_z80_match_wps(uint16_t addr, uint32_t type);
 	void debug_rm_bp_m68k(int);
 	void debug_rm_wp_m68k(int);
 	void debug_rm_bp_z80(int);
@@ -770,6 +984,8 @@ public:
 	void debug_list_wps_z80();
 	int debug_set_bp_m68k(uint32_t);
 	int debug_set_bp_z80(uint16_t);
+	int debug_set_bp_cond(int context, int index, const char *cond,
+			      uint32_t count, int log);
 	void debug_clear_bp_m68k();
 	void debug_clear_bp_m68k(uint32_t);
 
@@ -792,6 +1008,9 @@ public:
   int debug_cmd_step(int n_args, char **args);
   int debug_cmd_trace(int n_args, char **args);
   int debug_cmd_minus_break(int n_args, char **args);
+  int debug_cmd_cond(int n_args, char **args);
+  int debug_cmd_hits(int n_args, char **args);
+  int debug_cmd_tp(int n_args, char **args);
   int debug_cmd_cpu(int n_args, char **args);
   int debug_cmd_dis(int n_args, char **args);
   int debug_cmd_mem(int n_args, char **args);
@@ -810,10 +1029,12 @@ public:
   void debug_update_z80_wp_cache(struct dgen_wp *w);
   void debug_update_fired_m68k_wps(void);
   void debug_update_fired_z80_wps(void);
-  void debug_set_wp_m68k(uint32_t start_addr, uint32_t end_addr);
+  void debug_set_wp_m68k(uint32_t start_addr, uint32_t end_addr,
+			 uint32_t flags = WP_FLAG_DEFAULT);
   void debug_clear_wp_m68k();
   void debug_clear_wp_m68k(uint32_t start_addr);
-  void debug_set_wp_z80(uint16_t start_addr, uint16_t end_addr);
+  void debug_set_wp_z80(uint16_t start_addr, uint16_t end_addr,
+			uint32_t flags = WP_FLAG_DEFAULT);
   void debug_print_m68k_disassemble(uint32_t from, int len);
   void debug_print_z80_disassemble(uint16_t, unsigned int);
   void debug_show_m68k_regs(void);
@@ -827,4 +1048,33 @@ inline int md::has_save_ram()
   return save_len;
 }
 
+#ifdef WITH_DEBUGGER
+
+/**
+ * Check a M68K memory access against watchpoints. Cheap unless the
+ * accessed page is watched.
+ *
+ * @param addr Address accessed.
+ * @param type WP_FLAG_READ or WP_FLAG_WRITE and access size.
+ */
+inline void md::debug_m68k_wp_access(uint32_t addr, uint32_t type)
+{
+	if (debug_wp_m68k_page[((addr >> 16) & (WP_PAGES - 1))] & type)
+		debug_m68k_match_wps(addr, type);
+}
+
+/**
+ * Z80 counterpart of debug_m68k_wp_access().
+ *
+ * @param addr Address accessed.
+ * @param type WP_FLAG_READ or WP_FLAG_WRITE and access size.
+ */
+inline void md::debug_z80_wp_access(uint16_t addr, uint32_t type)
+{
+	if (debug_wp_z80_page[(addr >> 8)] & type)
+		debug_z80_match_wps(addr, type);
+}
+
+#endif
+
 #endif // __MD_H__
@@ -18,22 +18,21 @@
 #include "md.h"
 #include "debug.h"
 #include "rc-vars.h"
+#include "vdp_render.h"
 
 // Set and unset contexts (Musashi, StarScream, MZ80)
 
 #ifdef WITH_PROFILER
-unsigned int *md::md_profiler_instr_run_counts = NULL;
-int md::md_profiler_instr_count = 0;
-
 void md::md_profiler_init(unsigned char* rom, int length)
 {
+	md_profiler_end();
 	md_profiler_instr_count = length / sizeof(short);
 	md_profiler_instr_run_counts = (unsigned int*)malloc(md_profiler_instr_count * sizeof(int));
 	memset(md_profiler_instr_run_counts, 0, md_profiler_instr_count * sizeof(int));
 #ifdef WITH_MUSA
 	bool musa_set = md_set_musa(true);
 #endif
-	m68k_set_instr_hook_callback(md::md_profiler_instr_hook_callback);
+	m68k_set_instr_hook_callback(md::musa_instr_hook_callback);
 #ifdef WITH_MUSA
 	md_set_musa(musa_set);
 #endif
@@ -43,15 +42,17 @@ void md::md_profiler_end()
 {
 	if(md_profiler_instr_run_counts)
 		free(md_profiler_instr_run_counts);
+	md_profiler_instr_run_counts = NULL;
+	md_profiler_instr_count = 0;
 }
 
 int md::md_profiler_instr_hook_callback(void)
 {
 	unsigned int address = m68k_get_reg(NULL, M68K_REG_PC);
 	unsigned int instruction = address / sizeof(short);
-	if (instruction < md_profiler_instr_count)
+	if ((md_musa != NULL) && (instruction < md_musa->md_profiler_instr_count))
 	{
-		md_profiler_instr_run_counts[instruction]++;
+		md_musa->md_profiler_instr_run_counts[instruction]++;
 	}
 	return 0;
 }
@@ -69,7 +70,25 @@ unsigned int md::md_profiler_get_instr_num_cycles(unsigned int address)
 #endif
 
 #ifdef WITH_MUSA
-class md* md::md_musa(0);
+thread_local class md* md::md_musa(0);
+
+// Called by Musashi before each instruction, a nonzero return value ends
+// the current timeslice before executing it.
+int md::musa_instr_hook_callback(void)
+{
+#ifdef WITH_PROFILER
+	md_profiler_instr_hook_callback();
+#endif
+#ifdef WITH_DEBUGGER
+	if ((md_musa != NULL) && (md_musa->debug_m68k_hooked) &&
+	    ((md_musa->debug_m68k_check_wps()) ||
+	     (md_musa->debug_m68k_check_bp(m68k_get_reg(NULL, M68K_REG_PC))))) {
+		fflush(stdout);
+		return 1;
+	}
+#endif
+	return 0;
+}
 
 bool md::md_set_musa(bool set)
 {
@@ -430,7 +449,7 @@ void md::md_set_drz80_sync(bool push)
 void md::md_set(bool set)
 {
 #ifdef WITH_MUSA
-	if (cpu_emu == CPU_EMU_MUSA)
+	if ((cpu_emu == CPU_EMU_MUSA) || (cpu_emu == CPU_EMU_MUSA_JIT))
 		md_set_musa(set);
 	else
 #endif
@@ -466,7 +485,7 @@ void md::md_set(bool set)
 // Return PC data.
 unsigned int md::m68k_read_pc()
 {
-	static bool rec = false;
+	static thread_local bool rec = false;
 	unsigned int pc;
 
 	// Forbid recursion.
@@ -474,7 +493,7 @@ unsigned int md::m68k_read_pc()
 		return h2be16(0xdead);
 	rec = true;
 #ifdef WITH_MUSA
-	if (cpu_emu == CPU_EMU_MUSA) {
+	if ((cpu_emu == CPU_EMU_MUSA) || (cpu_emu == CPU_EMU_MUSA_JIT)) {
 		md_set_musa(1);
 		pc = m68k_get_reg(NULL, M68K_REG_PC);
 		md_set_musa(0);
@@ -508,7 +527,8 @@ int md::m68k_odo()
 {
 	if (m68k_st_running) {
 #ifdef WITH_MUSA
-		if (cpu_emu == CPU_EMU_MUSA)
+		if ((cpu_emu == CPU_EMU_MUSA) ||
+		    (cpu_emu == CPU_EMU_MUSA_JIT))
 			return (odo.m68k + m68k_cycles_run());
 #endif
 #ifdef WITH_CYCLONE
@@ -525,6 +545,239 @@ int md::m68k_odo()
 	return odo.m68k;
 }
 
+#ifdef WITH_MUSA
+
+/**
+ * Check an operand of an idle loop instruction.
+ * Only operands whose value cannot change while the M68K runs alone are
+ * accepted: data registers, immediates, RAM, ROM and the VDP status port.
+ * @param ea Effective address field (mode and register).
+ * @param size Operand size in bytes.
+ * @param[in,out] pc Address of the extension words, moved past them.
+ * @param[out] status Set to true if the operand is the VDP status port.
+ * @return True if the operand is acceptable.
+ */
+bool md::m68k_idle_ea(unsigned int ea, unsigned int size, uint32_t *pc,
+		      bool *status)
+{
+	uint32_t addr;
+
+	switch (ea >> 3) {
+	case 0: // Dn
+		return true;
+	case 2: // (An)
+		addr = m68k_get_reg(NULL, (m68k_register_t)
+				    (M68K_REG_A0 + (ea & 7)));
+		break;
+	case 5: // d16(An)
+		addr = (m68k_get_reg(NULL, (m68k_register_t)
+				     (M68K_REG_A0 + (ea & 7))) +
+			(int16_t)misc_readword(*pc));
+		*pc += 2;
+		break;
+	case 7:
+		switch (ea & 7) {
+		case 0: // (xxx).w
+			addr = (int16_t)misc_readword(*pc);
+			*pc += 2;
+			break;
+		case 1: // (xxx).l
+			addr = ((misc_readword(*pc) << 16) |
+				misc_readword(*pc + 2));
+			*pc += 4;
+			break;
+		case 2: // d16(PC)
+			addr = (*pc + (int16_t)misc_readword(*pc));
+			*pc += 2;
+			break;
+		case 4: // #imm
+			*pc += ((size == 4) ? 4 : 2);
+			return true;
+		default:
+			return false;
+		}
+		break;
+	default:
+		return false;
+	}
+	addr &= 0x00ffffff;
+	if ((size != 1) && (addr & 1))
+		return false; // Address error.
+	switch (m68k_page[(addr >> 16)]) {
+	case M68K_PAGE_ROM:
+	case M68K_PAGE_RAM:
+		return true;
+	case M68K_PAGE_VDP:
+		// coo4/coo5 only change between m68k_run() calls, except for
+		// the H-blank and DMA busy flags (see calculate_coo5()).
+		addr &= 0xe700ff;
+		if ((addr < 0xc00004) || ((addr + size) > 0xc00008))
+			return false;
+		*status = true;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Find whether an idle loop starts at a given address.
+ * An idle loop is a short sequence of instructions that only read
+ * unchanging operands (see m68k_idle_ea()), set flags or overwrite data
+ * registers with them, and ends with a branch back to its start. Once it
+ * has been executed, every following iteration is identical.
+ * @param start First instruction of the loop.
+ * @param pc Address that must be an instruction boundary in the loop.
+ * @param[out] status Set to true if the loop reads the VDP status port.
+ * @return Number of instructions in the loop, 0 if it isn't one.
+ */
+unsigned int md::m68k_idle_loop(uint32_t start, uint32_t pc, bool *status)
+{
+	uint32_t addr = start;
+	bool found = (start == pc);
+	unsigned int i;
+
+	for (i = 1; (i <= 4); ++i) {
+		uint16_t op = misc_readword(addr);
+		unsigned int ea = (op & 0x3f);
+		unsigned int size = (1 << ((op >> 6) & 3));
+		bool ok;
+
+		addr += 2;
+		if ((op & 0xf000) == 0x6000) {
+			int32_t disp = (int8_t)op;
+
+			// Bcc/BRA back to start, BSR excluded.
+			if ((op & 0x0f00) == 0x0100)
+				return 0;
+			if (disp == 0)
+				disp = (int16_t)misc_readword(addr);
+			if ((addr + disp) != start)
+				return 0;
+			return (found ? i : 0);
+		}
+		if (((op & 0xff00) == 0x4a00) && (size != 8))
+			// TST.s <ea>
+			ok = ((ea != 0x3c) &&
+			      (m68k_idle_ea(ea, size, &addr, status)));
+		else if (((op & 0xff00) == 0x0c00) && (size != 8)) {
+			// CMPI.s #imm,<ea>
+			addr += ((size == 4) ? 4 : 2);
+			ok = ((ea != 0x3c) &&
+			      (m68k_idle_ea(ea, size, &addr, status)));
+		}
+		else if ((op & 0xffc0) == 0x0800) {
+			// BTST #imm,<ea>
+			addr += 2;
+			ok = ((ea != 0x3c) &&
+			      (m68k_idle_ea(ea, 1, &addr, status)));
+		}
+		else if (((op & 0xf1c0) == 0x0100) && ((op & 0x38) != 0x08))
+			// BTST Dn,<ea>
+			ok = m68k_idle_ea(ea, 1, &addr, status);
+		else if (((op & 0xc1c0) == 0x0000) && (op & 0x3000)) {
+			// MOVE.s <ea>,Dn
+			static const uint8_t move_size[4] = { 0, 1, 4, 2 };
+
+			ok = m68k_idle_ea(ea, move_size[((op >> 12) & 3)],
+					  &addr, status);
+		}
+		else if (((op & 0xff38) == 0x0200) && (size != 8)) {
+			// ANDI.s #imm,Dn
+			addr += ((size == 4) ? 4 : 2);
+			ok = true;
+		}
+		else if (((op & 0xf100) == 0xb000) && (size != 8))
+			// CMP.s <ea>,Dn
+			ok = m68k_idle_ea(ea, size, &addr, status);
+		else
+			return 0;
+		if (!ok)
+			return 0;
+		if (addr == pc)
+			found = true;
+	}
+	return 0;
+}
+
+/**
+ * Skip iterations of an idle loop.
+ * When the M68K is in an idle loop (see m68k_idle_loop()), run it up to
+ * its start, time one iteration and advance odo.m68k by as many whole
+ * iterations as fit before odo.m68k_max, or before the H-blank or DMA busy
+ * flags change if the loop polls them. The remaining cycles are left to the core,
+ * which then stops on the same instruction and cycle as it would have
+ * without skipping.
+ */
+void md::m68k_idle_skip()
+{
+	uint32_t pc = (m68k_get_reg(NULL, M68K_REG_PC) & 0x00ffffff);
+	uint32_t start = pc;
+	uint32_t addr;
+	unsigned int n = 0;
+	unsigned int i;
+	bool status = false;
+	int iter = 0;
+	int limit = odo.m68k_max;
+	int pos;
+
+	if ((pc & 1) || (m68k_get_reg(NULL, M68K_REG_SR) & 0x8000))
+		return; // Odd PC or tracing.
+	// The CPU may be anywhere in the loop, look for branches back to or
+	// before it. Extension words may look like branches, the loop is
+	// decoded properly afterwards.
+	for (addr = pc; ((n == 0) && (addr != (pc + 0x20))); addr += 2) {
+		uint16_t op = misc_readword(addr);
+		int32_t disp = (int8_t)op;
+
+		if (((op & 0xf000) != 0x6000) || ((op & 0x0f00) == 0x0100))
+			continue;
+		if (disp == 0)
+			disp = (int16_t)misc_readword(addr + 2);
+		start = ((addr + 2 + disp) & 0x00ffffff);
+		if ((start > pc) || ((pc - start) >= 0x20))
+			continue;
+		status = false;
+		n = m68k_idle_loop(start, pc, &status);
+	}
+	if (n == 0)
+		return;
+	// Single-step to the start of the loop, then over one iteration.
+	for (i = 0; (pc != start); ++i) {
+		if ((i == n) || (odo.m68k >= odo.m68k_max))
+			return;
+		odo.m68k += m68k_execute(1);
+		pc = (m68k_get_reg(NULL, M68K_REG_PC) & 0x00ffffff);
+	}
+	for (i = 0; (i != n); ++i) {
+		int cycles;
+
+		if (odo.m68k >= odo.m68k_max)
+			return;
+		cycles = m68k_execute(1);
+		odo.m68k += cycles;
+		iter += cycles;
+	}
+	if (status) {
+		// Stop at the next H-blank flag change after the timed
+		// iteration started.
+		pos = ((odo.m68k - iter) % M68K_CYCLES_PER_LINE);
+		pos = ((odo.m68k - iter - pos) +
+		       ((pos < M68K_CYCLES_HBLANK) ?
+			M68K_CYCLES_HBLANK : M68K_CYCLES_PER_LINE));
+		if (pos < limit)
+			limit = pos;
+		// Same for the DMA busy flag.
+		if ((dma_end > (odo.m68k - iter)) && (dma_end < limit))
+			limit = dma_end;
+	}
+	if (((m68k_get_reg(NULL, M68K_REG_PC) & 0x00ffffff) != start) ||
+	    (odo.m68k >= limit))
+		return;
+	odo.m68k += (((limit - odo.m68k) / iter) * iter);
+}
+
+#endif // WITH_MUSA
+
 // Run M68K to odo.m68k_max
 void md::m68k_run()
 {
@@ -543,9 +796,12 @@ void md::m68k_run()
 		goto cpu_stalled;
 	debug_m68k = (debug_step_m68k ||
 		      debug_trace_m68k ||
-		      debug_instr_count_enabled ||
-		      debug_is_m68k_bp_set() ||
-		      debug_is_m68k_wp_set());
+		      debug_instr_count_enabled);
+	// Breakpoints and watchpoints alone are checked by the core when
+	// possible.
+	if ((!debug_m68k_hook(!debug_m68k)) &&
+	    ((debug_is_m68k_bp_set()) || (debug_is_m68k_wp_set())))
+		debug_m68k = true;
 	if (debug_m68k) {
 		prev_odo = odo.m68k;
 		cycles_to_debug = cycles;
@@ -556,8 +812,30 @@ void md::m68k_run()
 	}
 #endif
 #ifdef WITH_MUSA
-	if (cpu_emu == CPU_EMU_MUSA)
-		odo.m68k += m68k_execute(cycles);
+	if ((cpu_emu == CPU_EMU_MUSA) || (cpu_emu == CPU_EMU_MUSA_JIT)) {
+		// Breakpoints and watchpoints must see every instruction.
+		if ((dgen_m68k_idle_skip)
+#ifdef WITH_DEBUGGER
+		    && (!debug_m68k) && (!debug_m68k_hooked)
+#endif
+		    ) {
+			m68k_idle_skip();
+			cycles = (odo.m68k_max - odo.m68k);
+		}
+		if (cycles > 0) {
+#ifdef WITH_DEBUGGER
+			// Single instructions, translating blocks is
+			// pointless.
+			if (debug_m68k)
+				odo.m68k += m68k_execute(cycles);
+			else
+#endif
+			if (cpu_emu == CPU_EMU_MUSA)
+				odo.m68k += m68k_execute(cycles);
+			else
+				odo.m68k += m68k_execute_jit(cycles);
+		}
+	}
 	else
 #endif
 #ifdef WITH_STAR
@@ -588,11 +866,40 @@ void md::m68k_run()
 			goto debug_next_instruction;
 		}
 	}
+	else
+		debug_m68k_check_wps(); // fired by the last instruction
 cpu_stalled:
 #endif
 	m68k_st_running = 0;
 }
 
+/**
+ * Stop the M68K for some time, e.g. while DMA uses its bus.
+ * When it is running, it stops executing instructions as soon as possible.
+ * @param cycles Number of M68K cycles.
+ */
+void md::m68k_freeze(int cycles)
+{
+	if (m68k_st_running) {
+#ifdef WITH_MUSA
+		if ((cpu_emu == CPU_EMU_MUSA) ||
+		    (cpu_emu == CPU_EMU_MUSA_JIT)) {
+			m68k_burn_cycles(cycles);
+			return;
+		}
+#endif
+#ifdef WITH_CYCLONE
+		if (cpu_emu == CPU_EMU_CYCLONE) {
+			cyclonecpu.cycles -= cycles;
+			return;
+		}
+#endif
+	}
+	// Other cores keep running until the end of their slice, the next
+	// one is shorter.
+	odo.m68k += cycles;
+}
+
 // Issue BUSREQ
 void md::m68k_busreq_request()
 {
@@ -623,7 +930,7 @@ void md::m68k_irq(int i)
 		return;
 #endif
 #ifdef WITH_MUSA
-	if (cpu_emu == CPU_EMU_MUSA)
+	if ((cpu_emu == CPU_EMU_MUSA) || (cpu_emu == CPU_EMU_MUSA_JIT))
 		m68k_set_irq(i);
 	else
 #endif
@@ -683,7 +990,7 @@ int md::z80_odo()
 	if (z80_st_running) {
 #ifdef WITH_CZ80
 		if (z80_core == Z80_CORE_CZ80)
-			return (odo.z80 + Cz80_Get_CycleRemaining(&cz80));
+			return (odo.z80 + Cz80_Get_CycleDone(&cz80));
 #endif
 #ifdef WITH_MZ80
 		if (z80_core == Z80_CORE_MZ80)
@@ -698,6 +1005,198 @@ int md::z80_odo()
 	return odo.z80;
 }
 
+#ifdef WITH_CZ80
+
+/**
+ * Check whether the Z80 is in an idle loop, like m68k_idle_loop() does
+ * for the M68K.
+ * Recognized loops have up to four instructions that load A from or test
+ * bits in Z80 RAM, set flags without side effects, and end with a jump
+ * back to the first one. Z80 RAM cannot change during z80_run() unless
+ * the Z80 writes to it, so such loops can only be left through an
+ * interrupt.
+ * @param start Address of the first instruction of the loop.
+ * @param pc Current PC, must be an instruction boundary within the loop.
+ * @return Number of instructions in the loop, 0 if not an idle loop.
+ */
+unsigned int md::z80_idle_loop(uint16_t start, uint16_t pc)
+{
+	uint16_t addr = start;
+	bool found = false;
+	unsigned int i;
+
+	for (i = 0; (i != 4); ++i) {
+		uint8_t op;
+		unsigned int ea = 0;
+		unsigned int target;
+
+		// Longest instructions are 3 bytes.
+		if (addr > (0x2000 - 3))
+			return 0;
+		if (addr == pc)
+			found = true;
+		op = z80ram[addr];
+		if ((op == 0x18) || ((op & 0xe7) == 0x20)) {
+			// JR e, JR cc,e
+			target = ((addr + 2 + (int8_t)z80ram[(addr + 1)]) &
+				  0xffff);
+			return (((found) && (target == start)) ? (i + 1) : 0);
+		}
+		if ((op == 0xc3) || ((op & 0xc7) == 0xc2)) {
+			// JP nn, JP cc,nn
+			target = (z80ram[(addr + 1)] |
+				  (z80ram[(addr + 2)] << 8));
+			return (((found) && (target == start)) ? (i + 1) : 0);
+		}
+		switch (op) {
+		case 0x3a: // LD A,(nn)
+			ea = (z80ram[(addr + 1)] | (z80ram[(addr + 2)] << 8));
+			addr += 3;
+			break;
+		case 0x0a: // LD A,(BC)
+			ea = Cz80_Get_BC(&cz80);
+			++addr;
+			break;
+		case 0x1a: // LD A,(DE)
+			ea = Cz80_Get_DE(&cz80);
+			++addr;
+			break;
+		case 0x7e: // LD A,(HL)
+			ea = Cz80_Get_HL(&cz80);
+			++addr;
+			break;
+		case 0xa7: // AND A
+		case 0xb7: // OR A
+			++addr;
+			break;
+		case 0xe6: // AND n
+		case 0xf6: // OR n
+		case 0xfe: // CP n
+			addr += 2;
+			break;
+		case 0xcb: // BIT b,r, BIT b,(HL)
+			op = z80ram[(addr + 1)];
+			if ((op & 0xc0) != 0x40)
+				return 0;
+			if ((op & 0x07) == 0x06)
+				ea = Cz80_Get_HL(&cz80);
+			addr += 2;
+			break;
+		case 0xdd: // LD A,(IX+d)
+		case 0xfd: // LD A,(IY+d)
+			if (z80ram[(addr + 1)] != 0x7e)
+				return 0;
+			ea = (((op == 0xdd) ?
+			       Cz80_Get_IX(&cz80) : Cz80_Get_IY(&cz80)) +
+			      (int8_t)z80ram[(addr + 2)]);
+			ea &= 0xffff;
+			addr += 3;
+			break;
+		default:
+			return 0;
+		}
+		// 0x0000-0x3fff: Z80 RAM.
+		if (ea > 0x3fff)
+			return 0;
+	}
+	return 0;
+}
+
+/**
+ * Cz80_Exec() replacement that fast-forwards the Z80 while it is halted
+ * or in an idle loop (see z80_idle_loop()). Results are identical to a
+ * plain Cz80_Exec() call, including the R register.
+ * @param cycles Number of cycles to execute.
+ * @return Number of cycles executed.
+ */
+int md::z80_idle_exec(int cycles)
+{
+	uint16_t pc = Cz80_Get_PC(&cz80);
+	uint16_t start = pc;
+	uint8_t r = cz80.R.B.L;
+	unsigned int addr;
+	unsigned int n = 0;
+	unsigned int i;
+	int done = 0;
+	int iter = 0;
+
+	// Pending interrupts are taken by the core, breakpoints and
+	// watchpoints must see every instruction.
+	if ((cz80.Status & (cz80.IFF.B.L | CZ80_HAS_NMI)) ||
+	    (cz80.Instr_Hook != NULL))
+		return Cz80_Exec(&cz80, cycles);
+	if ((cz80.Status & (CZ80_HALTED | CZ80_RUNNING |
+			    CZ80_DISABLE | CZ80_FAULTED)) == CZ80_HALTED) {
+		// Only an interrupt can wake it up.
+		cz80.R.B.L = ((r + (cycles >> 2)) & 0x7f);
+		return cycles;
+	}
+	// The Z80 may be anywhere in the loop, look for jumps back to or
+	// before it. Operands may look like jumps, the loop is decoded
+	// properly afterwards.
+	for (addr = pc; ((n == 0) && (addr != (pc + 0x10u)) &&
+			 (addr < (0x2000 - 3))); ++addr) {
+		uint8_t op = z80ram[addr];
+
+		if ((op == 0x18) || ((op & 0xe7) == 0x20))
+			start = ((addr + 2 + (int8_t)z80ram[(addr + 1)]) &
+				 0xffff);
+		else if ((op == 0xc3) || ((op & 0xc7) == 0xc2))
+			start = (z80ram[(addr + 1)] |
+				 (z80ram[(addr + 2)] << 8));
+		else
+			continue;
+		if ((start <= pc) && ((pc - start) < 0x10))
+			n = z80_idle_loop(start, pc);
+	}
+	if (n == 0)
+		return Cz80_Exec(&cz80, cycles);
+	// Single-step to the start of the loop, then over one iteration.
+	for (i = 0; (pc != start); ++i) {
+		if ((i == n) || (done >= cycles))
+			goto end;
+		done += Cz80_Exec(&cz80, 1);
+		pc = Cz80_Get_PC(&cz80);
+	}
+	for (i = 0; (i != n); ++i) {
+		int ret;
+
+		if (done >= cycles)
+			goto end;
+		ret = Cz80_Exec(&cz80, 1);
+		done += ret;
+		iter += ret;
+	}
+	if ((Cz80_Get_PC(&cz80) == start) && (done < cycles))
+		done += (((cycles - done) / iter) * iter);
+end:
+	// Cz80_Exec() only updates R when returning, make it look like a
+	// single call.
+	cz80.R.B.L = r;
+	if (done < cycles)
+		done += Cz80_Exec(&cz80, (cycles - done));
+	cz80.R.B.L = ((r + (done >> 2)) & 0x7f);
+	return done;
+}
+
+/**
+ * Cz80_Exec() adds a quarter of the cycles it executed to R, dropping the
+ * remainder each time. Count them from the odometer instead, so that R
+ * doesn't depend on how execution was sliced.
+ * @param prev Z80 odometer before executing.
+ */
+void md::z80_refresh(int prev)
+{
+	int done = (odo.z80 - prev);
+
+	if (done <= 0)
+		return;
+	cz80.R.B.L = ((cz80.R.B.L + ((odo.z80 >> 2) - (prev >> 2)) -
+		       (done >> 2)) & 0x7f);
+}
+
+#endif // WITH_CZ80
+
 // Run Z80 to odo.z80_max
 void md::z80_run()
 {
@@ -710,15 +1209,25 @@ void md::z80_run()
 
 	if (cycles <= 0)
 		return;
+	// Nothing to execute while BUSREQ or RESET hold the Z80.
+	if ((z80_st_busreq | z80_st_reset)
+#ifdef WITH_DEBUGGER
+	    && (!debug_trap)
+#endif
+	    ) {
+		odo.z80 += cycles;
+		return;
+	}
 	z80_st_running = 1;
 #ifdef WITH_DEBUGGER
 	if (debug_trap)
 		goto cpu_stalled;
 	debug_z80 = (debug_step_z80 ||
 		     debug_trace_z80 ||
-		     debug_instr_count_enabled ||
-		     debug_is_z80_bp_set() ||
-		     debug_is_z80_wp_set());
+		     debug_instr_count_enabled);
+	if ((!debug_z80_hook(!debug_z80)) &&
+	    ((debug_is_z80_bp_set()) || (debug_is_z80_wp_set())))
+		debug_z80 = true;
 	if (debug_z80) {
 		prev_odo = odo.z80;
 		cycles_to_debug = cycles;
@@ -728,37 +1237,44 @@ void md::z80_run()
 			goto cpu_stalled;
 	}
 #endif
-	if (z80_st_busreq | z80_st_reset)
-		odo.z80 += cycles;
-	else {
 #ifdef WITH_CZ80
-		if (z80_core == Z80_CORE_CZ80)
-			odo.z80 += Cz80_Exec(&cz80, cycles);
+	if (z80_core == Z80_CORE_CZ80) {
+		int prev = odo.z80;
+
+		if ((dgen_z80_idle_skip)
+#ifdef WITH_DEBUGGER
+		    && (!debug_z80)
+#endif
+		    )
+			odo.z80 += z80_idle_exec(cycles);
 		else
+			odo.z80 += Cz80_Exec(&cz80, cycles);
+		z80_refresh(prev);
+	}
+	else
 #endif
 #ifdef WITH_MZ80
-		if (z80_core == Z80_CORE_MZ80) {
-			mz80exec(cycles);
-			odo.z80 += mz80GetElapsedTicks(1);
-		}
-		else
+	if (z80_core == Z80_CORE_MZ80) {
+		mz80exec(cycles);
+		odo.z80 += mz80GetElapsedTicks(1);
+	}
+	else
 #endif
 #ifdef WITH_DRZ80
-		if (z80_core == Z80_CORE_DRZ80) {
-			int rem = DrZ80Run(&drz80, cycles);
-
-			// drz80.cycles is the number of cycles remaining,
-			// so it must be either 0 or a negative value.
-			// z80_odo() relies on this.
-			// This value is also returned by DrZ80Run().
-			assert(drz80.cycles <= 0);
-			assert(drz80.cycles == rem);
-			odo.z80 += (cycles - rem);
-		}
-		else
-#endif
-			odo.z80 += cycles;
+	if (z80_core == Z80_CORE_DRZ80) {
+		int rem = DrZ80Run(&drz80, cycles);
+
+		// drz80.cycles is the number of cycles remaining,
+		// so it must be either 0 or a negative value.
+		// z80_odo() relies on this.
+		// This value is also returned by DrZ80Run().
+		assert(drz80.cycles <= 0);
+		assert(drz80.cycles == rem);
+		odo.z80 += (cycles - rem);
 	}
+	else
+#endif
+		odo.z80 += cycles;
 #ifdef WITH_DEBUGGER
 	if (debug_z80) {
 		++debug_z80_instr_count;
@@ -770,6 +1286,8 @@ void md::z80_run()
 			goto debug_next_instruction;
 		}
 	}
+	else
+		debug_z80_check_wps(); // fired by the last instruction
 cpu_stalled:
 #endif
 	z80_st_running = 0;
@@ -778,7 +1296,9 @@ cpu_stalled:
 // Synchronize Z80 with M68K, don't execute code if fake is nonzero
 void md::z80_sync(int fake)
 {
-	int cycles = (m68k_odo() >> 1);
+	// Slices may be long, a rough M68K/Z80 ratio isn't good enough.
+	int cycles = ((m68k_odo() * Z80_CYCLES_PER_LINE) /
+		      M68K_CYCLES_PER_LINE);
 #ifdef WITH_DEBUGGER
 	int cycles_to_debug = 0;
 	int prev_odo = 0;
@@ -796,9 +1316,10 @@ void md::z80_sync(int fake)
 		goto cpu_stalled;
 	debug_z80 = (debug_step_z80 ||
 		     debug_trace_z80 ||
-		     debug_instr_count_enabled ||
-		     debug_is_z80_bp_set() ||
-		     debug_is_z80_wp_set());
+		     debug_instr_count_enabled);
+	if ((!debug_z80_hook(!debug_z80)) &&
+	    ((debug_is_z80_bp_set()) || (debug_is_z80_wp_set())))
+		debug_z80 = true;
 	if (debug_z80) {
 		prev_odo = odo.z80;
 		cycles_to_debug = cycles;
@@ -812,8 +1333,12 @@ void md::z80_sync(int fake)
 		odo.z80 += cycles;
 	else {
 #ifdef WITH_CZ80
-		if (z80_core == Z80_CORE_CZ80)
+		if (z80_core == Z80_CORE_CZ80) {
+			int prev = odo.z80;
+
 			odo.z80 += Cz80_Exec(&cz80, cycles);
+			z80_refresh(prev);
+		}
 		else
 #endif
 #ifdef WITH_MZ80
@@ -850,6 +1375,8 @@ void md::z80_sync(int fake)
 			goto debug_next_instruction;
 		}
 	}
+	else
+		debug_z80_check_wps(); // fired by the last instruction
 cpu_stalled:
 #endif
 	z80_st_running = 0;
@@ -925,32 +1452,77 @@ unsigned int md::vblank()
 	return (((pal) && (vdp.reg[1] & 0x08)) ? PAL_VBLANK : NTSC_VBLANK);
 }
 
-// 6-button pad status update. Should be called once per displayed line.
+// Return the line the M68K is currently on
+unsigned int md::frame_line()
+{
+	return (m68k_odo() / M68K_CYCLES_PER_LINE);
+}
+
+// 6-button pad status update. Catches up with the lines that started since
+// the previous call, must be called before accessing pads.
 void md::pad_update()
 {
+	unsigned int line = (frame_line() + 1);
+	unsigned int n;
+
 	// The following code was originally in DGen until at least DGen v1.21
 	// (Win32 version) but wasn't in DGen/SDL v1.23, preventing 6-button
 	// emulation from working at all until now (v1.31 included).
 	// This broke some games (no input at all).
 
+	if (line > lines)
+		line = lines;
+	if (line <= pad_line)
+		return;
+	n = (line - pad_line);
+	pad_line = line;
 	// Reset 6-button pad toggle after 26? lines
-	if (aoo3_six_timeout > 25)
+	if ((aoo3_six_timeout + n) > 26) {
 		aoo3_six = 0;
+		aoo3_six_timeout = 26;
+	}
 	else
-		++aoo3_six_timeout;
-	if (aoo5_six_timeout > 25)
+		aoo3_six_timeout += n;
+	if ((aoo5_six_timeout + n) > 26) {
 		aoo5_six = 0;
+		aoo5_six_timeout = 26;
+	}
 	else
-		++aoo5_six_timeout;
+		aoo5_six_timeout += n;
+}
+
+/**
+ * Schedule a frame event.
+ * @param ev Event to schedule, replaces any previous occurrence.
+ * @param when M68K cycles since the beginning of the frame.
+ */
+void md::event_schedule(enum md_event ev, int when)
+{
+	event_time[ev] = when;
+}
+
+/**
+ * Find when the next event is due.
+ * @return M68K cycles since the beginning of the frame.
+ */
+int md::event_next()
+{
+	int when = INT_MAX;
+	unsigned int i;
+
+	for (i = 0; (i != MD_EV_NUM); ++i)
+		if (event_time[i] < when)
+			when = event_time[i];
+	return when;
 }
 
-// Generate one frame
 int md::one_frame(struct bmap *bm, unsigned char retpal[256],
 		  struct sndinfo *sndi)
 {
-	int hints;
-	int m68k_max, z80_max;
 	unsigned int vblank = md::vblank();
+	unsigned int line, next;
+	unsigned int i;
+	int now;
 
 #ifdef WITH_DEBUGGER
 	if (debug_trap)
@@ -968,11 +1540,29 @@ int md::one_frame(struct bmap *bm, unsigned char retpal[256],
 		memset(bm->data, 0, (bm->pitch * bm->h));
 #endif
 	md_set(1);
+	// DMA may go on during the next frame, so may the M68K freeze it
+	// caused.
+	i = (lines * M68K_CYCLES_PER_LINE);
+	now = 0;
+	if (dma_end > (int)i) {
+		dma_end -= i;
+		if (odo.m68k > (int)i)
+			now = (odo.m68k - i);
+		if (now > dma_end)
+			now = dma_end;
+	}
+	else
+		dma_end = 0;
 	// Reset odometers
 	memset(&odo, 0, sizeof(odo));
+	odo.m68k = now;
 	// Reset FM tickers
 	fm_ticker[1] = 0;
 	fm_ticker[3] = 0;
+	// FM output is generated as registers are written
+	fm_start((sndi != NULL) ? sndi->len : 0);
+	sound_len = ((sndi != NULL) ? sndi->len : 0);
+	pad_line = 0;
 	// Raster zero causes special things to happen :)
 	// Init status register with fifo always empty (FIXME)
 	coo4 = (0x34 | 0x02); // 00110100b | 00000010b
@@ -984,125 +1574,114 @@ int md::one_frame(struct bmap *bm, unsigned char retpal[256],
 	coo5 &= ~0x40;
 	// Clear sprite collision bit (d5).
 	coo5 &= ~0x20;
-	// Is permanently set
-	hints = vdp.reg[10]; // Set hint counter
 	// Reset sprite overflow line
 	vdp.sprite_overflow_line = INT_MIN;
-	// Video display! :D
-	for (ras = 0; ((unsigned int)ras < vblank); ++ras) {
-		pad_update(); // Update 6-button pads
-		fm_timer_callback(); // Update sound timers
-		if (--hints < 0) {
-			// Trigger hint
-			hints = vdp.reg[10];
-			vdp.hint_pending = true;
-			m68k_vdp_irq_trigger();
-			may_want_to_get_pic(bm, retpal, 1);
+	// CPUs only stop for events. H-blank, FM timers, 6-button pads and
+	// the DMA busy flag are computed on demand, lines only matter when
+	// drawn or when the H-blank counter (reloaded at frame start) expires.
+	// Sprite status bits of frames that aren't drawn are caught up with
+	// when the VDP is accessed, see pic_catch_up().
+	for (i = 0; (i != MD_EV_NUM); ++i)
+		event_time[i] = INT_MAX;
+	if ((unsigned int)vdp.reg[10] <= vblank)
+		event_schedule(MD_EV_HINT,
+			       (vdp.reg[10] * M68K_CYCLES_PER_LINE));
+	if (bm != NULL) {
+		// (Re)start render threads when their number changes.
+		if ((vdp_render != NULL) &&
+		    (vdp_render->threads() != (unsigned int)dgen_render_threads)) {
+			delete vdp_render;
+			vdp_render = NULL;
 		}
-		else
-			may_want_to_get_pic(bm, retpal, 0);
-		// Enable h-blank
-		coo5 |= 0x04;
-		// H-blank comes before, about 36/209 of the whole scanline
-		m68k_max = (odo.m68k_max + M68K_CYCLES_PER_LINE);
-		odo.m68k_max += M68K_CYCLES_HBLANK;
-		z80_max = (odo.z80_max + Z80_CYCLES_PER_LINE);
-		odo.z80_max += Z80_CYCLES_HBLANK;
-		m68k_run();
-		z80_run();
-		// Disable h-blank
-		coo5 &= ~0x04;
-		// Do hdisplay now
-		odo.m68k_max = m68k_max;
-		odo.z80_max = z80_max;
-		m68k_run();
-		z80_run();
+		if ((vdp_render == NULL) && (dgen_render_threads > 0))
+			vdp_render = new md_vdp_render(*this,
+						       dgen_render_threads);
+		if (vdp_render != NULL)
+			vdp_render->frame_start(bm);
 	}
-	// Now we're in vblank, more special things happen :)
+	pic_line = 0;
+	pic_skip = (bm == NULL);
+	if ((bm != NULL) || (retpal != NULL))
+		event_schedule(MD_EV_LINE, 0);
 	// The following was roughly adapted from Genplus GX
-	// Enable v-blank
-	coo5 |= 0x08;
-	if (--hints < 0) {
-		// Trigger hint
-		vdp.hint_pending = true;
-		m68k_vdp_irq_trigger();
-	}
-	// Save m68k_max and z80_max
-	m68k_max = (odo.m68k_max + M68K_CYCLES_PER_LINE);
-	z80_max = (odo.z80_max + Z80_CYCLES_PER_LINE);
-	// Delay between vint and vint flag
-	odo.m68k_max += M68K_CYCLES_HBLANK;
-	odo.z80_max += Z80_CYCLES_HBLANK;
-	// Enable h-blank
-	coo5 |= 0x04;
-	m68k_run();
-	z80_run();
-	// Disable h-blank
-	coo5 &= ~0x04;
-	// Toggle vint flag
-	coo5 |= 0x80;
+	now = (vblank * M68K_CYCLES_PER_LINE);
+	event_schedule(MD_EV_VBLANK, now);
+	// Delay between v-blank and vint flag
+	event_schedule(MD_EV_VINT_FLAG, (now + M68K_CYCLES_HBLANK));
 	// Delay between v-blank and vint
-	odo.m68k_max += (M68K_CYCLES_VDELAY - M68K_CYCLES_HBLANK);
-	odo.z80_max += (Z80_CYCLES_VDELAY - Z80_CYCLES_HBLANK);
-	m68k_run();
-	z80_run();
-	// Restore m68k_max and z80_max
-	odo.m68k_max = m68k_max;
-	odo.z80_max = z80_max;
-	// Blank everything and trigger vint
-	vdp.vint_pending = true;
-	m68k_vdp_irq_trigger();
-	if (!z80_st_reset)
-		z80_irq(0);
-	fm_timer_callback();
-	// Run remaining cycles
-	m68k_run();
-	z80_run();
-	++ras;
-	// Run the course of vblank
-	pad_update();
-	fm_timer_callback();
-	// Usual h-blank stuff
-	coo5 |= 0x04;
-	m68k_max = (odo.m68k_max + M68K_CYCLES_PER_LINE);
-	odo.m68k_max += M68K_CYCLES_HBLANK;
-	z80_max = (odo.z80_max + Z80_CYCLES_PER_LINE);
-	odo.z80_max += Z80_CYCLES_HBLANK;
-	m68k_run();
-	z80_run();
-	coo5 &= ~0x04;
-	odo.m68k_max = m68k_max;
-	odo.z80_max = z80_max;
-	m68k_run();
-	z80_run();
-	// Clear Z80 interrupt
-	if (z80_st_irq)
-		z80_irq_clear();
-	++ras;
-	// Remaining lines
-	while ((unsigned int)ras < lines) {
-		pad_update();
-		fm_timer_callback();
-		// Enable h-blank
-		coo5 |= 0x04;
-		m68k_max = (odo.m68k_max + M68K_CYCLES_PER_LINE);
-		odo.m68k_max += M68K_CYCLES_HBLANK;
-		z80_max = (odo.z80_max + Z80_CYCLES_PER_LINE);
-		odo.z80_max += Z80_CYCLES_HBLANK;
+	event_schedule(MD_EV_VINT, (now + M68K_CYCLES_VDELAY));
+	// Z80 interrupt lasts until the end of the next line
+	event_schedule(MD_EV_Z80_IRQ_CLEAR,
+		       (now + (2 * M68K_CYCLES_PER_LINE)));
+	event_schedule(MD_EV_FRAME_END, (lines * M68K_CYCLES_PER_LINE));
+	do {
+		now = event_next();
+		odo.m68k_max = now;
+		odo.z80_max = ((now * Z80_CYCLES_PER_LINE) /
+			       M68K_CYCLES_PER_LINE);
 		m68k_run();
 		z80_run();
-		// Disable h-blank
-		coo5 &= ~0x04;
-		odo.m68k_max = m68k_max;
-		odo.z80_max = z80_max;
-		m68k_run();
-		z80_run();
-		++ras;
+		ras = (now / M68K_CYCLES_PER_LINE);
+		line = ras;
+		for (i = 0; (i != MD_EV_NUM); ++i) {
+			if (event_time[i] != now)
+				continue;
+			event_time[i] = INT_MAX;
+			switch (i) {
+			case MD_EV_VBLANK:
+				// Enable v-blank
+				coo5 |= 0x08;
+				// Go through the lines left, or wait for render
+				// threads which only report sprite collisions at
+				// this point.
+				pic_catch_up();
+				if ((bm != NULL) && (vdp_render != NULL))
+					coo5 |= vdp_render->frame_end(vdp);
+				break;
+			case MD_EV_HINT:
+				// Trigger hint
+				vdp.hint_pending = true;
+				m68k_vdp_irq_trigger();
+				// Reload counter, it stops during v-blank
+				next = (line + vdp.reg[10] + 1);
+				if (next <= vblank)
+					event_schedule(MD_EV_HINT,
+						       (next *
+							M68K_CYCLES_PER_LINE));
+				break;
+			case MD_EV_LINE:
+				may_want_to_get_pic(bm, retpal, 0);
+				if ((line + 1) < vblank)
+					event_schedule(MD_EV_LINE,
+						       (now +
+							M68K_CYCLES_PER_LINE));
+				break;
+			case MD_EV_VINT_FLAG:
+				// Toggle vint flag
+				coo5 |= 0x80;
+				break;
+			case MD_EV_VINT:
+				// Blank everything and trigger vint
+				vdp.vint_pending = true;
+				m68k_vdp_irq_trigger();
+				if (!z80_st_reset)
+					z80_irq(0);
+				break;
+			case MD_EV_Z80_IRQ_CLEAR:
+				// Clear Z80 interrupt
+				if (z80_st_irq)
+					z80_irq_clear();
+				break;
+			}
+		}
 	}
+	while (now != (int)(lines * M68K_CYCLES_PER_LINE));
+	pic_skip = false;
 	// Fill the sound buffers
 	if (sndi)
 		may_want_to_get_sound(sndi);
 	fm_timer_callback();
+	pad_update();
 	md_set(0);
 #ifdef WITH_VGMDUMP
 	vgm_dump_frame();
@@ -1110,21 +1689,99 @@ int md::one_frame(struct bmap *bm, unsigned char retpal[256],
 	return 0;
 }
 
+// Return VDP status low byte (Gens/GS style)
+uint8_t md::calculate_coo5()
+{
+	int id = m68k_odo();
+	uint8_t ret;
+
+	pic_catch_up();
+	ret = coo5;
+
+	// H-blank comes before, about 36/209 of the whole scanline
+	if ((id % M68K_CYCLES_PER_LINE) < M68K_CYCLES_HBLANK)
+		ret |= 0x04;
+	// DMA busy
+	if (id < dma_end)
+		ret |= 0x02;
+	return ret;
+}
+
+/**
+ * Compute how long a DMA transfer started now lasts.
+ * The VDP only gives DMA a few access slots per line during active display
+ * and most of them during blanking.
+ * @param slots Number of access slots needed by the transfer.
+ * @return Duration in M68K cycles.
+ */
+int md::dma_cycles(unsigned int slots)
+{
+	// Access slots per line (H32, H40), from Charles MacDonald's docs.
+	static const unsigned int rate[2][2] = {
+		{ 16, 18 }, // active display
+		{ 167, 205 } // blanking or display disabled
+	};
+	unsigned int vblank = md::vblank();
+	unsigned int h40 = !!(vdp.reg[12] & 0x01);
+	int start = m68k_odo();
+	int now = start;
+
+	while (slots) {
+		unsigned int line = ((now / M68K_CYCLES_PER_LINE) % lines);
+		unsigned int left = (M68K_CYCLES_PER_LINE -
+				     (now % M68K_CYCLES_PER_LINE));
+		unsigned int blank = ((line >= vblank) ||
+				      (!(vdp.reg[1] & 0x40)));
+		unsigned int r = rate[blank][h40];
+		unsigned int n = ((left * r) / M68K_CYCLES_PER_LINE);
+
+		if (slots <= n) {
+			now += (((slots * M68K_CYCLES_PER_LINE) + (r - 1)) / r);
+			break;
+		}
+		slots -= n;
+		now += left;
+	}
+	return (now - start);
+}
+
+/**
+ * Start timing a DMA transfer, called by the VDP once it is done.
+ * Data is transferred immediately, only the status flag and the M68K
+ * see how long it takes.
+ * @param slots Number of access slots used by the transfer.
+ * @param freeze True when the transfer reads from the M68K bus.
+ */
+void md::dma_start(unsigned int slots, bool freeze)
+{
+	int cycles;
+
+	if (!dgen_dma_timing)
+		return;
+	cycles = dma_cycles(slots);
+	dma_end = (m68k_odo() + cycles);
+	if (freeze)
+		m68k_freeze(cycles);
+}
+
 // Return V counter (Gens/GS style)
 uint8_t md::calculate_coo8()
 {
 	unsigned int id;
 	unsigned int hc, vc;
+	unsigned int line;
 	uint8_t bl, bh;
 
 	id = m68k_odo();
+	// Slices may span several lines, ras isn't necessarily current.
+	line = (id / M68K_CYCLES_PER_LINE);
 	/*
 	  FIXME
-	  Using "(ras - 1)" instead of "ras" here seems to solve horizon
+	  Using "(line - 1)" instead of "line" here seems to solve horizon
 	  issues in Road Rash and Mickey Mania (Moose Chase level).
 	*/
-	if (ras)
-		id -= ((ras - 1) * M68K_CYCLES_PER_LINE);
+	if (line)
+		id -= ((line - 1) * M68K_CYCLES_PER_LINE);
 	id &= 0x1ff;
 	if (vdp.reg[4] & 0x81) {
 		hc = hc_table[id][1];
@@ -1137,7 +1794,7 @@ uint8_t md::calculate_coo8()
 	bh = (hc <= 0xe0);
 	bl = (hc >= bl);
 	bl &= bh;
-	vc = ras;
+	vc = line;
 	vc += (bl != 0);
 	if (pal) {
 		if (vc >= 0x103)
@@ -1154,10 +1811,12 @@ uint8_t md::calculate_coo8()
 uint8_t md::calculate_coo9()
 {
 	unsigned int id;
+	unsigned int line;
 
 	id = m68k_odo();
-	if (ras)
-		id -= ((ras - 1) * M68K_CYCLES_PER_LINE);
+	line = (id / M68K_CYCLES_PER_LINE);
+	if (line)
+		id -= ((line - 1) * M68K_CYCLES_PER_LINE);
 	id &= 0x1ff;
 	if (vdp.reg[4] & 0x81)
 		return hc_table[id][1];
@@ -1170,51 +1829,81 @@ uint8_t md::calculate_coo9()
 
 inline int md::may_want_to_get_pic(struct bmap *bm,unsigned char retpal[256],int/*mark*/)
 {
-  if (bm==NULL) return 0;
-
-  if (ras>=0 && (unsigned int)ras<vblank())
-    vdp.draw_scanline(bm, ras);
+  if (bm!=NULL && ras>=0 && (unsigned int)ras<vblank())
+    {
+      // Sprites must be prepared for every line, even unchanged ones
+      vdp.skip_scanline(ras);
+      if (vdp.scanline_changed(bm, ras))
+	{
+	  // Render threads draw it later
+	  if (vdp_render != NULL)
+	    vdp_render->line(vdp, ras);
+	  else
+	    vdp.render_scanline(bm, ras);
+	}
+      coo5 |= vdp.status;
+      vdp.status = 0;
+    }
   if(retpal && ras == 100) get_md_palette(retpal, vdp.cram);
   return 0;
 }
 
-int md::may_want_to_get_sound(struct sndinfo *sndi)
+/**
+ * Go through the lines the M68K has reached in a frame that isn't drawn,
+ * for the sprite overflow and collision bits. Lines of drawn frames are
+ * gone through by may_want_to_get_pic() instead.
+ */
+void md::pic_catch_up()
 {
-  extern intptr_t dgen_volume;
-  unsigned int i, len = sndi->len;
+	unsigned int vblank;
+	unsigned int line;
 
-  // Get the PSG
-  SN76496Update_16_2(0, sndi->lr, len);
-
-	if (dac_len) {
-		unsigned int ratio = ((sndi->len << 10) / elemof(dac_data));
-
-		// Stretch the DAC to fit the real length.
-		for (i = 0; (i != sndi->len); ++i) {
-			unsigned int index = ((i << 10) / ratio);
-			uint16_t data;
-
-			if (index >= dac_len)
-				data = dac_data[dac_len - 1];
-			else
-				data = dac_data[index];
-			data = ((data - 0x80) << 6);
-			sndi->lr[i << 1] += data;
-			sndi->lr[(i << 1) ^ 1] += data;
-		}
-		// Clear the DAC for next frame.
-		dac_len = 0;
-#ifndef NDEBUG
-		memset(dac_data, 0xff, sizeof(dac_data));
-#endif
+	if (!pic_skip)
+		return;
+	vblank = md::vblank();
+	line = frame_line();
+	if (line >= vblank)
+		line = (vblank - 1);
+	for (; (pic_line <= line); ++pic_line) {
+		// Sprites must be prepared for every line
+		vdp.skip_scanline(pic_line);
+		// Skipped frames still raise the sprite collision bit, which
+		// stays set until the next frame
+		if (!(coo5 & 0x20))
+			vdp.collide_scanline(pic_line);
+		coo5 |= vdp.status;
+		vdp.status = 0;
 	}
+}
 
-  // Add in the stereo FM buffer
-  YM2612UpdateOne(0, sndi->lr, len, dgen_volume, 1);
-  if (dgen_mjazz) {
-    YM2612UpdateOne(1, sndi->lr, len, dgen_volume, 0);
-    YM2612UpdateOne(2, sndi->lr, len, dgen_volume, 0);
+int md::may_want_to_get_sound(struct sndinfo *sndi)
+{
+  extern intptr_t dgen_volume;
+  unsigned int len = sndi->len;
+
+  // Get the PSG, finishing what register writes left
+  SN76496Update_16_2(&ctx_sn76496, sndi->lr, len);
+  // Then the DAC, as written along the frame
+  dac_mix(sndi->lr, len);
+  sound_len = 0;
+
+  // Add in the stereo FM buffer, finishing what register writes left
+  if (fm_max == len) {
+    fm_generate(len);
+    YM2612Mix(sndi->lr, &fm_data[0], len, dgen_volume, 1);
+    if (fm_chips == 3) {
+      YM2612Mix(sndi->lr, &fm_data[(len * 2)], len, dgen_volume, 0);
+      YM2612Mix(sndi->lr, &fm_data[(len * 4)], len, dgen_volume, 0);
+    }
+  }
+  else {
+    YM2612UpdateOne(ctx_ym2612, 0, sndi->lr, len, dgen_volume, 1);
+    if (dgen_mjazz) {
+      YM2612UpdateOne(ctx_ym2612, 1, sndi->lr, len, dgen_volume, 0);
+      YM2612UpdateOne(ctx_ym2612, 2, sndi->lr, len, dgen_volume, 0);
+    }
   }
+  fm_max = 0;
   return 0;
 }
 
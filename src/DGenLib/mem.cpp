@@ -7,6 +7,16 @@
 #include <assert.h>
 #include "md.h"
 #include "mem.h"
+#include "system.h"
+
+#ifdef WITH_DEBUGGER
+// Watchpoint checks on accesses made by CPU cores.
+#define M68K_WP(md, a, type) (md)->debug_m68k_wp_access((a), (type))
+#define Z80_WP(md, a, type) (md)->debug_z80_wp_access((a), (type))
+#else
+#define M68K_WP(md, a, type) (void)0
+#define Z80_WP(md, a, type) (void)0
+#endif
 
 /**
  * Read one byte from the memory space.
@@ -95,6 +105,59 @@ void md::z80_port_write(uint16_t a, uint8_t d)
 	(void)d;
 }
 
+/**
+ * Build the M68K memory map, one handler type per 64KB page.
+ * Must be called again whenever ROM, save RAM or Pico mode change.
+ */
+void md::m68k_page_map()
+{
+	unsigned int i;
+
+	for (i = 0; (i != elemof(m68k_page)); ++i) {
+		uint32_t a = (i << 16);
+		uint8_t type;
+
+		/* 0x000000-0x7fffff: ROM */
+		if (a <= M68K_ROM_END) {
+			if ((save_len) &&
+			    (a < (save_start + save_len)) &&
+			    ((a + 0xffff) >= save_start))
+				type = M68K_PAGE_SRAM;
+			else if (ROM_ADDR(a) < romlen)
+				type = M68K_PAGE_ROM;
+			else
+				type = M68K_PAGE_EMPTY;
+		}
+		/* 0x800000-0x9fffff: empty area */
+		else if (a <= M68K_EMPTY1_END) {
+#ifdef WITH_PICO
+			/* 0x800000-0x80001f: Sega Pico I/O area */
+			if ((pico_enabled) && (a == M68K_EMPTY1_START))
+				type = M68K_PAGE_PICO;
+			else
+#endif
+			type = M68K_PAGE_EMPTY;
+		}
+		/* 0xa00000-0xa0ffff: Z80 */
+		else if (a == M68K_IO_START)
+			type = M68K_PAGE_Z80;
+		/* 0xa10000-0xafffff: system I/O and control */
+		else if (a <= M68K_IO_END)
+			type = M68K_PAGE_IO;
+		/* 0xb00000-0xbfffff: empty area */
+		else if (a <= M68K_EMPTY2_END)
+			type = M68K_PAGE_EMPTY;
+		/* 0xc00000-0xdfffff: VDP/PSG */
+		else if (a <= M68K_VDP_END)
+			type = M68K_PAGE_VDP;
+		/* 0xe00000-0xfeffff: invalid addresses, mirror RAM */
+		/* 0xff0000-0xffffff: RAM */
+		else
+			type = M68K_PAGE_RAM;
+		m68k_page[i] = type;
+	}
+}
+
 uint8_t md::m68k_ROM_read(uint32_t a)
 {
 	/* save RAM */
@@ -108,14 +171,25 @@ uint8_t md::m68k_ROM_read(uint32_t a)
 	return 0;
 }
 
+uint8_t md::m68k_Z80_read(uint32_t a)
+{
+#ifdef WITH_PICO
+	/* Sega Pico empty area */
+	if (pico_enabled)
+		return 0;
+#endif
+	if ((!z80_st_busreq) && (a < 0xa04000))
+		return 0;
+	return z80_read(a & 0xffff);
+}
+
 uint8_t md::m68k_IO_read(uint32_t a)
 {
-	/* Z80 */
-	if (a < 0xa10000) {
-		if ((!z80_st_busreq) && (a < 0xa04000))
-			return 0;
-		return z80_read(a & 0xffff);
-	}
+#ifdef WITH_PICO
+	/* Sega Pico empty area */
+	if (pico_enabled)
+		return 0;
+#endif
 	/* version */
 	if (a == 0xa10000)
 		return 0;
@@ -135,6 +209,7 @@ uint8_t md::m68k_IO_read(uint32_t a)
 	if (a == 0xa10002)
 		return 0;
 	if (a == 0xa10003) {
+		pad_update();
 		if (aoo3_six == 3) {
 			/* extended pad info */
 			if (aoo3_toggle == 0)
@@ -155,6 +230,7 @@ uint8_t md::m68k_IO_read(uint32_t a)
 	if (a == 0xa10004)
 		return 0;
 	if (a == 0xa10005) {
+		pad_update();
 		if (aoo5_six == 3) {
 			/* extended pad info */
 			if (aoo5_toggle == 0)
@@ -220,7 +296,7 @@ uint8_t md::m68k_VDP_read(uint32_t a)
 		vdp.cmd_pending = false;
 		if ((a & 0x01) == 0)
 			return coo4;
-		return coo5;
+		return calculate_coo5();
 	}
 	/* HV counters */
 	if (a == 0xc00008)
@@ -241,16 +317,25 @@ uint8_t md::misc_readbyte(uint32_t a)
 {
 	/* clip to 24-bit */
 	a &= 0x00ffffff;
-	/* 0x000000-0x7fffff: ROM */
-	if (a <= M68K_ROM_END) {
+	switch (m68k_page[(a >> 16)]) {
+	case M68K_PAGE_ROM:
+		if (ROM_ADDR(a) < romlen)
+			return rom[ROM_ADDR(a)];
+		return 0;
+	case M68K_PAGE_SRAM:
 		return m68k_ROM_read(a);
-	}
+	case M68K_PAGE_Z80:
+		return m68k_Z80_read(a);
+	case M68K_PAGE_IO:
+		return m68k_IO_read(a);
+	case M68K_PAGE_VDP:
+		return m68k_VDP_read(a);
+	case M68K_PAGE_RAM:
+		return ram[((a ^ 1) & 0xffff)];
 #ifdef WITH_PICO
-	/* 0x800000-0x80001f: Sega Pico I/O area */
-	if ((pico_enabled) &&
-	    ((a >= 0x800000) && (a <= 0x80001f))) {
-		a &= 0x1f;
-		switch(a) {
+	case M68K_PAGE_PICO:
+		/* 0x800000-0x80001f: Sega Pico I/O area */
+		switch (a & 0xffff) {
 		case 1: // Version register
 			switch (region) {
 			case 'J': // Japan
@@ -272,34 +357,46 @@ uint8_t md::misc_readbyte(uint32_t a)
 		case 0xB: // LSB of Y coordinate for pen
 			return pico_pen_coords[1] & 0xff;
 		}
-	}
-	/* 0x800020-0xafffff: Sega Pico empty area */
-	if ((pico_enabled) &&
-	    (a <= M68K_IO_END))
 		return 0;
 #endif
-	/* 0x800000-0x9fffff: empty area */
-	if (a <= M68K_EMPTY1_END) {
-		/*
-		 * http://cgfm2.emuviews.com/txt/gen-hw.txt
-		 * see section 1 point 3 for what these addresses do.
-		 */
-		return 0;
-	}
-	/* 0xa00000-0xafffff: system I/O and control */
-	if (a <= M68K_IO_END) {
-		return m68k_IO_read(a);
 	}
-	/* 0xb00000-0xbfffff: empty area */
-	if (a <= M68K_EMPTY2_END)
-		return 0;
-	/* 0xc00000-0xdfffff: VDP/PSG */
-	if (a <= M68K_VDP_END) {
-		return m68k_VDP_read(a);
+	/*
+	 * Empty areas.
+	 * http://cgfm2.emuviews.com/txt/gen-hw.txt
+	 * see section 1 point 3 for what these addresses do.
+	 */
+	return 0;
+}
+
+/**
+ * Find memory DMA can read directly, without going through misc_readbyte().
+ * @param a Even address to read from.
+ * @param[out] len Number of bytes that can be read from there.
+ * @param[out] swap Value to XOR byte offsets with, for memory stored
+ * byteswapped.
+ * @return Pointer to the byte at a before swapping, NULL if it must be read
+ * through misc_readbyte().
+ */
+const uint8_t *md::dma_source(uint32_t a, unsigned int *len,
+			      unsigned int *swap)
+{
+	/* clip to 24-bit */
+	a &= 0x00ffffff;
+	/* don't cross 64KB pages, they may be mapped differently */
+	*len = (0x10000 - (a & 0xffff));
+	switch (m68k_page[(a >> 16)]) {
+	case M68K_PAGE_ROM:
+		if ((a + 2) > romlen)
+			return NULL;
+		if (*len > (romlen - a))
+			*len = ((romlen - a) & ~1);
+		*swap = ROM_ADDR(0);
+		return &rom[a];
+	case M68K_PAGE_RAM:
+		*swap = 1;
+		return &ram[(a & 0xffff)];
 	}
-	/* 0xe00000-0xfeffff: invalid addresses, mirror RAM */
-	/* 0xff0000-0xffffff: RAM */
-	return ram[((a ^ 1) & 0xffff)];
+	return NULL;
 }
 
 void md::m68k_ROM_write(uint32_t a, uint8_t d)
@@ -310,20 +407,30 @@ void md::m68k_ROM_write(uint32_t a, uint8_t d)
 		saveram[((a ^ 1) - save_start)] = d;
 #ifdef WITH_DEBUGGER
 	/* Allow debugger to write to the ROM. */
-	if ((debug_trap) && (ROM_ADDR(a) < romlen))
+	if ((debug_trap) && (ROM_ADDR(a) < romlen)) {
 		rom[ROM_ADDR(a)] = d;
+#ifdef WITH_MUSA
+		m68k_decode_cache_invalidate(ctx_musa_dcache, a);
+		m68k_jit_flush(ctx_musa_jit);
+#endif
+	}
 #endif
 }
 
-void md::m68k_IO_write(uint32_t a, uint8_t d)
+void md::m68k_Z80_write(uint32_t a, uint8_t d)
 {
-	/* Z80 */
-	if (a < 0xa10000) {
-		if ((!z80_st_busreq) && (a < 0xa04000))
-			return;
-		z80_write((a & 0xffff), d);
+	if ((!z80_st_busreq) && (a < 0xa04000))
 		return;
-	}
+	// The Z80 runs after the M68K in each slice. Let it catch up before
+	// the YM2612 is written, so that writes from both are played in order.
+	if ((a >= 0xa04000) && (a < 0xa06000) &&
+	    (!z80_st_busreq) && (!z80_st_reset))
+		z80_sync(0);
+	z80_write((a & 0xffff), d);
+}
+
+void md::m68k_IO_write(uint32_t a, uint8_t d)
+{
 	/* ctrl 1 */
 	if (a == 0xa10009)
 	{
@@ -349,8 +456,13 @@ void md::m68k_IO_write(uint32_t a, uint8_t d)
 	/* Z80 RESET */
 	if (a == 0xa11200) {
 		/* cancel RESET state if nonzero */
-		if (d)
+		if (d) {
+			// Don't run what was held until now, see
+			// m68k_busreq_cancel().
+			if ((z80_st_reset) && (z80_st_busreq == 0))
+				z80_sync(1);
 			z80_st_reset = 0;
+		}
 		else if (z80_st_reset == 0) {
 			if (z80_st_busreq == 0)
 				z80_sync(0);
@@ -365,6 +477,7 @@ void md::m68k_IO_write(uint32_t a, uint8_t d)
 	/* I/O port access */
 	if (a < 0xa1000d) {
 		if (a == 0xa10003) {
+			pad_update();
 			if ((aoo3_six >= 0) && ((d & 0x40) == 0) &&
 			    (aoo3_toggle))
 				++aoo3_six;
@@ -379,6 +492,7 @@ void md::m68k_IO_write(uint32_t a, uint8_t d)
 			return;
 		}
 		if (a == 0xa10005) {
+			pad_update();
 			if ((aoo5_six >= 0) && ((d & 0x40) == 0) &&
 			    (aoo5_toggle))
 				++aoo5_six;
@@ -416,24 +530,18 @@ void md::misc_writebyte(uint32_t a, uint8_t d)
 {
 	/* clip to 24-bit */
 	a &= 0x00ffffff;
-	/* 0x000000-0x7fffff: ROM */
-	if (a <= M68K_ROM_END) {
+	switch (m68k_page[(a >> 16)]) {
+	case M68K_PAGE_ROM:
+	case M68K_PAGE_SRAM:
 		m68k_ROM_write(a, d);
 		return;
-	}
-	/* 0x800000-0x9fffff: empty area */
-	if (a <= M68K_EMPTY1_END)
+	case M68K_PAGE_Z80:
+		m68k_Z80_write(a, d);
 		return;
-	/* 0xa00000-0xafffff: system I/O and control */
-	if (a <= M68K_IO_END) {
+	case M68K_PAGE_IO:
 		m68k_IO_write(a, d);
 		return;
-	}
-	/* 0xb00000-0xbfffff: empty area */
-	if (a <= M68K_EMPTY2_END)
-		return;
-	/* 0xc00000-0xdfffff: VDP/PSG */
-	if (a < M68K_VDP_END) {
+	case M68K_PAGE_VDP:
 		a &= 0xe700ff;
 		if (a < 0xc00008) {
 			misc_writeword(a, (d | (d << 8)));
@@ -443,10 +551,14 @@ void md::misc_writebyte(uint32_t a, uint8_t d)
 		if (a == 0xc00011)
 			mysn_write(d);
 		return;
+	case M68K_PAGE_RAM:
+		ram[((a ^ 1) & 0xffff)] = d;
+#ifdef WITH_MUSA
+		m68k_decode_cache_invalidate(ctx_musa_dcache, a);
+#endif
+		return;
 	}
-	/* 0xe00000-0xfeffff: invalid addresses, mirror RAM */
-	/* 0xff0000-0xffffff: RAM */
-	ram[((a ^ 1) & 0xffff)] = d;
+	/* empty areas */
 }
 
 
@@ -462,14 +574,21 @@ uint16_t md::misc_readword(uint32_t a)
 	uint16_t ret;
 
 	a &= 0x00ffffff;
-	/* BUSREQ */
-	if ((a & 0xffff00) == 0xa11100)
-		return ((!z80_st_busreq << 8) | (m68k_read_pc() & 0xfeff));
-	/* RESET */
-	if ((a & 0xffff00) == 0xa11200)
-		return m68k_read_pc();
-	/* VDP */
-	if ((a >= 0xc00000) && (a < 0xe00000)) {
+	switch (m68k_page[(a >> 16)]) {
+	case M68K_PAGE_RAM:
+		if (a & 0x01)
+			break;
+		return ((ram[((a ^ 1) & 0xffff)] << 8) | ram[(a & 0xffff)]);
+	case M68K_PAGE_IO:
+		/* BUSREQ */
+		if ((a & 0xffff00) == 0xa11100)
+			return ((!z80_st_busreq << 8) |
+				(m68k_read_pc() & 0xfeff));
+		/* RESET */
+		if ((a & 0xffff00) == 0xa11200)
+			return m68k_read_pc();
+		break;
+	case M68K_PAGE_VDP:
 		a &= 0xe700ff;
 		if (a < 0xc00004) {
 			if (a & 0x01)
@@ -480,7 +599,8 @@ uint16_t md::misc_readword(uint32_t a)
 		if (a < 0xc00008) {
 			if (a & 0x01)
 				return 0;
-			return (((coo4 & 0xff) << 8) | (coo5 & 0xff));
+			return (((coo4 & 0xff) << 8) |
+				(calculate_coo5() & 0xff));
 		}
 		if (a == 0xc00008) {
 			if (a & 0x01)
@@ -488,6 +608,7 @@ uint16_t md::misc_readword(uint32_t a)
 			return ((calculate_coo8() << 8) |
 				(calculate_coo9() & 0xff));
 		}
+		break;
 	}
 	/* else pass onto readbyte */
 	ret = (misc_readbyte(a) << 8);
@@ -503,22 +624,32 @@ uint16_t md::misc_readword(uint32_t a)
 void md::misc_writeword(uint32_t a, uint16_t d)
 {
 	a &= 0x00ffffff;
-	/* Z80 */
-	if ((a >= 0xa00000) && (a < 0xa10000)) {
-		if ((!z80_st_busreq) && (a < 0xa04000))
-			return;
-		z80_write((a & 0xffff), (d >> 8));
+	switch (m68k_page[(a >> 16)]) {
+	case M68K_PAGE_RAM:
+		if (a & 0x01)
+			break;
+		ram[((a ^ 1) & 0xffff)] = (d >> 8);
+		ram[(a & 0xffff)] = d;
+#ifdef WITH_MUSA
+		m68k_decode_cache_invalidate(ctx_musa_dcache, a);
+#endif
 		return;
-	}
-	/* BUSREQ and RESET */
-	if ((a == 0xa11100) ||
-	    (a == 0xa11200)) {
-		misc_writebyte(a, (d >> 8));
+	case M68K_PAGE_Z80:
+		m68k_Z80_write(a, (d >> 8));
 		return;
-	}
-	/* VDP */
-	if ((a >= 0xc00000) && (a < 0xe00000)) {
+	case M68K_PAGE_IO:
+		/* BUSREQ and RESET */
+		if ((a == 0xa11100) ||
+		    (a == 0xa11200)) {
+			m68k_IO_write(a, (d >> 8));
+			return;
+		}
+		break;
+	case M68K_PAGE_VDP:
 		a &= 0xe700ff;
+		// Lines not drawn must see the VDP as it was.
+		if (a < 0xc00008)
+			pic_catch_up();
 		if (a < 0xc00004) {
 			if (a & 0x01)
 				return;
@@ -545,6 +676,7 @@ void md::misc_writeword(uint32_t a, uint16_t d)
 			vdp.cmd_pending = true;
 			return;
 		}
+		break;
 	}
 	/* else pass onto writebyte */
 	misc_writebyte(a, (d >> 8));
@@ -562,57 +694,67 @@ void md::misc_writeword(uint32_t a, uint16_t d)
 /* Read from anywhere */
 extern "C" unsigned int m68k_read_memory_8(unsigned int address)
 {
+	M68K_WP(md::md_musa, address, (WP_FLAG_READ | WP_FLAG_BYTE));
 	return md::md_musa->misc_readbyte(address);
 }
 
 extern "C" unsigned int m68k_read_memory_16(unsigned int address)
 {
+	M68K_WP(md::md_musa, address, (WP_FLAG_READ | WP_FLAG_WORD));
 	return md::md_musa->misc_readword(address);
 }
 
 extern "C" unsigned int m68k_read_memory_32(unsigned int address)
 {
+	M68K_WP(md::md_musa, address, (WP_FLAG_READ | WP_FLAG_LONG));
 	return ((md::md_musa->misc_readword(address) << 16) |
 		(md::md_musa->misc_readword(address + 2) & 0xffff));
 }
 
-/* Read data immediately following the PC */
+/*
+ * Read data immediately following the PC. These are instruction fetches,
+ * not data reads, watchpoints don't see them.
+ */
 extern "C" unsigned int m68k_read_immediate_8(unsigned int address)
 {
-	return m68k_read_memory_8(address);
+	return md::md_musa->misc_readbyte(address);
 }
 
 extern "C" unsigned int m68k_read_immediate_16(unsigned int address)
 {
-	return m68k_read_memory_16(address);
+	return md::md_musa->misc_readword(address);
 }
 
 extern "C" unsigned int m68k_read_immediate_32(unsigned int address)
 {
-	return m68k_read_memory_32(address);
+	return ((md::md_musa->misc_readword(address) << 16) |
+		(md::md_musa->misc_readword(address + 2) & 0xffff));
 }
 
 /* Read an instruction (16-bit word immeditately after PC) */
 extern "C" unsigned int m68k_read_instruction(unsigned int address)
 {
-	return m68k_read_memory_16(address);
+	return m68k_read_immediate_16(address);
 }
 
 /* Write to anywhere */
 extern "C" void m68k_write_memory_8(unsigned int address, unsigned int value)
 {
 	md::md_musa->misc_writebyte(address, value);
+	M68K_WP(md::md_musa, address, (WP_FLAG_WRITE | WP_FLAG_BYTE));
 }
 
 extern "C" void m68k_write_memory_16(unsigned int address, unsigned int value)
 {
 	md::md_musa->misc_writeword(address, value);
+	M68K_WP(md::md_musa, address, (WP_FLAG_WRITE | WP_FLAG_WORD));
 }
 
 extern "C" void m68k_write_memory_32(unsigned int address, unsigned int value)
 {
 	md::md_musa->misc_writeword(address, ((value >> 16) & 0xffff));
 	md::md_musa->misc_writeword((address + 2), (value & 0xffff));
+	M68K_WP(md::md_musa, address, (WP_FLAG_WRITE | WP_FLAG_LONG));
 }
 
 #endif // WITH_MUSA
@@ -622,16 +764,19 @@ extern "C" void m68k_write_memory_32(unsigned int address, unsigned int value)
 /* Read from anywhere */
 extern "C" uint32_t cyclone_read_memory_8(uint32_t address)
 {
+	M68K_WP(md::md_cyclone, address, (WP_FLAG_READ | WP_FLAG_BYTE));
 	return md::md_cyclone->misc_readbyte(address);
 }
 
 extern "C" uint32_t cyclone_read_memory_16(uint32_t address)
 {
+	M68K_WP(md::md_cyclone, address, (WP_FLAG_READ | WP_FLAG_WORD));
 	return md::md_cyclone->misc_readword(address);
 }
 
 extern "C" uint32_t cyclone_read_memory_32(uint32_t address)
 {
+	M68K_WP(md::md_cyclone, address, (WP_FLAG_READ | WP_FLAG_LONG));
 	return ((md::md_cyclone->misc_readword(address) << 16) |
 		(md::md_cyclone->misc_readword(address + 2) & 0xffff));
 }
@@ -640,17 +785,20 @@ extern "C" uint32_t cyclone_read_memory_32(uint32_t address)
 extern "C" void cyclone_write_memory_8(uint32_t address, uint8_t value)
 {
 	md::md_cyclone->misc_writebyte(address, value);
+	M68K_WP(md::md_cyclone, address, (WP_FLAG_WRITE | WP_FLAG_BYTE));
 }
 
 extern "C" void cyclone_write_memory_16(uint32_t address, uint16_t value)
 {
 	md::md_cyclone->misc_writeword(address, value);
+	M68K_WP(md::md_cyclone, address, (WP_FLAG_WRITE | WP_FLAG_WORD));
 }
 
 extern "C" void cyclone_write_memory_32(uint32_t address, uint32_t value)
 {
 	md::md_cyclone->misc_writeword(address, ((value >> 16) & 0xffff));
 	md::md_cyclone->misc_writeword((address + 2), (value & 0xffff));
+	M68K_WP(md::md_cyclone, address, (WP_FLAG_WRITE | WP_FLAG_LONG));
 }
 
 uintptr_t md::checkpc(uintptr_t pc)
@@ -694,24 +842,28 @@ extern "C" uintptr_t cyclone_checkpc(uintptr_t pc)
 extern "C" unsigned star_readbyte(unsigned a, unsigned d)
 {
 	(void)d;
+	M68K_WP(md::md_star, a, (WP_FLAG_READ | WP_FLAG_BYTE));
 	return md::md_star->misc_readbyte(a);
 }
 
 extern "C" unsigned star_readword(unsigned a, unsigned d)
 {
 	(void)d;
+	M68K_WP(md::md_star, a, (WP_FLAG_READ | WP_FLAG_WORD));
 	return md::md_star->misc_readword(a);
 }
 
 extern "C" unsigned star_writebyte(unsigned a, unsigned d)
 {
 	md::md_star->misc_writebyte(a, d);
+	M68K_WP(md::md_star, a, (WP_FLAG_WRITE | WP_FLAG_BYTE));
 	return 0;
 }
 
 extern "C" unsigned star_writeword(unsigned a, unsigned d)
 {
 	md::md_star->misc_writeword(a, d);
+	M68K_WP(md::md_star, a, (WP_FLAG_WRITE | WP_FLAG_WORD));
 	return 0;
 }
 
@@ -735,6 +887,7 @@ extern "C" unsigned star_writeword(unsigned a, unsigned d)
 extern "C" UINT8 mz80_read(UINT32 a, struct MemoryReadByte *unused)
 {
 	(void)unused;
+	Z80_WP(md::md_mz80, a, (WP_FLAG_READ | WP_FLAG_BYTE));
 	return md::md_mz80->z80_read(MZ80_NOSIBCALL(UINT32, a));
 }
 
@@ -742,6 +895,7 @@ extern "C" void mz80_write(UINT32 a, UINT8 d, struct MemoryWriteByte *unused)
 {
 	(void)unused;
 	md::md_mz80->z80_write(MZ80_NOSIBCALL(UINT32, a), d);
+	Z80_WP(md::md_mz80, a, (WP_FLAG_WRITE | WP_FLAG_BYTE));
 }
 
 extern "C" UINT16 mz80_ioread(UINT16 a, struct z80PortRead *unused)
@@ -764,6 +918,7 @@ extern "C" uint8_t cz80_memread(void *ctx, uint16_t a)
 {
 	class md* md = (class md*)ctx;
 
+	Z80_WP(md, a, (WP_FLAG_READ | WP_FLAG_BYTE));
 	return md->z80_read(a);
 }
 
@@ -772,12 +927,14 @@ extern "C" void cz80_memwrite(void *ctx, uint16_t a, uint8_t d)
 	class md* md = (class md*)ctx;
 
 	md->z80_write(a, d);
+	Z80_WP(md, a, (WP_FLAG_WRITE | WP_FLAG_BYTE));
 }
 
 extern "C" uint16_t cz80_memread16(void *ctx, uint16_t a)
 {
 	class md* md = (class md*)ctx;
 
+	Z80_WP(md, a, (WP_FLAG_READ | WP_FLAG_WORD));
 	return ((uint16_t)md->z80_read(a) |
 		((uint16_t)md->z80_read(a + 1) << 8));
 }
@@ -788,6 +945,7 @@ extern "C" void cz80_memwrite16(void *ctx, uint16_t a, uint16_t d)
 
 	md->z80_write(a, (uint8_t)d);
 	md->z80_write((a + 1), (uint8_t)(d >> 8));
+	Z80_WP(md, a, (WP_FLAG_WRITE | WP_FLAG_WORD));
 }
 
 extern "C" uint8_t cz80_ioread(void *ctx, uint16_t a)
@@ -834,11 +992,13 @@ uintptr_t drz80_rebasePC(uint16_t new_pc)
 
 uint8_t drz80_read8(uint16_t a)
 {
+	Z80_WP(md::md_drz80, a, (WP_FLAG_READ | WP_FLAG_BYTE));
 	return md::md_drz80->z80_read(a);
 }
 
 uint16_t drz80_read16(uint16_t a)
 {
+	Z80_WP(md::md_drz80, a, (WP_FLAG_READ | WP_FLAG_WORD));
 	return ((uint16_t)md::md_drz80->z80_read(a) |
 		((uint16_t)md::md_drz80->z80_read(a + 1) << 8));
 }
@@ -846,12 +1006,14 @@ uint16_t drz80_read16(uint16_t a)
 void drz80_write8(uint8_t d, uint16_t a)
 {
 	md::md_drz80->z80_write(a, d);
+	Z80_WP(md::md_drz80, a, (WP_FLAG_WRITE | WP_FLAG_BYTE));
 }
 
 void drz80_write16(uint16_t d, uint16_t a)
 {
 	md::md_drz80->z80_write(a, (uint8_t)d);
 	md::md_drz80->z80_write((a + 1), (uint8_t)(d >> 8));
+	Z80_WP(md::md_drz80, a, (WP_FLAG_WRITE | WP_FLAG_WORD));
 }
 
 uint8_t drz80_in(uint16_t p)
@@ -35,6 +35,18 @@
 
 /* ======================================================================== */
 
+/* Emulation state (CPU core, disassembler) is thread-local so that several
+ * CPUs may run concurrently, each in its own thread.
+ */
+#if defined(_MSC_VER)
+	#define M68K_THREAD __declspec(thread)
+#elif defined(__GNUC__)
+	#define M68K_THREAD __thread
+#else
+	#define M68K_THREAD
+#endif
+
+
 /* There are 7 levels of interrupt to the 68K.
  * A transition from < 7 to 7 will cause a non-maskable interrupt (NMI).
  */
@@ -201,10 +213,42 @@ void m68k_write_memory_32_pd(unsigned int address, unsigned int value);
  * for faster direct access without having to use the above functions.
  * See m68k_mem_t definition.
  *
+ * Regions are looked up through a page table covering the 24-bit address
+ * space (M68K_MEM_PAGES pages of 1 << M68K_MEM_PAGE_SHIFT bytes), which is
+ * rebuilt each time this function is called. The array must therefore
+ * remain valid and unchanged until the next call.
+ *
  * Enable this functionality with M68K_REGISTER_MEMORY in m68kconf.h.
  */
+#define M68K_MEM_PAGE_SHIFT 16
+#define M68K_MEM_PAGES (0x1000000 >> M68K_MEM_PAGE_SHIFT)
+
 void m68k_register_memory(m68k_mem_t memory[], unsigned int len);
 
+/* Decoded instruction cache (see M68K_DECODE_CACHE in m68kconf.h).
+ * The host allocates m68k_decode_cache_size() bytes per CPU context and
+ * registers them with m68k_set_decode_cache(). Writes made to registered
+ * memory without going through the CPU must be reported with
+ * m68k_decode_cache_invalidate(), or m68k_decode_cache_flush() when a
+ * whole area is modified at once.
+ */
+unsigned int m68k_decode_cache_size(void);
+void m68k_set_decode_cache(void *cache);
+void m68k_decode_cache_flush(void *cache);
+void m68k_decode_cache_invalidate(void *cache, unsigned int address);
+
+/* Block translator (see M68K_JIT in m68kconf.h).
+ * m68k_jit_create() returns a translation cache to register with the current
+ * CPU context using m68k_set_jit(), or NULL if unsupported on this host.
+ * Only code from read-only regions is translated, everything else is
+ * interpreted. Changes made to these regions by the host must be reported
+ * with m68k_jit_flush().
+ */
+void *m68k_jit_create(void);
+void m68k_jit_destroy(void *jit);
+void m68k_jit_flush(void *jit);
+void m68k_set_jit(void *jit);
+
 
 /* ======================================================================== */
 /* ============================== CALLBACKS =============================== */
@@ -329,6 +373,11 @@ void m68k_pulse_reset(void);
 /* execute num_cycles worth of instructions.  returns number of cycles used */
 int m68k_execute(int num_cycles);
 
+/* Same as m68k_execute(), using the block translator registered with
+ * m68k_set_jit() when there is one.
+ */
+int m68k_execute_jit(int num_cycles);
+
 /* These functions let you read/write/modify the number of cycles left to run
  * while m68k_execute() is running.
  * These are useful if the 68k accesses a memory-mapped port on another device
@@ -338,6 +387,7 @@ int m68k_cycles_run(void);              /* Number of cycles run so far */
 int m68k_cycles_remaining(void);        /* Number of cycles left */
 void m68k_modify_timeslice(int cycles); /* Modify cycles left */
 void m68k_end_timeslice(void);          /* End timeslice now */
+void m68k_burn_cycles(int cycles);      /* Use cycles without executing */
 
 /* Set the IPL0-IPL2 pins on the CPU (IRQ).
  * A transition from < 7 to 7 will cause a non-maskable interrupt (NMI).
@@ -67,8 +67,10 @@
 /* If ON, the CPU will call m68k_read_immediate_xx() for immediate addressing
  * and m68k_read_pcrelative_xx() for PC-relative addressing.
  * If off, all read requests from the CPU will be redirected to m68k_read_xx()
+ * DGen only separates immediate reads (instruction fetches), PC-relative
+ * reads still go through m68k_read_xx() (see m68kcpu.h).
  */
-#define M68K_SEPARATE_READS         OPT_OFF
+#define M68K_SEPARATE_READS         OPT_ON
 
 /* If ON, the CPU will call m68k_write_32_pd() when it executes move.l with a
  * predecrement destination EA mode instead of m68k_write_32().
@@ -83,6 +85,26 @@
  */
 #define M68K_REGISTER_MEMORY        OPT_ON
 
+/* If ON, opcodes fetched from registered memory regions are cached by PC
+ * along with their handler and base cycles, saving the fetch and decoding
+ * steps in hot loops. Requires M68K_REGISTER_MEMORY and is disabled when
+ * prefetch or address error emulation are enabled.
+ * Storage must be provided with m68k_set_decode_cache().
+ */
+#define M68K_DECODE_CACHE           OPT_ON
+
+/* If ON, m68k_execute_jit() translates code located in read-only executable
+ * registered memory regions into blocks of native calls to the opcode
+ * handlers, removing the fetch/dispatch loop. Only available on x86-64 hosts,
+ * same requirements as M68K_DECODE_CACHE.
+ * Storage must be provided with m68k_jit_create().
+ */
+#if defined(__x86_64__) || defined(_M_X64)
+#define M68K_JIT                    OPT_ON
+#else
+#define M68K_JIT                    OPT_OFF
+#endif
+
 /* If ON, CPU will call the interrupt acknowledge callback when it services an
  * interrupt.
  * If off, all interrupts will be autovectored and all interrupt requests will
@@ -43,10 +43,11 @@ extern void m68040_fpu_op1(void);
 /* ================================= DATA ================================= */
 /* ======================================================================== */
 
-int  m68ki_initial_cycles;
-int  m68ki_remaining_cycles = 0;                     /* Number of clocks remaining */
-uint m68ki_tracing = 0;
-uint m68ki_address_space;
+M68K_THREAD int  m68ki_initial_cycles;
+M68K_THREAD sint m68ki_remaining_cycles = 0;         /* Number of clocks remaining */
+M68K_THREAD uint m68ki_tracing = 0;
+M68K_THREAD uint m68ki_executing = 0;              /* Inside m68k_execute() */
+M68K_THREAD uint m68ki_address_space;
 
 #ifdef M68K_LOG_ENABLE
 const char* m68ki_cpu_names[] =
@@ -72,15 +73,15 @@ const char* m68ki_cpu_names[] =
 #endif /* M68K_LOG_ENABLE */
 
 /* The CPU core */
-m68ki_cpu_core m68ki_cpu;
+M68K_THREAD m68ki_cpu_core m68ki_cpu;
 
 #if M68K_EMULATE_ADDRESS_ERROR
-jmp_buf m68ki_aerr_trap;
+M68K_THREAD jmp_buf m68ki_aerr_trap;
 #endif /* M68K_EMULATE_ADDRESS_ERROR */
 
-uint    m68ki_aerr_address;
-uint    m68ki_aerr_write_mode;
-uint    m68ki_aerr_fc;
+M68K_THREAD uint m68ki_aerr_address;
+M68K_THREAD uint m68ki_aerr_write_mode;
+M68K_THREAD uint m68ki_aerr_fc;
 
 /* Used by shift & rotate instructions */
 uint8 m68ki_shift_8_table[65] =
@@ -449,7 +450,7 @@ uint8 m68ki_ea_idx_cycle_table[64] =
  */
 
 /* Interrupt acknowledge */
-static int default_int_ack_callback_data;
+static M68K_THREAD int default_int_ack_callback_data;
 static int default_int_ack_callback(int int_level)
 {
 	default_int_ack_callback_data = int_level;
@@ -458,7 +459,7 @@ static int default_int_ack_callback(int int_level)
 }
 
 /* Breakpoint acknowledge */
-static unsigned int default_bkpt_ack_callback_data;
+static M68K_THREAD unsigned int default_bkpt_ack_callback_data;
 static void default_bkpt_ack_callback(unsigned int data)
 {
 	default_bkpt_ack_callback_data = data;
@@ -488,14 +489,14 @@ static int default_tas_instr_callback(void)
 }
 
 /* Called when the program counter changed by a large value */
-static unsigned int default_pc_changed_callback_data;
+static M68K_THREAD unsigned int default_pc_changed_callback_data;
 static void default_pc_changed_callback(unsigned int new_pc)
 {
 	default_pc_changed_callback_data = new_pc;
 }
 
 /* Called every time there's bus activity (read/write to/from memory */
-static unsigned int default_set_fc_callback_data;
+static M68K_THREAD unsigned int default_set_fc_callback_data;
 static void default_set_fc_callback(unsigned int new_fc)
 {
 	default_set_fc_callback_data = new_fc;
@@ -678,16 +679,73 @@ void m68k_set_instr_hook_callback(int  (*callback)(void))
 	CALLBACK_INSTR_HOOK = callback ? callback : default_instr_hook_callback;
 }
 
+unsigned int m68k_decode_cache_size(void)
+{
+	return (sizeof(m68ki_decode_t) * M68K_DECODE_CACHE_SIZE);
+}
+
+void m68k_decode_cache_flush(void *cache)
+{
+	m68ki_decode_t *dc = cache;
+	unsigned int i;
+
+	if (dc == NULL)
+		return;
+	for (i = 0; (i != M68K_DECODE_CACHE_SIZE); ++i)
+		dc[i].pc = ~0u;
+}
+
+void m68k_decode_cache_invalidate(void *cache, unsigned int address)
+{
+	m68ki_decode_t *dc = cache;
+
+	if (dc == NULL)
+		return;
+	dc = &dc[((address >> 1) & (M68K_DECODE_CACHE_SIZE - 1))];
+	if (((dc->pc ^ address) & 0xfffe) == 0)
+		dc->pc = ~0u;
+}
+
+void m68k_set_decode_cache(void *cache)
+{
+	m68ki_cpu.dcache = cache;
+	m68k_decode_cache_flush(cache);
+}
+
 void m68k_register_memory(m68k_mem_t memory[], unsigned int len)
 {
+	unsigned int i;
+	unsigned int j;
+
 	m68ki_cpu.mem = (void *)memory;
 	m68ki_cpu.mem_len = len;
+	m68k_decode_cache_flush(m68ki_cpu.dcache);
+	m68k_jit_flush(m68ki_cpu.jit);
+	/* Rebuild the page table, first region to cover a page owns it. */
+	for (j = 0; (j != M68K_MEM_PAGES); ++j)
+		m68ki_cpu.mem_page[j] = 0;
+	for (i = 0; ((i != len) && (i < 0xff)); ++i) {
+		unsigned int first;
+		unsigned int last;
+
+		if (memory[i].size == 0)
+			continue;
+		first = (memory[i].addr >> M68K_MEM_PAGE_SHIFT);
+		last = ((memory[i].addr + memory[i].size - 1) >>
+			M68K_MEM_PAGE_SHIFT);
+		for (j = first; ((j <= last) && (j < M68K_MEM_PAGES)); ++j)
+			if (m68ki_cpu.mem_page[j] == 0)
+				m68ki_cpu.mem_page[j] = (i + 1);
+	}
 }
 
 #include <stdio.h>
 /* Set the CPU type. */
 void m68k_set_cpu_type(unsigned int cpu_type)
 {
+	/* Cached base cycles depend on the CPU type */
+	m68k_decode_cache_flush(m68ki_cpu.dcache);
+	m68k_jit_flush(m68ki_cpu.jit);
 	switch(cpu_type)
 	{
 		case M68K_CPU_TYPE_68000:
@@ -799,6 +857,7 @@ int m68k_execute(int num_cycles)
 		/* Set our pool of clock cycles available */
 		SET_CYCLES(num_cycles);
 		m68ki_initial_cycles = num_cycles;
+		m68ki_executing = 1;
 
 		/* ASG: update cycles */
 		USE_CYCLES(CPU_INT_CYCLES);
@@ -828,9 +887,21 @@ int m68k_execute(int num_cycles)
 			REG_PPC = REG_PC;
 
 			/* Read an instruction and call its handler */
-			REG_IR = m68ki_read_imm_16();
-			m68ki_instruction_jump_table[REG_IR]();
-			USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
+#if M68K_DECODE_CACHE
+			if (m68ki_cpu.dcache != NULL) {
+				m68ki_decode_t *dc = m68ki_decode_instruction();
+				uint cycles = dc->cycles;
+
+				dc->handler();
+				USE_CYCLES(cycles);
+			}
+			else
+#endif
+			{
+				REG_IR = m68ki_read_imm_16();
+				m68ki_instruction_jump_table[REG_IR]();
+				USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
+			}
 
 			/* Trace m68k_exception, if necessary */
 			m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */
@@ -842,6 +913,7 @@ int m68k_execute(int num_cycles)
 		/* ASG: update cycles */
 		USE_CYCLES(CPU_INT_CYCLES);
 		CPU_INT_CYCLES = 0;
+		m68ki_executing = 0;
 
 		/* return how many clocks we used */
 		return m68ki_initial_cycles - GET_CYCLES();
@@ -875,10 +947,20 @@ void m68k_modify_timeslice(int cycles)
 
 void m68k_end_timeslice(void)
 {
-	m68ki_initial_cycles = GET_CYCLES();
+	/* Keep m68k_execute() returning the number of cycles actually used */
+	m68ki_initial_cycles -= GET_CYCLES();
 	SET_CYCLES(0);
 }
 
+/* Consume cycles as if the CPU was busy, e.g. while it waits for the bus.
+ * m68k_execute() returns as soon as none are left and includes them in the
+ * number of cycles used.
+ */
+void m68k_burn_cycles(int cycles)
+{
+	USE_CYCLES(cycles);
+}
+
 unsigned int m68k_get_instruction_cycle_count(unsigned int instruction)
 {
 	return CYC_INSTRUCTION[instruction];
@@ -905,10 +987,14 @@ void m68k_init(void)
 {
 	static uint emulation_initialized = 0;
 
-	/* The first call to this function initializes the opcode handler jump table */
+	/* The first call to this function initializes the opcode handler jump table,
+	 * and the disassembler's which is used by the block translator. Callers
+	 * running CPUs on several threads must ensure that call is complete first.
+	 */
 	if(!emulation_initialized)
 		{
 		m68ki_build_opcode_table();
+		m68k_is_valid_instruction(0, M68K_CPU_TYPE_68000);
 		emulation_initialized = 1;
 	}
 
@@ -947,6 +1033,8 @@ void m68k_pulse_reset(void)
 	/* Set to arbitrary number since our first fetch is from 0 */
 	CPU_PREF_ADDR = 0x1000;
 #endif /* M68K_EMULATE_PREFETCH */
+	/* Memory may have been reinitialized, forget decoded instructions */
+	m68k_decode_cache_flush(m68ki_cpu.dcache);
 
 	/* Read the initial stack pointer and program counter */
 	m68ki_jump(0);
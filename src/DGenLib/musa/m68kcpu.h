@@ -503,10 +503,26 @@ typedef uint32 uint64;
 
 
 
+/* The decoded instruction cache bypasses the regular opcode fetch */
+#if M68K_DECODE_CACHE && (!M68K_REGISTER_MEMORY || M68K_EMULATE_PREFETCH || \
+			  M68K_EMULATE_ADDRESS_ERROR)
+	#undef M68K_DECODE_CACHE
+	#define M68K_DECODE_CACHE OPT_OFF
+#endif
+
+/* Translated blocks assume nothing happens between instructions */
+#if M68K_JIT && (!M68K_REGISTER_MEMORY || M68K_EMULATE_PREFETCH || \
+		 M68K_EMULATE_ADDRESS_ERROR || M68K_EMULATE_TRACE || \
+		 M68K_EMULATE_FC)
+	#undef M68K_JIT
+	#define M68K_JIT OPT_OFF
+#endif
+
+
 /* Address error */
 #if M68K_EMULATE_ADDRESS_ERROR
 	#include <setjmp.h>
-	extern jmp_buf m68ki_aerr_trap;
+	extern M68K_THREAD jmp_buf m68ki_aerr_trap;
 
 	#define m68ki_set_address_error_trap() \
 		if(setjmp(m68ki_aerr_trap) != 0) \
@@ -516,6 +532,7 @@ typedef uint32 uint64;
 			{ \
 				SET_CYCLES(0); \
 				CPU_INT_CYCLES = 0; \
+				m68ki_executing = 0; \
 				return m68ki_initial_cycles; \
 			} \
 		}
@@ -772,10 +789,10 @@ typedef uint32 uint64;
 /* map read immediate 8 to read immediate 16 */
 #define m68ki_read_imm_8() MASK_OUT_ABOVE_8(m68ki_read_imm_16())
 
-/* Map PC-relative reads */
-#define m68ki_read_pcrel_8(A) m68k_read_pcrelative_8(A)
-#define m68ki_read_pcrel_16(A) m68k_read_pcrelative_16(A)
-#define m68ki_read_pcrel_32(A) m68k_read_pcrelative_32(A)
+/* Map PC-relative reads, these are data reads from the program space */
+#define m68ki_read_pcrel_8(A) m68ki_read_program_8(A)
+#define m68ki_read_pcrel_16(A) m68ki_read_program_16(A)
+#define m68ki_read_pcrel_32(A) m68ki_read_program_32(A)
 
 /* Read from the program space */
 #define m68ki_read_program_8(A) 	m68ki_read_8_fc(A, FLAG_S | FUNCTION_CODE_USER_PROGRAM)
@@ -799,6 +816,17 @@ typedef union
 	double f;
 } fp_reg;
 
+/* Decoded instruction cache entry, see M68K_DECODE_CACHE */
+#define M68K_DECODE_CACHE_SIZE 0x2000 /* number of entries, power of two */
+
+typedef struct
+{
+	uint pc;               /* Opcode address, ~0 if unused */
+	uint16 ir;             /* Opcode */
+	uint8 cycles;          /* Base cycles */
+	void (*handler)(void); /* Opcode handler */
+} m68ki_decode_t;
+
 typedef struct
 {
 	uint cpu_type;     /* CPU Type: 68000, 68008, 68010, 68EC020, or 68020 */
@@ -852,6 +880,9 @@ typedef struct
 	/* Memory regions if defined */
 	m68k_mem_t (*mem)[];
 	unsigned int mem_len;
+	uint8 mem_page[M68K_MEM_PAGES]; /* region index + 1 per page, 0 if none */
+	m68ki_decode_t *dcache;         /* Decoded instruction cache */
+	void *jit;                      /* Translated blocks, see m68kjit.c */
 
 	/* Callbacks to host */
 	int  (*int_ack_callback)(int int_line);           /* Interrupt Acknowledge */
@@ -867,19 +898,22 @@ typedef struct
 } m68ki_cpu_core;
 
 
-extern m68ki_cpu_core m68ki_cpu;
-extern sint           m68ki_remaining_cycles;
-extern uint           m68ki_tracing;
+extern M68K_THREAD m68ki_cpu_core m68ki_cpu;
+extern M68K_THREAD int  m68ki_initial_cycles;
+extern M68K_THREAD sint m68ki_remaining_cycles;
+extern M68K_THREAD uint m68ki_tracing;
+extern M68K_THREAD uint m68ki_executing;
 extern uint8          m68ki_shift_8_table[];
 extern uint16         m68ki_shift_16_table[];
 extern uint           m68ki_shift_32_table[];
 extern uint8          m68ki_exception_cycle_table[][256];
-extern uint           m68ki_address_space;
+extern M68K_THREAD uint m68ki_address_space;
 extern uint8          m68ki_ea_idx_cycle_table[];
+extern void (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
 
-extern uint           m68ki_aerr_address;
-extern uint           m68ki_aerr_write_mode;
-extern uint           m68ki_aerr_fc;
+extern M68K_THREAD uint m68ki_aerr_address;
+extern M68K_THREAD uint m68ki_aerr_write_mode;
+extern M68K_THREAD uint m68ki_aerr_fc;
 
 /* Read data immediately after the program counter */
 INLINE uint m68ki_read_imm_16(void);
@@ -1008,74 +1042,24 @@ char* m68ki_disassemble_quick(unsigned int pc, unsigned int cpu_type,unsigned in
 /* ======================================================================== */
 
 
-/* ---------------------------- Read Immediate ---------------------------- */
-
-/* Handles all immediate reads, does address error check, function code setting,
- * and prefetching if they are enabled in m68kconf.h
- */
-INLINE uint m68ki_read_imm_16(void)
-{
-	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
-	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
-#if M68K_EMULATE_PREFETCH
-	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
-	{
-		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
-		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
-	}
-	REG_PC += 2;
-	return MASK_OUT_ABOVE_16(CPU_PREF_DATA >> ((2-((REG_PC-2)&2))<<3));
-#else
-	REG_PC += 2;
-	return m68k_read_immediate_16(ADDRESS_68K(REG_PC-2));
-#endif /* M68K_EMULATE_PREFETCH */
-}
-INLINE uint m68ki_read_imm_32(void)
-{
-#if M68K_EMULATE_PREFETCH
-	uint temp_val;
-
-	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
-	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
-	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
-	{
-		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
-		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
-	}
-	temp_val = CPU_PREF_DATA;
-	REG_PC += 2;
-	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
-	{
-		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
-		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
-		temp_val = MASK_OUT_ABOVE_32((temp_val << 16) | (CPU_PREF_DATA >> 16));
-	}
-	REG_PC += 2;
-
-	return temp_val;
-#else
-	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
-	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
-	REG_PC += 4;
-	return m68k_read_immediate_32(ADDRESS_68K(REG_PC-4));
-#endif /* M68K_EMULATE_PREFETCH */
-}
-
-
-
 /* ------------------------- Top level read/write ------------------------- */
 
 #if M68K_REGISTER_MEMORY
 
 INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 {
-	unsigned int i;
+	unsigned int i = m68ki_cpu.mem_page[((address >> M68K_MEM_PAGE_SHIFT) &
+					     (M68K_MEM_PAGES - 1))];
+	m68k_mem_t *mem;
 
-	if (m68ki_cpu.mem == NULL)
+	if (i == 0)
 		return NULL;
-	for (i = 0; (i != m68ki_cpu.mem_len); ++i) {
-		m68k_mem_t *mem = &(*m68ki_cpu.mem)[i];
-
+	mem = &(*m68ki_cpu.mem)[(i - 1)];
+	if (((address ^ mem->swab) - mem->addr) < mem->size)
+		return mem;
+	/* Page only partially covered by its region, check the next ones. */
+	for (; (i != m68ki_cpu.mem_len); ++i) {
+		mem = &(*m68ki_cpu.mem)[i];
 		if (((address ^ mem->swab) >= mem->addr) &&
 		    ((address ^ mem->swab) < (mem->addr + mem->size)))
 			return mem;
@@ -1083,22 +1067,37 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 	return NULL;
 }
 
+/* Drop the cached opcode at this address, mirrors included. Only the low
+ * 16 bits are compared, a few unrelated entries may also be dropped.
+ */
+INLINE void m68ki_decode_invalidate(uint address)
+{
+	m68ki_decode_t *dc;
+
+	if (m68ki_cpu.dcache == NULL)
+		return;
+	dc = &m68ki_cpu.dcache[((address >> 1) &
+				(M68K_DECODE_CACHE_SIZE - 1))];
+	if (((dc->pc ^ address) & 0xfffe) == 0)
+		dc->pc = ~0u;
+}
+
 #define m68ki_read_memory_8_direct(a)					\
 	do {								\
 		m68k_mem_t *mem = m68ki_locate_memory(a);		\
 									\
-		if (mem != NULL)					\
+		if ((mem != NULL) && (mem->r))				\
 			return ((uint8 *)mem->mem)			\
 				[((((a) - mem->addr) ^ mem->swab) &	\
 				  mem->mask)];				\
 	}								\
 	while (0)
 
-#define m68ki_read_memory_16_direct(a)					\
+#define m68ki_read_memory_16_flag(a, f)				\
 	do {								\
 		m68k_mem_t *mem = m68ki_locate_memory(a);		\
 									\
-		if (mem != NULL) {					\
+		if ((mem != NULL) && (mem->f)) {			\
 			uint8 *m = &((uint8 *)mem->mem)			\
 				[(((a) - mem->addr) & mem->mask)];	\
 									\
@@ -1108,11 +1107,11 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 	}								\
 	while (0)
 
-#define m68ki_read_memory_32_direct(a)					\
+#define m68ki_read_memory_32_flag(a, f)				\
 	do {								\
 		m68k_mem_t *mem = m68ki_locate_memory(a);		\
 									\
-		if (mem != NULL) {					\
+		if ((mem != NULL) && (mem->f)) {			\
 			uint8 *m = &((uint8 *)mem->mem)			\
 				[(((a) - mem->addr) & mem->mask)];	\
 									\
@@ -1124,6 +1123,12 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 	}								\
 	while (0)
 
+/* Data reads need the R bit, opcode and extension word fetches the X bit. */
+#define m68ki_read_memory_16_direct(a) m68ki_read_memory_16_flag(a, r)
+#define m68ki_read_memory_32_direct(a) m68ki_read_memory_32_flag(a, r)
+#define m68ki_fetch_memory_16_direct(a) m68ki_read_memory_16_flag(a, x)
+#define m68ki_fetch_memory_32_direct(a) m68ki_read_memory_32_flag(a, x)
+
 #define m68ki_write_memory_8_direct(a, v)				\
 	do {								\
 		m68k_mem_t *mem = m68ki_locate_memory(a);		\
@@ -1132,6 +1137,7 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 			((uint8 *)mem->mem)				\
 				[((((a) - mem->addr) ^ mem->swab) &	\
 				  mem->mask)] = (v);			\
+			m68ki_decode_invalidate(a);			\
 			return;						\
 		}							\
 	}								\
@@ -1147,6 +1153,7 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 									\
 			m[mem->swab] = ((v) >> 8);			\
 			m[(mem->swab ^ 1)] = (v);			\
+			m68ki_decode_invalidate(a);			\
 			return;						\
 		}							\
 	}								\
@@ -1164,6 +1171,8 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 			m[(mem->swab ^ 1)] = ((v) >> 16);		\
 			m[(mem->swab + 2)] = ((v) >> 8);		\
 			m[((mem->swab + 2) ^ 1)] = (v);			\
+			m68ki_decode_invalidate(a);			\
+			m68ki_decode_invalidate((a) + 2);		\
 			return;						\
 		}							\
 	}								\
@@ -1174,6 +1183,8 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 #define m68ki_read_memory_8_direct(a) (void)0
 #define m68ki_read_memory_16_direct(a) (void)0
 #define m68ki_read_memory_32_direct(a) (void)0
+#define m68ki_fetch_memory_16_direct(a) (void)0
+#define m68ki_fetch_memory_32_direct(a) (void)0
 
 #define m68ki_write_memory_8_direct(a, v) (void)0
 #define m68ki_write_memory_16_direct(a, v) (void)0
@@ -1181,6 +1192,91 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 
 #endif /* M68K_REGISTER_MEMORY */
 
+/* ---------------------------- Read Immediate ---------------------------- */
+
+/* Handles all immediate reads, does address error check, function code setting,
+ * and prefetching if they are enabled in m68kconf.h
+ * Without prefetching, opcodes and extension words are fetched straight from
+ * executable registered memory regions when possible, otherwise through
+ * m68k_read_immediate_xx() which doesn't see them as data reads.
+ */
+INLINE uint m68ki_read_imm_16(void)
+{
+	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+#if M68K_EMULATE_PREFETCH
+	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
+	{
+		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
+		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
+	}
+	REG_PC += 2;
+	return MASK_OUT_ABOVE_16(CPU_PREF_DATA >> ((2-((REG_PC-2)&2))<<3));
+#else
+	REG_PC += 2;
+	m68ki_fetch_memory_16_direct(ADDRESS_68K(REG_PC-2));
+	return m68k_read_immediate_16(ADDRESS_68K(REG_PC-2));
+#endif /* M68K_EMULATE_PREFETCH */
+}
+INLINE uint m68ki_read_imm_32(void)
+{
+#if M68K_EMULATE_PREFETCH
+	uint temp_val;
+
+	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
+	{
+		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
+		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
+	}
+	temp_val = CPU_PREF_DATA;
+	REG_PC += 2;
+	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
+	{
+		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
+		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
+		temp_val = MASK_OUT_ABOVE_32((temp_val << 16) | (CPU_PREF_DATA >> 16));
+	}
+	REG_PC += 2;
+
+	return temp_val;
+#else
+	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+	REG_PC += 4;
+	m68ki_fetch_memory_32_direct(ADDRESS_68K(REG_PC-4));
+	return m68k_read_immediate_32(ADDRESS_68K(REG_PC-4));
+#endif /* M68K_EMULATE_PREFETCH */
+}
+
+#if M68K_DECODE_CACHE
+/* Fetch the next opcode through the decoded instruction cache. Only opcodes
+ * read from executable registered memory are cached.
+ */
+INLINE m68ki_decode_t *m68ki_decode_instruction(void)
+{
+	m68ki_decode_t *dc = &m68ki_cpu.dcache[((REG_PC >> 1) &
+						(M68K_DECODE_CACHE_SIZE - 1))];
+	m68k_mem_t *mem;
+
+	if (dc->pc == REG_PC) {
+		REG_IR = dc->ir;
+		REG_PC += 2;
+		return dc;
+	}
+	mem = m68ki_locate_memory(ADDRESS_68K(REG_PC));
+	dc->pc = (((mem != NULL) && (mem->x)) ? REG_PC : ~0u);
+	REG_IR = m68ki_read_imm_16();
+	dc->ir = REG_IR;
+	dc->cycles = CYC_INSTRUCTION[REG_IR];
+	dc->handler = m68ki_instruction_jump_table[REG_IR];
+	return dc;
+}
+#endif /* M68K_DECODE_CACHE */
+
+
+
 /* Handles all memory accesses (except for immediate reads if they are
  * configured to use separate functions in m68kconf.h).
  * All memory accesses must go through these top level functions.
@@ -2094,8 +2190,12 @@ void m68ki_exception_interrupt(uint int_level)
 
 	m68ki_jump(new_pc);
 
-	/* Defer cycle counting until later */
-	CPU_INT_CYCLES += CYC_EXCEPTION[vector];
+	/* Defer cycle counting until later, unless the CPU is executing and
+	 * the time it sees must stay right within the slice */
+	if(m68ki_executing)
+		USE_CYCLES(CYC_EXCEPTION[vector]);
+	else
+		CPU_INT_CYCLES += CYC_EXCEPTION[vector];
 
 #if !M68K_EMULATE_INT_ACK
 	/* Automatically clear IRQ if we are not using an acknowledge scheme */
@@ -196,16 +196,16 @@ static void (*g_instruction_table[0x10000])(void);
 static int  g_initialized = 0;
 
 /* Address mask to simulate address lines */
-static unsigned int g_address_mask = 0xffffffff;
-
-static char g_dasm_str[100]; /* string to hold disassembly */
-static char g_helper_str[100]; /* string to hold helpful info */
-static uint g_cpu_pc;        /* program counter */
-static uint g_cpu_ir;        /* instruction register */
-static uint g_cpu_type;
-static uint g_opcode_type;
-static const unsigned char* g_rawop;
-static uint g_rawbasepc;
+static M68K_THREAD unsigned int g_address_mask = 0xffffffff;
+
+static M68K_THREAD char g_dasm_str[100]; /* string to hold disassembly */
+static M68K_THREAD char g_helper_str[100]; /* string to hold helpful info */
+static M68K_THREAD uint g_cpu_pc;        /* program counter */
+static M68K_THREAD uint g_cpu_ir;        /* instruction register */
+static M68K_THREAD uint g_cpu_type;
+static M68K_THREAD uint g_opcode_type;
+static M68K_THREAD const unsigned char* g_rawop;
+static M68K_THREAD uint g_rawbasepc;
 
 /* used by ops like asr, ror, addq, etc */
 static uint g_3bit_qdata_table[8] = {8, 1, 2, 3, 4, 5, 6, 7};
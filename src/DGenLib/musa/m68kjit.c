@@ -0,0 +1,431 @@
+/* ======================================================================== */
+/* ============================ BLOCK TRANSLATOR ========================== */
+/* ======================================================================== */
+
+/* Translates runs of instructions located in read-only executable memory
+ * regions into x86-64 code calling their opcode handlers in sequence.
+ *
+ * Opcodes, handlers and base cycles are resolved once at translation time,
+ * so a translated block behaves exactly like the m68k_execute() loop without
+ * its fetch and dispatch overhead. After each instruction the block returns
+ * to m68k_execute_jit() when the timeslice is over, or when REG_PC does not
+ * point to the next translated instruction (branches, exceptions, interrupts
+ * taken during an instruction).
+ *
+ * Anything that cannot be translated (RAM, unaligned PC, hosts other than
+ * x86-64) is interpreted.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "m68kcpu.h"
+
+#if M68K_JIT
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define M68K_JIT_BLOCKS 0x8000         /* lookup table entries, power of two */
+#define M68K_JIT_CODE_SIZE 0x1000000   /* bytes of native code */
+#define M68K_JIT_BLOCK_INSNS 64        /* max. instructions per block */
+#define M68K_JIT_INSN_SIZE 128         /* max. native bytes per instruction */
+#define M68K_JIT_BLOCK_SIZE (64 + (M68K_JIT_BLOCK_INSNS * M68K_JIT_INSN_SIZE))
+
+/* Blocks receive the addresses of the thread-local CPU state. */
+typedef void (*m68ki_jit_code_t)(m68ki_cpu_core *cpu, sint *cycles);
+
+typedef struct
+{
+	uint pc;               /* Block address, ~0 if unused */
+	m68ki_jit_code_t code; /* Translated block, NULL to interpret */
+} m68ki_jit_block_t;
+
+typedef struct
+{
+	m68ki_jit_block_t block[M68K_JIT_BLOCKS];
+	uint8 *code;           /* Executable buffer */
+	uint8 *code_ptr;       /* First free byte in code */
+} m68ki_jit_t;
+
+static void *m68ki_jit_alloc_code(size_t size)
+{
+#ifdef _WIN32
+	return VirtualAlloc(NULL, size, (MEM_COMMIT | MEM_RESERVE),
+			    PAGE_EXECUTE_READWRITE);
+#else
+	void *p = mmap(NULL, size, (PROT_READ | PROT_WRITE | PROT_EXEC),
+		       (MAP_PRIVATE | MAP_ANONYMOUS), -1, 0);
+
+	return ((p == MAP_FAILED) ? NULL : p);
+#endif
+}
+
+static void m68ki_jit_free_code(void *p, size_t size)
+{
+#ifdef _WIN32
+	(void)size;
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	munmap(p, size);
+#endif
+}
+
+void *m68k_jit_create(void)
+{
+	m68ki_jit_t *jit = malloc(sizeof(*jit));
+
+	if (jit == NULL)
+		return NULL;
+	jit->code = m68ki_jit_alloc_code(M68K_JIT_CODE_SIZE);
+	if (jit->code == NULL) {
+		free(jit);
+		return NULL;
+	}
+	m68k_jit_flush(jit);
+	return jit;
+}
+
+void m68k_jit_destroy(void *jit)
+{
+	m68ki_jit_t *j = jit;
+
+	if (j == NULL)
+		return;
+	if (m68ki_cpu.jit == j)
+		m68ki_cpu.jit = NULL;
+	m68ki_jit_free_code(j->code, M68K_JIT_CODE_SIZE);
+	free(j);
+}
+
+void m68k_jit_flush(void *jit)
+{
+	m68ki_jit_t *j = jit;
+	unsigned int i;
+
+	if (j == NULL)
+		return;
+	for (i = 0; (i != M68K_JIT_BLOCKS); ++i)
+		j->block[i].pc = ~0u;
+	j->code_ptr = j->code;
+}
+
+void m68k_set_jit(void *jit)
+{
+	m68ki_cpu.jit = jit;
+	m68k_jit_flush(jit);
+}
+
+/* ------------------------------ Code emitter ---------------------------- */
+
+static uint8 *m68ki_jit_emit_32(uint8 *p, uint32 v)
+{
+	p[0] = (v & 0xff);
+	p[1] = ((v >> 8) & 0xff);
+	p[2] = ((v >> 16) & 0xff);
+	p[3] = ((v >> 24) & 0xff);
+	return (p + 4);
+}
+
+static uint8 *m68ki_jit_emit_64(uint8 *p, const void *v)
+{
+	uint64_t u = (uint64_t)(uintptr_t)v;
+
+	p = m68ki_jit_emit_32(p, (uint32)u);
+	return m68ki_jit_emit_32(p, (uint32)(u >> 32));
+}
+
+/* mov dword [rbx + offset], imm32 */
+static uint8 *m68ki_jit_emit_store(uint8 *p, size_t offset, uint32 v)
+{
+	*(p++) = 0xc7;
+	*(p++) = 0x83;
+	p = m68ki_jit_emit_32(p, (uint32)offset);
+	return m68ki_jit_emit_32(p, v);
+}
+
+/* mov rax, imm64; call rax */
+static uint8 *m68ki_jit_emit_call(uint8 *p, const void *fn)
+{
+	*(p++) = 0x48;
+	*(p++) = 0xb8;
+	p = m68ki_jit_emit_64(p, fn);
+	*(p++) = 0xff;
+	*(p++) = 0xd0;
+	return p;
+}
+
+/* jcc rel32 (0x0f, cc) or jmp rel32 (cc == 0) */
+static uint8 *m68ki_jit_emit_jump(uint8 *p, uint8 cc, const uint8 *to)
+{
+	if (cc) {
+		*(p++) = 0x0f;
+		*(p++) = cc;
+	}
+	else
+		*(p++) = 0xe9;
+	return m68ki_jit_emit_32(p, (uint32)(to - (p + 4)));
+}
+
+#define JIT_JNE 0x85
+#define JIT_JLE 0x8e
+#define JIT_JMP 0x00
+
+/* --------------------------- Block translation -------------------------- */
+
+#if M68K_INSTRUCTION_HOOK
+static int m68ki_jit_instr_hook(void)
+{
+	if (m68ki_instr_hook()) {
+		m68k_end_timeslice();
+		return 1;
+	}
+	return 0;
+}
+#endif
+
+/* Instructions that always leave the block, either by changing REG_PC or by
+ * stopping the CPU.
+ */
+static int m68ki_jit_block_end(uint op)
+{
+	switch (op >> 12) {
+	case 0x6: /* Bcc, BRA, BSR */
+	case 0xa: /* Line A */
+	case 0xf: /* Line F */
+		return 1;
+	case 0x4:
+		if ((op & 0xff80) == 0x4e80) /* JSR, JMP */
+			return 1;
+		if ((op & 0xfff0) == 0x4e40) /* TRAP */
+			return 1;
+		switch (op) {
+		case 0x4afc: /* ILLEGAL */
+		case 0x4e72: /* STOP */
+		case 0x4e73: /* RTE */
+		case 0x4e74: /* RTD */
+		case 0x4e75: /* RTS */
+		case 0x4e77: /* RTR */
+			return 1;
+		}
+		return 0;
+	case 0x5:
+		return ((op & 0xf0f8) == 0x50c8); /* DBcc */
+	}
+	return 0;
+}
+
+/* Translate instructions starting at pc, returns NULL if they must be
+ * interpreted instead.
+ */
+static m68ki_jit_code_t m68ki_jit_translate(m68ki_jit_t *jit, uint pc)
+{
+	m68k_mem_t *mem = m68ki_locate_memory(ADDRESS_68K(pc));
+	unsigned int cpu_type = m68k_get_reg(NULL, M68K_REG_CPU_TYPE);
+	uint8 *epilogue;
+	uint8 *entry;
+	uint8 *p;
+	unsigned int n;
+
+	if ((mem == NULL) || (!mem->x) || (mem->w) || (pc & 1))
+		return NULL;
+	if ((jit->code_ptr + M68K_JIT_BLOCK_SIZE) >
+	    (jit->code + M68K_JIT_CODE_SIZE))
+		m68k_jit_flush(jit);
+	p = jit->code_ptr;
+	/* Epilogue first so that exits can jump backwards to it. */
+	epilogue = p;
+	*(p++) = 0x48; /* add rsp, 40 */
+	*(p++) = 0x83;
+	*(p++) = 0xc4;
+	*(p++) = 0x28;
+	*(p++) = 0x41; /* pop r12 */
+	*(p++) = 0x5c;
+	*(p++) = 0x5b; /* pop rbx */
+	*(p++) = 0xc3; /* ret */
+	/* Prologue, rbx and r12 are callee-saved in both ABIs. The stack is
+	 * aligned on 16 bytes and provides Win64 shadow space. */
+	entry = p;
+	*(p++) = 0x53; /* push rbx */
+	*(p++) = 0x41; /* push r12 */
+	*(p++) = 0x54;
+	*(p++) = 0x48; /* sub rsp, 40 */
+	*(p++) = 0x83;
+	*(p++) = 0xec;
+	*(p++) = 0x28;
+#ifdef _WIN32
+	*(p++) = 0x48; /* mov rbx, rcx (&m68ki_cpu) */
+	*(p++) = 0x89;
+	*(p++) = 0xcb;
+	*(p++) = 0x49; /* mov r12, rdx (&m68ki_remaining_cycles) */
+	*(p++) = 0x89;
+	*(p++) = 0xd4;
+#else
+	*(p++) = 0x48; /* mov rbx, rdi (&m68ki_cpu) */
+	*(p++) = 0x89;
+	*(p++) = 0xfb;
+	*(p++) = 0x49; /* mov r12, rsi (&m68ki_remaining_cycles) */
+	*(p++) = 0x89;
+	*(p++) = 0xf4;
+#endif
+	for (n = 0; (n != M68K_JIT_BLOCK_INSNS); ++n) {
+		uint8 raw[32];
+		char str[256];
+		unsigned int len;
+		unsigned int i;
+		uint op;
+
+		/* Raw bytes for the disassembler, which provides lengths. */
+		memset(raw, 0, sizeof(raw));
+		for (i = 0; (i != sizeof(raw)); ++i) {
+			uint a = ADDRESS_68K(pc + i);
+
+			if (((a ^ mem->swab) - mem->addr) >= mem->size)
+				break;
+			raw[i] = ((uint8 *)mem->mem)
+				[(((a - mem->addr) ^ mem->swab) & mem->mask)];
+		}
+		if (i < 2)
+			break;
+		op = ((raw[0] << 8) | raw[1]);
+		len = m68k_disassemble_raw(str, pc, raw, &raw[2], cpu_type);
+		if ((len < 2) || (len > i))
+			break;
+		/* REG_PC already equals pc here. */
+#if M68K_INSTRUCTION_HOOK
+		p = m68ki_jit_emit_call(p, (void *)m68ki_jit_instr_hook);
+		*(p++) = 0x85; /* test eax, eax */
+		*(p++) = 0xc0;
+		p = m68ki_jit_emit_jump(p, JIT_JNE, epilogue);
+#endif
+		p = m68ki_jit_emit_store(p, offsetof(m68ki_cpu_core, ppc), pc);
+		p = m68ki_jit_emit_store(p, offsetof(m68ki_cpu_core, pc),
+					 (pc + 2));
+		p = m68ki_jit_emit_store(p, offsetof(m68ki_cpu_core, ir), op);
+		p = m68ki_jit_emit_call(p,
+					(void *)m68ki_instruction_jump_table[op]);
+		/* sub dword [r12], cycles */
+		*(p++) = 0x41;
+		*(p++) = 0x81;
+		*(p++) = 0x2c;
+		*(p++) = 0x24;
+		p = m68ki_jit_emit_32(p, CYC_INSTRUCTION[op]);
+		pc += len;
+		/* cmp dword [rbx + pc], next; jne epilogue */
+		*(p++) = 0x81;
+		*(p++) = 0xbb;
+		p = m68ki_jit_emit_32(p, offsetof(m68ki_cpu_core, pc));
+		p = m68ki_jit_emit_32(p, pc);
+		p = m68ki_jit_emit_jump(p, JIT_JNE, epilogue);
+		/* cmp dword [r12], 0; jle epilogue */
+		*(p++) = 0x41;
+		*(p++) = 0x83;
+		*(p++) = 0x3c;
+		*(p++) = 0x24;
+		*(p++) = 0x00;
+		p = m68ki_jit_emit_jump(p, JIT_JLE, epilogue);
+		if (m68ki_jit_block_end(op)) {
+			++n;
+			break;
+		}
+	}
+	if (n == 0)
+		return NULL;
+	p = m68ki_jit_emit_jump(p, JIT_JMP, epilogue);
+	jit->code_ptr = p;
+	return (m68ki_jit_code_t)entry;
+}
+
+/* Run a single instruction, same as the m68k_execute() loop body. */
+static void m68ki_jit_interpret(void)
+{
+#if M68K_INSTRUCTION_HOOK
+	if (m68ki_instr_hook()) {
+		m68k_end_timeslice();
+		return;
+	}
+#endif
+	REG_PPC = REG_PC;
+#if M68K_DECODE_CACHE
+	if (m68ki_cpu.dcache != NULL) {
+		m68ki_decode_t *dc = m68ki_decode_instruction();
+		uint cycles = dc->cycles;
+
+		dc->handler();
+		USE_CYCLES(cycles);
+	}
+	else
+#endif
+	{
+		REG_IR = m68ki_read_imm_16();
+		m68ki_instruction_jump_table[REG_IR]();
+		USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
+	}
+}
+
+int m68k_execute_jit(int num_cycles)
+{
+	m68ki_jit_t *jit = m68ki_cpu.jit;
+
+	if ((jit == NULL) || (CPU_STOPPED))
+		return m68k_execute(num_cycles);
+	SET_CYCLES(num_cycles);
+	m68ki_initial_cycles = num_cycles;
+	m68ki_executing = 1;
+	USE_CYCLES(CPU_INT_CYCLES);
+	CPU_INT_CYCLES = 0;
+	do {
+		m68ki_jit_block_t *b =
+			&jit->block[((REG_PC >> 1) & (M68K_JIT_BLOCKS - 1))];
+
+		if (b->pc != REG_PC) {
+			uint pc = REG_PC;
+			m68ki_jit_code_t code = m68ki_jit_translate(jit, pc);
+
+			/* Translation may have flushed the table. */
+			b->pc = pc;
+			b->code = code;
+		}
+		if (b->code != NULL)
+			b->code(&m68ki_cpu, &m68ki_remaining_cycles);
+		else
+			m68ki_jit_interpret();
+	} while (GET_CYCLES() > 0);
+	REG_PPC = REG_PC;
+	USE_CYCLES(CPU_INT_CYCLES);
+	CPU_INT_CYCLES = 0;
+	m68ki_executing = 0;
+	return (m68ki_initial_cycles - GET_CYCLES());
+}
+
+#else /* M68K_JIT */
+
+void *m68k_jit_create(void)
+{
+	return NULL;
+}
+
+void m68k_jit_destroy(void *jit)
+{
+	(void)jit;
+}
+
+void m68k_jit_flush(void *jit)
+{
+	(void)jit;
+}
+
+void m68k_set_jit(void *jit)
+{
+	m68ki_cpu.jit = jit;
+}
+
+int m68k_execute_jit(int num_cycles)
+{
+	return m68k_execute(num_cycles);
+}
+
+#endif /* M68K_JIT */
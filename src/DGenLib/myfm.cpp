@@ -24,6 +24,9 @@ int md::myfm_write(int a, int v, int md)
 #ifdef WITH_VGMDUMP
 	vgm_dump_ym2612(sid, fm_sel[sid], v);
 #endif
+	// Timers are only updated on demand, catch up before changing them.
+	if ((sid == 0) && (fm_sel[0] >= 0x24) && (fm_sel[0] <= 0x27))
+		fm_timer_callback();
 	if (fm_sel[sid] == 0x2a) {
 		dac_submit((uint8_t)v);
 		pass = 0;
@@ -64,10 +67,13 @@ int md::myfm_write(int a, int v, int md)
 	fm_reg[sid][(fm_sel[sid])] = v;
 end:
 	if (pass) {
-		YM2612Write(0, a, v);
+		// Generate what was played until now with the previous value.
+		if (a & 0x01)
+			fm_catch_up();
+		YM2612Write(ctx_ym2612, 0, a, v);
 		if (dgen_mjazz) {
-			YM2612Write(1, a, v);
-			YM2612Write(2, a, v);
+			YM2612Write(ctx_ym2612, 1, a, v);
+			YM2612Write(ctx_ym2612, 2, a, v);
 		}
 	}
 	return 0;
@@ -76,7 +82,7 @@ end:
 int md::myfm_read(int a)
 {
 	fm_timer_callback();
-	return (fm_tover | (YM2612Read(0, (a & 3)) & ~0x03));
+	return (fm_tover | (YM2612Read(ctx_ym2612, 0, (a & 3)) & ~0x03));
 }
 
 int md::mysn_write(int d)
@@ -84,7 +90,8 @@ int md::mysn_write(int d)
 #ifdef WITH_VGMDUMP
 	vgm_dump_sn76496(d);
 #endif
-	SN76496Write(0, d);
+	psg_catch_up();
+	SN76496Write(&ctx_sn76496, d);
 	return 0;
 }
 
@@ -103,7 +110,7 @@ int md::fm_timer_callback()
 		if (fm_ticker[0] >= amax) {
 			if (fm_reg[0][0x27] & 0x04)
 				fm_tover |= 0x01;
-			fm_ticker[0] -= amax;
+			fm_ticker[0] %= amax;
 		}
 	}
 	if ((fm_reg[0][0x27] & 0x02) && ((now - fm_ticker[3]) > 0)) {
@@ -112,7 +119,7 @@ int md::fm_timer_callback()
 		if (fm_ticker[2] >= bmax) {
 			if (fm_reg[0][0x27] & 0x08)
 				fm_tover |= 0x02;
-			fm_ticker[2] -= bmax;
+			fm_ticker[2] %= bmax;
 		}
 	}
 	return 0;
@@ -124,64 +131,225 @@ void md::fm_reset()
 	fm_tover = 0x00;
 	memset(fm_ticker, 0, sizeof(fm_ticker));
 	memset(fm_reg, 0, sizeof(fm_reg));
-	YM2612ResetChip(0);
+	YM2612ResetChip(ctx_ym2612, 0);
 	if (dgen_mjazz) {
-		YM2612ResetChip(1);
-		YM2612ResetChip(2);
+		YM2612ResetChip(ctx_ym2612, 1);
+		YM2612ResetChip(ctx_ym2612, 2);
 	}
-	SN76496_init(0,
+	SN76496_init(&ctx_sn76496,
 		     (((pal) ? PAL_MCLK : NTSC_MCLK) / 15),
 		     dgen_soundrate, 16);
 }
 
+/**
+ * Start generating FM output for a frame.
+ * @param len Number of samples in the frame, 0 to generate nothing.
+ */
+void md::fm_start(unsigned int len)
+{
+	fm_max = 0;
+	fm_len = 0;
+	// MJazz may be toggled at any time, not in the middle of a frame.
+	fm_chips = (dgen_mjazz ? 3 : 1);
+	if (len > fm_size) {
+		// Room for MJazz chips.
+		int32_t *data = (int32_t *)realloc(fm_data,
+						   (len * 2 * 3 *
+						    sizeof(*data)));
+
+		if (data == NULL)
+			return;
+		fm_data = data;
+		fm_size = len;
+	}
+	fm_max = len;
+}
+
+/**
+ * Generate FM output up to a given number of samples into the frame.
+ * @param len Number of samples.
+ */
+void md::fm_generate(unsigned int len)
+{
+	unsigned int i;
+
+	if (len > fm_max)
+		len = fm_max;
+	if (len <= fm_len)
+		return;
+	for (i = 0; (i != fm_chips); ++i)
+		YM2612Generate(ctx_ym2612, i,
+			       &fm_data[(((i * fm_max) + fm_len) * 2)],
+			       (len - fm_len));
+	fm_len = len;
+}
+
+/**
+ * Get the current time in the frame, as seen by the CPU accessing a sound
+ * chip.
+ * @param len Number of samples in the frame.
+ * @param shift Fixed point precision of the result.
+ * @return Time in samples.
+ */
+uint64_t md::sound_pos(unsigned int len, unsigned int shift)
+{
+	uint64_t odo;
+	unsigned int max;
+
+	if (z80_st_running) {
+		odo = z80_odo();
+		max = (lines * Z80_CYCLES_PER_LINE);
+	}
+	else {
+		odo = m68k_odo();
+		max = (lines * M68K_CYCLES_PER_LINE);
+	}
+	return (((odo << shift) * len) / max);
+}
+
+/**
+ * Generate FM output up to the current time, as seen by the CPU writing
+ * to the YM2612.
+ */
+void md::fm_catch_up()
+{
+	if (fm_max == 0)
+		return;
+	fm_generate(sound_pos(fm_max, 0));
+}
+
+/**
+ * Run the PSG up to the current time, as seen by the CPU writing to it.
+ */
+void md::psg_catch_up()
+{
+	uint64_t pos;
+
+	if (sound_len == 0)
+		return;
+	pos = sound_pos(sound_len, 16);
+	if (pos > ((uint64_t)sound_len << 16))
+		pos = ((uint64_t)sound_len << 16);
+	SN76496Run(&ctx_sn76496, pos);
+}
+
 void md::dac_init()
 {
 	dac_enabled = true;
-	dac_len = 0;
-#ifndef NDEBUG
-	memset(dac_data, 0xff, sizeof(dac_data));
-#endif
+	dac_data = 0x80;
+	dac_level = 0;
+	dac_head = 0;
+	dac_count = 0;
 }
 
-static const struct {
-	unsigned int samples;
-	unsigned int usecs;
-} per_frame[2] = {
-	{ (44100 / 60), (1000000 / 60) },
-	{ (44100 / 50), (1000000 / 50) },
-};
+/**
+ * Record a DAC level change at the current time.
+ * @param level New level.
+ */
+void md::dac_push(int16_t level)
+{
+	struct dac_write *w;
+	uint64_t pos;
 
-void md::dac_submit(uint8_t d)
+	// Nothing is played without sound, only the level matters.
+	if (sound_len == 0) {
+		dac_level = level;
+		dac_count = 0;
+		return;
+	}
+	if (dac_count == dac_size) {
+		unsigned int size = (dac_size ? (dac_size * 2) : 0x400);
+		struct dac_write *ring =
+			(struct dac_write *)malloc(size * sizeof(*ring));
+		unsigned int i;
+
+		if (ring == NULL)
+			return;
+		for (i = 0; (i != dac_count); ++i)
+			ring[i] = dac_ring[((dac_head + i) & (dac_size - 1))];
+		free(dac_ring);
+		dac_ring = ring;
+		dac_size = size;
+		dac_head = 0;
+	}
+	// Writes may end up past this frame, but never go back in time.
+	pos = sound_pos(sound_len, 16);
+	if (pos > ((uint64_t)sound_len << 17))
+		pos = ((uint64_t)sound_len << 17);
+	if (dac_count) {
+		w = &dac_ring[((dac_head + dac_count - 1) & (dac_size - 1))];
+		if (pos < w->pos)
+			pos = w->pos;
+	}
+	w = &dac_ring[((dac_head + dac_count) & (dac_size - 1))];
+	w->pos = pos;
+	w->level = level;
+	++dac_count;
+}
+
+/**
+ * Add the DAC output for the frame, each sample being the average level
+ * during its period. Changes past the end of the frame are kept for the
+ * next one.
+ * @param lr Interleaved stereo samples.
+ * @param len Number of samples.
+ */
+void md::dac_mix(int16_t *lr, unsigned int len)
 {
-	unsigned int usecs;
-	unsigned int index;
+	uint32_t t = 0;
+	int level = dac_level;
 	unsigned int i;
 
-	if (!dac_enabled)
-		return;
-	if (dac_len == elemof(dac_data))
-		return;
-	usecs = frame_usecs();
-	index = ((usecs << 10) /
-		 ((per_frame[pal].usecs << 10) /
-		  elemof(dac_data)));
-	if (index >= elemof(dac_data))
+	if ((dac_count == 0) && (level == 0))
 		return;
-	dac_data[index] = d;
-	if (dac_len)
-		d = dac_data[dac_len - 1];
-	for (i = dac_len; (i < index); ++i)
-		dac_data[i] = d;
-	dac_len = (index + 1);
+	for (i = 0; (i != len); ++i) {
+		uint32_t next = ((i + 1) << 16);
+		int32_t sum = 0;
+
+		while (dac_count) {
+			struct dac_write *w = &dac_ring[dac_head];
+
+			if (w->pos >= next)
+				break;
+			sum += (level * (int32_t)(w->pos - t));
+			t = w->pos;
+			level = w->level;
+			dac_head = ((dac_head + 1) & (dac_size - 1));
+			--dac_count;
+		}
+		sum += (level * (int32_t)(next - t));
+		t = next;
+		lr[(i << 1)] += (sum >> 16);
+		lr[((i << 1) | 1)] += (sum >> 16);
+	}
+	for (i = 0; (i != dac_count); ++i)
+		dac_ring[((dac_head + i) & (dac_size - 1))].pos -= (len << 16);
+	dac_level = level;
+}
+
+void md::dac_submit(uint8_t d)
+{
+	dac_data = d;
+	if (dac_enabled)
+		dac_push((d - 0x80) << 6);
 }
 
 void md::dac_enable(uint8_t d)
 {
 	dac_enabled = ((d & 0x80) >> 7);
+	dac_push(dac_enabled ? ((dac_data - 0x80) << 6) : 0);
 }
 
 #ifdef WITH_VGMDUMP
 
+static const struct {
+	unsigned int samples;
+	unsigned int usecs;
+} per_frame[2] = {
+	{ (44100 / 60), (1000000 / 60) },
+	{ (44100 / 50), (1000000 / 50) },
+};
+
 void md::vgm_dump_ym2612(uint8_t a1, uint8_t reg, uint8_t data)
 {
 	if (vgm_dump) {
@@ -283,7 +451,7 @@ int md::vgm_dump_start(const char *name)
 	if (fwrite(buf, sizeof(buf), 1, vgm_dump_file) != 1)
 		goto error;
 	// Dump YM2612 registers directly.
-	YM2612_dump(0, ym2612_buf);
+	YM2612_dump(ctx_ym2612, 0, ym2612_buf);
 	// Timers.
 	{
 		uint8_t buf[] = {
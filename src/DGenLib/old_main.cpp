@@ -35,9 +35,6 @@
 static long dgen_mingw_detach = 1;
 #endif
 
-// Defined in ras.cpp, and set to true if the Genesis palette's changed.
-extern int pal_dirty;
-
 FILE *debug_log = NULL;
 
 // Do a demo frame, if active
@@ -607,9 +604,9 @@ next_rom:
 			else
 				megad->one_frame(&mdscr, mdpal, NULL);
 		frozen:
-			if ((mdpal) && (pal_dirty)) {
+			if ((mdpal) && (megad->vdp.pal_dirty)) {
 				pd_graphics_palette_update();
-				pal_dirty = 0;
+				megad->vdp.pal_dirty = false;
 			}
 			pd_graphics_update(megad->plugged);
 			++frames;
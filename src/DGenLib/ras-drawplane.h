@@ -7,7 +7,7 @@
 		yscroll_amount = get_word(vsram + rec_no * 2) & 0x7ff;	\
 									\
 		/* interlace ? */					\
-		if (reg[12] & 2)					\
+		if (INTERLACE)						\
 			yscroll_amount >>= 1;				\
 									\
 		/* Offset for the line */				\
@@ -20,8 +20,11 @@
 	while (0)
 
 {
+	const int w = display_mode<MODE>::cells;
+	const int xstart = display_mode<MODE>::start;
+	unsigned int bank = 0;
 	int xsize, ysize;
-	int x, scan = 0, w, xstart;
+	int x, scan = 0;
 	static int sizes[4] = { 32, 64, 64, 128 };
 	unsigned which;
 	unsigned char *where, *hscroll_rec_ptr, *tiles, *tile_line = NULL;
@@ -70,29 +73,16 @@
 #if PLANE == 0
 	hscroll_rec_ptr = (vram + ((reg[13] << 10) & 0xfc00));
 	tiles = (vram + (reg[2] << 10));
+#if VRAM_128KB
+	bank = get_vram_bank_tiles(PLANE_A);
+#endif
 #else // PLANE == 1
 	hscroll_rec_ptr = (vram + ((reg[13] << 10) & 0xfc00) + 2);
 	tiles = (vram + (reg[4] << 13));
+#if VRAM_128KB
+	bank = get_vram_bank_tiles(PLANE_B);
 #endif
-
-	// Wide or narrow?
-#if VDP_H56_MODE
-	if (reg[1] & 1)
-	{
-		// 16:9 enhanced mode
-		w = 54;
-		xstart = -8;
-	}
-	else
 #endif
-	if (reg[12] & 1) {
-		w = 40;
-		xstart = -8;
-	}
-	else {
-		w = 32;
-		xstart = 24;
-	}
 
 	/*
 	 * Lookup the horizontal offset.
@@ -120,7 +110,7 @@
 	hscroll_amount = get_word(hscroll_rec_ptr);
 	xoff_mask = xsize - 1;
 	xoff = ((-(hscroll_amount>>3) - 1)<<1) & xoff_mask;
-	where = dest + (xstart + (hscroll_amount & 7)) * (int) Bpp;
+	where = (layer[PLANE] + LAYER_MARGIN + xstart + (hscroll_amount & 7));
 
 	/*
 	 * If this is not column vscroll mode, we look up the
@@ -181,20 +171,12 @@
 #endif
 		which = get_word(tile_line + xoff);
 
-#if (FRONT == 0) && (PLANE == 1)
-		draw_tile_solid(PLANE, which, scan, where);
-#elif FRONT == 1
-		if (which >> 15)
-			draw_tile(PLANE, which, scan, where);
-#else
-		if (!(which >> 15))
-			draw_tile(PLANE, which, scan, where);
-#endif
+		draw_tile<INTERLACE>(bank, which, scan, where);
 
 #if PLANE == 0
 	skip:
 #endif
-		where += Bpp_times8;
+		where += 8;
 		xoff = ((xoff + 2) & xoff_mask);
 	}
 }
@@ -17,36 +17,11 @@
 #include "pd.h"
 #include "rc-vars.h"
 
-// This is marked each time the palette is updated. Handy for the 8bpp
-// implementation, so we don't waste time changing the palette unnecessarily.
-int pal_dirty;
-
-// Macros, to route draw_tile and draw_tile_solid to the right handler
-#define draw_tile(plane, which, line, where) \
-	switch(Bpp)\
-	  {\
-	  case 1:\
-	    draw_tile1((plane),(which),(line),(where)); break;\
-	  case 2:\
-	    draw_tile2((plane),(which),(line),(where)); break;\
-	  case 3:\
-	    draw_tile3((plane),(which),(line),(where)); break;\
-	  case 4:\
-	    draw_tile4((plane),(which),(line),(where)); break;\
-	  }
-
-#define draw_tile_solid(plane, which, line, where) \
-	switch(Bpp)\
-	  {\
-	  case 1:\
-	    draw_tile1_solid((plane),(which),(line),(where)); break;\
-	  case 2:\
-	    draw_tile2_solid((plane),(which),(line),(where)); break;\
-	  case 3:\
-	    draw_tile3_solid((plane),(which),(line),(where)); break;\
-	  case 4:\
-	    draw_tile4_solid((plane),(which),(line),(where)); break;\
-	  }
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define RAS_SSE2
+#endif
 
 // Silly utility function, get a big-endian word
 #ifdef WORDS_BIGENDIAN
@@ -57,91 +32,33 @@ static inline int get_word(unsigned char *where)
   { return (where[0] << 8) | where[1]; }
 #endif
 
-// Tile pixel masks
-#ifdef WORDS_BIGENDIAN
-#  define PIXEL0 (0xf0000000)
-#  define PIXEL1 (0x0f000000)
-#  define PIXEL2 (0x00f00000)
-#  define PIXEL3 (0x000f0000)
-#  define PIXEL4 (0x0000f000)
-#  define PIXEL5 (0x00000f00)
-#  define PIXEL6 (0x000000f0)
-#  define PIXEL7 (0x0000000f)
-#  define SHIFT0 (28)
-#  define SHIFT1 (24)
-#  define SHIFT2 (20)
-#  define SHIFT3 (16)
-#  define SHIFT4 (12)
-#  define SHIFT5 ( 8)
-#  define SHIFT6 ( 4)
-#  define SHIFT7 ( 0)
-#else // WORDS_BIGENDIAN
-#  define PIXEL0 (0x000000f0)
-#  define PIXEL1 (0x0000000f)
-#  define PIXEL2 (0x0000f000)
-#  define PIXEL3 (0x00000f00)
-#  define PIXEL4 (0x00f00000)
-#  define PIXEL5 (0x000f0000)
-#  define PIXEL6 (0xf0000000)
-#  define PIXEL7 (0x0f000000)
-#  define SHIFT0 ( 4)
-#  define SHIFT1 ( 0)
-#  define SHIFT2 (12)
-#  define SHIFT3 ( 8)
-#  define SHIFT4 (20)
-#  define SHIFT5 (16)
-#  define SHIFT6 (28)
-#  define SHIFT7 (24)
-#endif // WORDS_BIGENDIAN
-
-#ifdef WITH_X86_TILES
-extern "C" {
-
-void asm_tiles_init(unsigned char *vram,
-		    unsigned char *reg,
-		    unsigned *highpal);
-
-void drawtile1(int which, int line, unsigned char *where);
-void drawtile1_solid(int which, int line, unsigned char *where);
-void drawtile2(int which, int line, unsigned char *where);
-void drawtile2_solid(int which, int line, unsigned char *where);
-void drawtile3(int which, int line, unsigned char *where);
-void drawtile3_solid(int which, int line, unsigned char *where);
-void drawtile4(int which, int line, unsigned char *where);
-void drawtile4_solid(int which, int line, unsigned char *where);
-}
-
-// Pass off these calls to assembler counterparts
-inline void md_vdp::draw_tile1_solid(int plane, int which, int line, unsigned char *where)
-  { drawtile1_solid(which, line, where); }
-
-inline void md_vdp::draw_tile1(int plane, int which, int line, unsigned char *where)
-  { drawtile1(which, line, where); }
-
-inline void md_vdp::draw_tile2_solid(int plane, int which, int line, unsigned char *where)
-  { drawtile2_solid(which, line, where); }
-
-inline void md_vdp::draw_tile2(int plane, int which, int line, unsigned char *where)
-  { drawtile2(which, line, where); }
-
-inline void md_vdp::draw_tile3_solid(int plane, int which, int line, unsigned char *where)
-  { drawtile3_solid(which, line, where); }
-
-inline void md_vdp::draw_tile3(int plane, int which, int line, unsigned char *where)
-  { drawtile3(which, line, where); }
+// Layout of each DisplayMode: number of cells across (not counting the
+// partially visible ones), where the first one starts in the layers, which
+// dots are merged into the destination and where sprites stop being drawn
+// (sprites are offset by 32 dots in H32).
+template <unsigned int MODE>
+struct display_mode;
 
-inline void md_vdp::draw_tile4_solid(int plane, int which, int line, unsigned char *where)
-  { drawtile4_solid(which, line, where); }
-
-inline void md_vdp::draw_tile4(int plane, int which, int line, unsigned char *where)
-  { drawtile4(which, line, where); }
+template <>
+struct display_mode<DISPLAY_H32>
+{
+	enum { cells = 32, start = 24, merge_start = 32, merge_end = 288,
+	       sprite_width = 320 };
+};
 
-#else // WITH_X86_TILES
+template <>
+struct display_mode<DISPLAY_H40>
+{
+	enum { cells = 40, start = -8, merge_start = 0, merge_end = 320,
+	       sprite_width = 320 };
+};
 
-static bool has_zero_nibbles(uint32_t u32)
+template <>
+struct display_mode<DISPLAY_H56>
 {
-	return (((u32 - 0x11111111) & ~u32 & 0x88888888)) ? true : false;
-}
+	enum { cells = 54, start = -8, merge_start = 0, merge_end = 448,
+	       sprite_width = 448 };
+};
 
 #if VRAM_128KB
 inline unsigned int md_vdp::get_vram_bank_tiles(int plane)
@@ -170,558 +87,127 @@ inline unsigned int md_vdp::get_vram_bank_tiles(int plane)
 }
 #endif
 
-// Blit tile solidly, for 1 byte-per-pixel
-inline void md_vdp::draw_tile1_solid(int plane, int which, int line, unsigned char *where)
-{
-  unsigned tile, pal;
-
-  pal = (which >> 9 & 0x30); // Determine which 16-color palette
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  unsigned int bank = 0;
-
-#if VRAM_128KB
-  bank = get_vram_bank_tiles(plane);
-#endif
-
-  if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + bank + ((which&0x7ff) << 6) + (line << 3));
-  else
-    tile = *(unsigned*)(vram + bank + ((which&0x7ff) << 5) + (line << 2));
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      *(where  ) = ((tile & PIXEL7)>>SHIFT7) | pal;
-      *(where+1) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      *(where+2) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      *(where+3) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      *(where+4) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      *(where+5) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      *(where+6) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      *(where+7) = ((tile & PIXEL0)>>SHIFT0) | pal;
-    } else {
-      *(where  ) = ((tile & PIXEL0)>>SHIFT0) | pal;
-      *(where+1) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      *(where+2) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      *(where+3) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      *(where+4) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      *(where+5) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      *(where+6) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      *(where+7) = ((tile & PIXEL7)>>SHIFT7) | pal;
-    }
-}
-
-// Blit tile, leaving color zero transparent, for 1 byte per pixel
-inline void md_vdp::draw_tile1(int plane, int which, int line, unsigned char *where)
-{
-  unsigned tile, pal;
-
-  pal = (which >> 9 & 0x30); // Determine which 16-color palette
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  unsigned int bank = 0;
-
-#if VRAM_128KB
-  bank = get_vram_bank_tiles(plane);
-#endif
-
-  if (reg[12] & 2) // interlace
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 6) + (line << 3));
-  else
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 5) + (line << 2));
-
-  // If the tile is all 0's, why waste the time?
-  if(!tile) return;
-
-  // If the tile doesn't have any transparent pixels, draw it solidly.
-  if (!has_zero_nibbles(tile)) {
-    if (which & 0x800) {
-      // x flipped
-      *(where  ) = ((tile & PIXEL7)>>SHIFT7) | pal;
-      *(where+1) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      *(where+2) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      *(where+3) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      *(where+4) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      *(where+5) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      *(where+6) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      *(where+7) = ((tile & PIXEL0)>>SHIFT0) | pal;
-    }
-    else {
-      *(where  ) = ((tile & PIXEL0)>>SHIFT0) | pal;
-      *(where+1) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      *(where+2) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      *(where+3) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      *(where+4) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      *(where+5) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      *(where+6) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      *(where+7) = ((tile & PIXEL7)>>SHIFT7) | pal;
-    }
-    return;
-  }
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      if(tile & PIXEL7) *(where  ) = ((tile & PIXEL7)>>SHIFT7) | pal;
-      if(tile & PIXEL6) *(where+1) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      if(tile & PIXEL5) *(where+2) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      if(tile & PIXEL4) *(where+3) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      if(tile & PIXEL3) *(where+4) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      if(tile & PIXEL2) *(where+5) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      if(tile & PIXEL1) *(where+6) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      if(tile & PIXEL0) *(where+7) = ((tile & PIXEL0)>>SHIFT0) | pal;
-    } else {
-      if(tile & PIXEL0) *(where  ) = ((tile & PIXEL0)>>SHIFT0) | pal;
-      if(tile & PIXEL1) *(where+1) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      if(tile & PIXEL2) *(where+2) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      if(tile & PIXEL3) *(where+3) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      if(tile & PIXEL4) *(where+4) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      if(tile & PIXEL5) *(where+5) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      if(tile & PIXEL6) *(where+6) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      if(tile & PIXEL7) *(where+7) = ((tile & PIXEL7)>>SHIFT7) | pal;
-    }
-}
-
-// Blit tile solidly, for 2 byte-per-pixel
-inline void md_vdp::draw_tile2_solid(int plane, int which, int line, unsigned char *where)
-{
-  unsigned tile, temp, *pal;
-  unsigned short *wwhere = (unsigned short*)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-  temp = *pal; *pal = highpal[reg[7]&0x3f]; // Get background color
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  unsigned int bank = 0;
-
-#if VRAM_128KB
-  bank = get_vram_bank_tiles(plane);
-#endif
-
-  if (reg[12] & 2) // interlace
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 6) + (line << 3));
-  else
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 5) + (line << 2));
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    } else {
-      *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
-  // Restore the original color
-  *pal = temp;
-}
-
-// Blit tile, leaving color zero transparent, for 2 byte per pixel
-inline void md_vdp::draw_tile2(int plane, int which, int line, unsigned char *where)
+// Get the VRAM address of a line of dots from a tile in a bank
+template <bool INTERLACE>
+inline unsigned int md_vdp::tile_line_addr(unsigned int bank, int which,
+					   int line)
 {
-  unsigned tile, *pal;
-  unsigned short *wwhere = (unsigned short*)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-
   if(which & 0x1000) // y flipped
     line ^= 7; // take from the bottom, instead of the top
 
-  unsigned int bank = 0;
-
-#if VRAM_128KB
-  bank = get_vram_bank_tiles(plane);
-#endif
-
-  if (reg[12] & 2) // interlace
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 6) + (line << 3));
-  else
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 5) + (line << 2));
-
-  // If the tile is all 0's, why waste the time?
-  if(!tile) return;
-
-  // If the tile doesn't have any transparent pixels, draw it solidly.
-  if (!has_zero_nibbles(tile)) {
-    if (which & 0x800) {
-      // x flipped
-      *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    }
-    else {
-      *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
-    return;
-  }
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      if(tile & PIXEL7) *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      if(tile & PIXEL6) *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      if(tile & PIXEL5) *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      if(tile & PIXEL4) *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      if(tile & PIXEL3) *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      if(tile & PIXEL2) *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      if(tile & PIXEL1) *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      if(tile & PIXEL0) *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    } else {
-      if(tile & PIXEL0) *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      if(tile & PIXEL1) *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      if(tile & PIXEL2) *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      if(tile & PIXEL3) *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      if(tile & PIXEL4) *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      if(tile & PIXEL5) *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      if(tile & PIXEL6) *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      if(tile & PIXEL7) *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
+  if (INTERLACE)
+    return ((bank + ((which & 0x7ff) << 6) + (line << 3)) & (VRAM_SIZE - 1));
+  return (bank + ((which & 0x7ff) << 5) + (line << 2));
 }
 
-inline void md_vdp::draw_tile3_solid(int plane, int which, int line, unsigned char *where)
+// Get a line of decoded dots (0-15) from the tile cache, decode the whole
+// tile first if VRAM changed since the last time.
+// Lines come from the address alone so y flipping and interlace (which
+// only uses even lines of 8x16 tiles) don't need their own copies.
+inline const uint8_t *md_vdp::tile_line(unsigned int addr, unsigned int xflip)
 {
-  unsigned tile, temp, *pal;
-  uint24_t *wwhere = (uint24_t *)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-  temp = *pal; *pal = highpal[reg[7]&0x3f]; // Get background color
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  unsigned int bank = 0;
+  unsigned int tile = (addr >> 5);
+  uint8_t *dots = tile_cache[xflip][tile];
 
-#if VRAM_128KB
-  bank = get_vram_bank_tiles(plane);
-#endif
-
-  if (reg[12] & 2) // interlace
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 6) + (line << 3));
-  else
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 5) + (line << 2));
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
+  if (!(tile_valid[tile] & (1 << xflip)))
     {
-      u24cpy(&wwhere[0], (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-      u24cpy(&wwhere[1], (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      u24cpy(&wwhere[2], (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      u24cpy(&wwhere[3], (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      u24cpy(&wwhere[4], (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      u24cpy(&wwhere[5], (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      u24cpy(&wwhere[6], (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      u24cpy(&wwhere[7], (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-    } else {
-      u24cpy(&wwhere[0], (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-      u24cpy(&wwhere[1], (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      u24cpy(&wwhere[2], (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      u24cpy(&wwhere[3], (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      u24cpy(&wwhere[4], (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      u24cpy(&wwhere[5], (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      u24cpy(&wwhere[6], (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      u24cpy(&wwhere[7], (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-    }
-  // Restore the original color
-  *pal = temp;
-}
-
-inline void md_vdp::draw_tile3(int plane, int which, int line, unsigned char *where)
-{
-  unsigned tile, *pal;
-  uint24_t *wwhere = (uint24_t *)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
+      const uint8_t *src = (vram + (tile << 5));
+      unsigned int i;
 
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  unsigned int bank = 0;
-
-#if VRAM_128KB
-  bank = get_vram_bank_tiles(plane);
-#endif
-
-  if (reg[12] & 2) // interlace
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 6) + (line << 3));
-  else
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 5) + (line << 2));
-
-  // If it's empty, why waste the time?
-  if(!tile) return;
-
-  // If the tile doesn't have any transparent pixels, draw it solidly.
-  if (!has_zero_nibbles(tile)) {
-    if (which & 0x800) {
-      // x flipped
-      u24cpy(&wwhere[0], (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-      u24cpy(&wwhere[1], (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      u24cpy(&wwhere[2], (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      u24cpy(&wwhere[3], (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      u24cpy(&wwhere[4], (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      u24cpy(&wwhere[5], (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      u24cpy(&wwhere[6], (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      u24cpy(&wwhere[7], (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-    }
-    else {
-      u24cpy(&wwhere[0], (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-      u24cpy(&wwhere[1], (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      u24cpy(&wwhere[2], (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      u24cpy(&wwhere[3], (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      u24cpy(&wwhere[4], (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      u24cpy(&wwhere[5], (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      u24cpy(&wwhere[6], (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      u24cpy(&wwhere[7], (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-    }
-    return;
-  }
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      if (tile & PIXEL7)
-		u24cpy(&wwhere[0],
-		       (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-      if(tile & PIXEL6)
-		u24cpy(&wwhere[1],
-		       (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      if(tile & PIXEL5)
-		u24cpy(&wwhere[2],
-		       (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      if(tile & PIXEL4)
-		u24cpy(&wwhere[3],
-		       (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      if(tile & PIXEL3)
-		u24cpy(&wwhere[4],
-		       (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      if(tile & PIXEL2)
-		u24cpy(&wwhere[5],
-		       (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      if(tile & PIXEL1)
-		u24cpy(&wwhere[6],
-		       (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      if(tile & PIXEL0)
-		u24cpy(&wwhere[7],
-		       (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-    } else {
-      if(tile & PIXEL0)
-		u24cpy(&wwhere[0],
-		       (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-      if(tile & PIXEL1)
-		u24cpy(&wwhere[1],
-		       (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      if(tile & PIXEL2)
-		u24cpy(&wwhere[2],
-		       (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      if(tile & PIXEL3)
-		u24cpy(&wwhere[3],
-		       (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      if(tile & PIXEL4)
-		u24cpy(&wwhere[4],
-		       (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      if(tile & PIXEL5)
-		u24cpy(&wwhere[5],
-		       (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      if(tile & PIXEL6)
-		u24cpy(&wwhere[6],
-		       (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      if(tile & PIXEL7)
-		u24cpy(&wwhere[7],
-		       (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
+      // Two dots per byte, leftmost in the high nibble
+      if (xflip)
+	for (i = 0; (i != 32); ++i)
+	  {
+	    dots[(((i & ~3) << 1) + 7 - ((i & 3) << 1))] = (src[i] >> 4);
+	    dots[(((i & ~3) << 1) + 6 - ((i & 3) << 1))] = (src[i] & 0x0f);
+	  }
+      else
+	for (i = 0; (i != 32); ++i)
+	  {
+	    dots[(i << 1)] = (src[i] >> 4);
+	    dots[((i << 1) + 1)] = (src[i] & 0x0f);
+	  }
+      tile_valid[tile] |= (1 << xflip);
     }
+  return (dots + (((addr >> 2) & 7) << 3));
 }
 
-// Blit tile solidly, for 4 byte-per-pixel
-inline void md_vdp::draw_tile4_solid(int plane, int which, int line, unsigned char *where)
+// Blit a line of tile dots to a layer, along with the palette and the
+// priority bit. Color zero is kept, the merge takes care of transparency.
+template <bool INTERLACE>
+inline void md_vdp::draw_tile(unsigned int bank, int which, int line,
+			      uint8_t *where)
 {
-  unsigned tile, temp, *pal;
-  unsigned *wwhere = (unsigned*)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-  temp = *pal; *pal = highpal[reg[7]&0x3f]; // Get background color
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  unsigned int bank = 0;
-
-#if VRAM_128KB
-  bank = get_vram_bank_tiles(plane);
-#endif
-
-  if (reg[12] & 2) // interlace
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 6) + (line << 3));
-  else
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 5) + (line << 2));
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    } else {
-      *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
-  // Restore the original color
-  *pal = temp;
+  const uint8_t *dots;
+  uint64_t tile;
+
+  dots = tile_line(tile_line_addr<INTERLACE>(bank, which, line),
+		   ((which >> 11) & 1));
+
+  // Blit the tile! Dots are below 16, so OR the palette and priority bit
+  // on all of them.
+  memcpy(&tile, dots, sizeof(tile));
+  tile |= ((uint64_t)((which >> 9 & 0x30) | (which >> 8 & 0x80)) *
+	   0x0101010101010101ULL);
+  memcpy(where, &tile, sizeof(tile));
 }
 
-// Blit tile, leaving color zero transparent, for 4 byte per pixel
-inline void md_vdp::draw_tile4(int plane, int which, int line, unsigned char *where)
+// Blit a line of sprite tile dots, only where color zero leaves it
+// transparent and no sprite has been drawn yet, since sprites are drawn in
+// order of priority (the first one is on top). Dots landing on another
+// sprite trigger the collision bit instead.
+template <bool INTERLACE>
+inline void md_vdp::draw_tile_sprite(unsigned int bank, int which, int line,
+				     uint8_t *where)
 {
-  unsigned tile, *pal;
-  unsigned *wwhere = (unsigned*)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  unsigned int bank = 0;
-
-#if VRAM_128KB
-  bank = get_vram_bank_tiles(plane);
-#endif
+  unsigned addr, tile, attr, i;
+  const uint8_t *dots;
 
-  if (reg[12] & 2) // interlace
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 6) + (line << 3));
-  else
-	  tile = *(unsigned*)(vram + bank + ((which & 0x7ff) << 5) + (line << 2));
+  attr = ((which >> 9 & 0x30) | (which >> 8 & 0x80));
+  addr = tile_line_addr<INTERLACE>(bank, which, line);
+  tile = *(unsigned*)(vram + addr);
 
   // If the tile is all 0's, why waste the time?
   if(!tile) return;
 
-  // If the tile doesn't have any transparent pixels, draw it solidly.
-  if (!has_zero_nibbles(tile)) {
-    if (which & 0x800) {
-      // x flipped
-      *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    }
-    else {
-      *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
-    return;
-  }
-
   // Blit the tile!
-  if(which & 0x800) // x flipped
+  dots = tile_line(addr, ((which >> 11) & 1));
+  for (i = 0; (i != 8); ++i)
     {
-      if(tile & PIXEL7) *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      if(tile & PIXEL6) *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      if(tile & PIXEL5) *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      if(tile & PIXEL4) *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      if(tile & PIXEL3) *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      if(tile & PIXEL2) *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      if(tile & PIXEL1) *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      if(tile & PIXEL0) *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    } else {
-      if(tile & PIXEL0) *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      if(tile & PIXEL1) *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      if(tile & PIXEL2) *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      if(tile & PIXEL3) *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      if(tile & PIXEL4) *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      if(tile & PIXEL5) *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      if(tile & PIXEL6) *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      if(tile & PIXEL7) *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
+      if (!dots[i])
+	continue;
+      if (where[i] & 0x0f)
+	status |= 0x20; // Sprite collision bit (d5)
+      else
+	where[i] = (dots[i] | attr);
     }
 }
-#endif // WITH_X86_TILES
 
-// Draw the window (front or back)
-void md_vdp::draw_window(int line, int front)
+// Draw the window
+template <unsigned int MODE, bool INTERLACE>
+void md_vdp::draw_window(int line)
 {
-  int size;
-  int x, y, w, start;
+  // Wide or narrow
+  const int size = ((MODE != DISPLAY_H32) ? 64 : 32);
+  const int w = display_mode<MODE>::cells;
+  const int start = display_mode<MODE>::start;
+  unsigned int bank = 0;
+  int x, y;
   int pl, add;
   int total_window;
-  unsigned char *where;
+  uint8_t *where;
   int which;
   // Set everything up
   y = line >> 3;
   total_window = (y < (reg[18]&0x1f)) ^ (reg[18] >> 7);
 
-  // Wide or narrow
-  size = (reg[12] & 1)? 64 : 32;
-
   pl = (reg[3] << 10) + ((y&0x3f)*size*2);
 
-  // Wide(320) or narrow(256)?
-#if VDP_H56_MODE
-  if (reg[1] & 1)
-  {
-	  // 16:9 enhanced mode
-	  w = 54;
-	  start = -8;
-  }
-  else
+#if VRAM_128KB
+  bank = get_vram_bank_tiles(PLANE_W);
 #endif
-  if(reg[12] & 1)
-    {
-      w = 40;
-      start = -8;
-    } else {
-      w = 32;
-      start = 24;
-    }
   add = -2;
-  where = dest + (start * (int)Bpp);
+  where = (layer[PLANE_W] + LAYER_MARGIN + start);
 	for (x = -1; (x < w); ++x) {
 		if (!total_window) {
 			if (reg[17] & 0x80) {
@@ -735,11 +221,10 @@ void md_vdp::draw_window(int line, int front)
 		}
 		which = get_word(((unsigned char *)vram) +
 				 (pl + (add & ((size - 1) << 1))));
-		if ((which >> 15) == front)
-			draw_tile(PLANE_W, which, (line & 7), where);
+		draw_tile<INTERLACE>(bank, which, (line & 7), where);
 	skip:
 		add += 2;
-		where += Bpp_times8;
+		where += 8;
 	}
 }
 
@@ -752,11 +237,8 @@ inline void md_vdp::get_sprite_info(struct sprite_info& info, int index)
 	// Get the sprite's location
 	info.y = get_word(info.sprite);
 
-#if VDP_H56_MODE
-	info.x = (get_word(info.sprite + 6) & 0x3ff);
-#else
-	info.x = (get_word(info.sprite + 6) & 0x1ff);
-#endif
+	// One more bit is needed in H56 mode
+	info.x = (get_word(info.sprite + 6) & (dgen_vdp_h56 ? 0x3ff : 0x1ff));
 
 	// Interlace?
 	// XXX
@@ -802,9 +284,9 @@ void md_vdp::sprite_masking_overflow(int line)
 {
 	int masking_sprite_index;
 	bool masking_effective;
-	int frame_limit;
 	int line_limit;
 	int dots;
+	int count;
 	int i;
 
 	/*
@@ -820,6 +302,9 @@ void md_vdp::sprite_masking_overflow(int line)
 	 * in H40 and 16 in H32 _or_ 320 pixels wide in H40 and 256 pixels
 	 * wide in H32, with a possibility for the last sprite to be only
 	 * partially drawn.
+	 *
+	 * Only sprites found on this line by sprite_lines_generate() are
+	 * processed, the frame limit has already been applied there.
 	 */
 	masking_sprite_index = -1;
 	// If sprites on the previous line overflowed, sprite masking becomes
@@ -827,57 +312,30 @@ void md_vdp::sprite_masking_overflow(int line)
 	masking_effective = (sprite_overflow_line == (line - 1));
 	// Set sprites and dots limits for the current line.
 	if (reg[12] & 1) {
-
-#if VDP_H56_MODE
-		frame_limit = 142;
-		line_limit = 36;
-#else
-		frame_limit = 80;
-		line_limit = 20;
-#endif
-
-#if VDP_H56_MODE
-		if (reg[1] & 1)
+		line_limit = (dgen_vdp_h56 ? 36 : 20);
+		if ((dgen_vdp_h56) && (reg[1] & 1))
 		{
 			// 16:9 enhanced mode
 			dots = 448;
 		}
 		else
-#endif
 		{
 			dots = 320;
 		}
 	}
 	else {
-		frame_limit = 64;
 		line_limit = 16;
 		dots = 256;
 	}
-	for (i = 0; i < sprite_count; i++) {
-		int x, y, w, h;
-		int idx;
+	count = (((unsigned int)line < 256) ? sprite_line_count[line] : 0);
+	for (i = 0; i < count; i++) {
+		int x, w;
 		uint8_t *sprite;
 
-		// First, make sure the frame limit hasn't been reached.
-		idx = sprite_order[i];
-		if (idx >= frame_limit) {
-			if (masking_sprite_index == -1)
-				masking_sprite_index = (i - 1);
-			break;
-		}
 		// Get current sprite coordinates and dimensions.
-		sprite = (sprite_base + (idx << 3));
+		sprite = (sprite_base + (sprite_order[sprite_line[line][i]] << 3));
 		x = get_word(sprite + 6) & 0x1ff;
-		y = get_word(sprite);
-		if (reg[12] & 2)
-			y = ((y & 0x3fe) >> 1);
-		else
-			y &= 0x1ff;
-		h = (((sprite[2] & 0x03) << 3) + 8);
 		w = (((sprite[2] << 1) & 0x18) + 8);
-		// If this sprite isn't found on the current line, skip it.
-		if (!(((line + 0x80) >= y) && ((line + 0x80) < (y + h))))
-			continue;
 		// Substract sprite from the dots limit and decrease the
 		// sprites limit.
 		dots -= w;
@@ -909,7 +367,7 @@ void md_vdp::sprite_masking_overflow(int line)
 			if (masking_sprite_index == -1)
 				masking_sprite_index = i;
 			// Trigger sprite overflow bit (d6).
-			belongs.coo5 |= 0x40;
+			status |= 0x40;
 			// Don't process any more sprites, exit from the loop.
 			break;
 		}
@@ -925,323 +383,332 @@ void md_vdp::sprite_masking_overflow(int line)
 	}
 	// If no masking sprite index was found, display them all.
 	if (masking_sprite_index == -1)
-		masking_sprite_index = (sprite_count - 1);
+		masking_sprite_index = (count - 1);
 	masking_sprite_index_cache = masking_sprite_index;
 	dots_cache = dots;
 }
 
-inline void md_vdp::sprite_mask_add(uint8_t* dest, int pitch,
-				    struct sprite_info& info, int value)
-{
-	uint32_t *tile = info.tile;
-	int len = (info.tw * info.h);
-	int lines = (8 << info.inter);
-	int line = 0;
-	int wrap = 0;
-	int unit = 1;
-
-	dest += info.x;
-	dest += (pitch * info.y);
-	if (info.yflip) {
-		dest += (pitch * (info.h - 1));
-		pitch = -pitch;
-	}
-	if (info.xflip) {
-		dest += (info.w - 1);
-		unit = -unit;
-	}
-	while (len) {
-		uint_fast32_t dots = be2h32(*tile);
-		unsigned int tmp;
-
-		for (tmp = 0; (tmp != 8); ++tmp) {
-			assert(dest >= (uint8_t *)sprite_mask);
-			assert(dest < ((uint8_t *)sprite_mask +
-				       sizeof(sprite_mask)));
-			/*
-			 * If a non-transparent sprite dot has already been
-			 * drawn here, trigger the collision bit (d5).
-			 * FIXME: doing this here is hackish and doesn't take
-			 * sprites with the high priority bit into account.
-			 */
-			if (*dest != 0xff)
-				belongs.coo5 |= 0x20;
-#ifdef WORDS_BIGENDIAN
-			if (dots & 0x0000000f)
-				*dest = value;
-			dots >>= 4;
-#else
-			if (dots & 0xf0000000)
-				*dest = value;
-			dots <<= 4;
-#endif
-			dest += unit;
-		}
-		++tile;
-		++line;
-		if (line == lines) {
-			/* Next tile. */
-			line = 0;
-			++wrap;
-			if (wrap == info.th) {
-				/* Next tiles column. */
-				dest -= (pitch * (info.h - 1));
-				wrap = 0;
-			}
-			else {
-				/* Next tiles row. */
-				dest += (pitch - (8 * unit));
-			}
-		}
-		else {
-			/* Next line of dots. */
-			dest -= (8 * unit);
-			dest += pitch;
-		}
-		--len;
-	}
-}
-
-void md_vdp::sprite_mask_generate()
+// Sort the sprites by the lines they cover, so each line only goes through
+// its own sprites. Sprites after the frame limit are never displayed.
+void md_vdp::sprite_lines_generate()
 {
+	int frame_limit;
 	int i;
 
-	int width = 320;
-
-#if VDP_H56_MODE
-	if (reg[1] & 1)
-	{
-		// 16:9 enhanced mode
-		width = 448;
-	}
-#endif
+	if (reg[12] & 1)
+		frame_limit = (dgen_vdp_h56 ? 142 : 80);
+	else
+		frame_limit = 64;
+	memset(sprite_line_count, 0, sizeof(sprite_line_count));
+	for (i = 0; i < sprite_count; i++) {
+		int y, h, line, end;
+		int idx;
+		uint8_t *sprite;
 
-	memset(sprite_mask, 0xff, sizeof(sprite_mask));
-	for (i = (sprite_count - 1); (i >= 0); --i) {
-		sprite_info info;
-
-		get_sprite_info(info, sprite_order[i]);
-		// We only care about sprites with the low priority bit unset.
-		if (info.prio)
-			continue;
-		// Don't bother with hidden sprites.
-		if ((info.x >= width) || ((info.x + info.w) < 0))
-			continue;
-		if ((info.y >= 256) || ((info.y + info.h) < 0))
-			continue;
-		info.x += 0x80;
-		info.y += 0x80;
-		// Draw overlap mask for this sprite in a 512x512 virtual area.
-		sprite_mask_add((uint8_t *)sprite_mask, sizeof(sprite_mask[0]),
-				info, i);
+		idx = sprite_order[i];
+		if (idx >= frame_limit)
+			break;
+		sprite = (sprite_base + (idx << 3));
+		y = get_word(sprite);
+		if (reg[12] & 2)
+			y = ((y & 0x3fe) >> 1);
+		else
+			y &= 0x1ff;
+		h = (((sprite[2] & 0x03) << 3) + 8);
+		line = (y - 0x80);
+		end = (line + h);
+		if (line < 0)
+			line = 0;
+		if (end > 256)
+			end = 256;
+		// Sprites beyond the per-line limit are never processed.
+		for (; (line < end); ++line)
+			if (sprite_line_count[line] != SPRITE_LINE_MAX)
+				sprite_line[line][sprite_line_count[line]++] = i;
 	}
 }
 
-void md_vdp::draw_sprites(int line, bool front)
+template <unsigned int MODE, bool INTERLACE>
+void md_vdp::draw_sprites(int line)
 {
+  const int width = display_mode<MODE>::sprite_width;
+  unsigned int bank = 0;
   unsigned int which;
   int tx, ty, x, y, xend, ysize, yoff, i, masking_sprite_index;
   int dots;
-  unsigned char *where;
-#ifdef WITH_DEBUG_VDP
-  static int ant[2];
-  static unsigned long ant_last[2];
-  unsigned long ant_cur;
+  uint8_t *where;
 
-  if ((dgen_vdp_sprites_boxing) && (line == 0)) {
-    ant_cur = pd_usecs();
-    if ((ant_cur - ant_last[front]) > 100000) {
-      ant_last[front] = ant_cur;
-      ant[front] ^= 1;
-    }
-  }
+#if VRAM_128KB
+  bank = get_vram_bank_tiles(PLANE_S);
 #endif
   masking_sprite_index = masking_sprite_index_cache;
   dots = dots_cache;
-  // If dots_cache is less than zero, draw the first sprite partially.
+  // If dots_cache is less than zero, draw the last sprite partially.
   if (dots > 0)
     dots = 0;
-  // Sprites have to be in reverse order :P
-  for (i = masking_sprite_index; i >= 0; --i)
+  // Sprites are drawn from the top, draw_tile_sprite() doesn't overwrite
+  // what the previous ones left in the layer.
+  for (i = 0; i <= masking_sprite_index; ++i)
     {
       sprite_info info;
 
-      get_sprite_info(info, sprite_order[i]);
-      // Only do it if it's on the right priority.
-      if (info.prio == front)
+      get_sprite_info(info, sprite_order[sprite_line[line][i]]);
+      which = get_word(info.sprite + 4);
+      // Get the sprite's location
+      y = info.y;
+      x = info.x;
+      yoff = (line - y);
+      xend = ((info.w - 8) + x);
+      // Partial draw if negative.
+      if (i == masking_sprite_index)
+	xend += dots;
+      ysize = ((info.h - 8) >> 3);
+      // Render if this sprite's on this line
+      if(xend > -8 && x < width && yoff >= 0 && yoff <= (ysize<<3)+7)
 	{
-	  which = get_word(info.sprite + 4);
-	  // Get the sprite's location
-	  y = info.y;
-	  x = info.x;
-	  yoff = (line - y);
-	  xend = ((info.w - 8) + x);
-	  // Partial draw if negative.
-	  xend += dots;
-	  ysize = ((info.h - 8) >> 3);
-	  // Render if this sprite's on this line
-
-	  int width = 320;
-
-#if VDP_H56_MODE
-	  if (reg[1] & 1)
-	  {
-		  // 16:9 enhanced mode
-		  width = 448;
-	  }
-#endif
-
-	  if(xend > -8 && x < width && yoff >= 0 && yoff <= (ysize<<3)+7)
-	    {
-	      ty = yoff & 7;
-	      // y flipped?
-	      if(which & 0x1000)
-		which += ysize - (yoff >> 3);
-	      else
-		which += (yoff >> 3);
-	      ++ysize;
-	      // Unconditionally draw this sprite. It's supposed to always
-	      // appear on top of other sprites.
-	      if (!front) {
-		// x flipped?
-		if (which & 0x800) {
-		  where = dest + (xend * (int)Bpp);
-		  for(tx = xend; tx >= x; tx -= 8)
-		    {
-		      if(tx > -8 && tx < width)
-			draw_tile(PLANE_S, which, ty, where);
-		      which += ysize;
-		      where -= Bpp_times8;
-		    }
-	        }
-		else {
-		  where = dest + (x * (int)Bpp);
-		  for(tx = x; tx <= xend; tx += 8)
-		    {
-		      if(tx > -8 && tx < width)
-			draw_tile(PLANE_S, which, ty, where);
-		      which += ysize;
-		      where += Bpp_times8;
-		    }
-		}
-	      }
-	      // Draw sprite with the high priority bit set only where it's
-	      // not covered by a higher priority sprite (lower index in the
-	      // list) but with this bit unset. Those have already been drawn
-	      // during the previous pass.
-	      else {
-		union {
-		  uint32_t t4[8];
-		  uint24_t t3[8];
-		  uint16_t t2[8];
-		  uint8_t t1[8];
-		} tile;
-
-		// x flipped?
-		if (which & 0x800) {
-		  where = dest + (xend * (int)Bpp);
-		  for (tx = xend; (tx >= x); tx -= 8) {
-		    if ((tx > -8) && (tx < width)) {
-		      int xx;
-		      int xo;
-
-		      memcpy(tile.t1, where, Bpp_times8);
-		      draw_tile(PLANE_S, which, ty, tile.t1);
-		      for (xx = tx, xo = 0; (xo != 8); ++xo, ++xx)
-			if (sprite_mask[(line + 0x80)][(xx + 0x80)] >= i)
-			  memcpy(&dest[(xx * (int)Bpp)],
-				 &tile.t1[(xo * (int)Bpp)],
-				 (int)Bpp);
-		    }
-		    which += ysize;
-		    where -= Bpp_times8;
-		  }
-	        }
-		else {
-		  where = dest + (x * (int)Bpp);
-		  for (tx = x; (tx <= xend); tx += 8) {
-		    if ((tx > -8) && (tx < width)) {
-		      int xx;
-		      int xo;
-
-		      memcpy(tile.t1, where, Bpp_times8);
-		      draw_tile(PLANE_S, which, ty, tile.t1);
-		      for (xx = tx, xo = 0; (xo != 8); ++xo, ++xx)
-			if (sprite_mask[(line + 0x80)][(xx + 0x80)] >= i)
-			  memcpy(&dest[(xx * (int)Bpp)],
-				 &tile.t1[(xo * (int)Bpp)],
-				 (int)Bpp);
-		    }
-		    which += ysize;
-		    where += Bpp_times8;
-		  }
-		}
+	  ty = yoff & 7;
+	  // y flipped?
+	  if(which & 0x1000)
+	    which += ysize - (yoff >> 3);
+	  else
+	    which += (yoff >> 3);
+	  ++ysize;
+	  // x flipped?
+	  if (which & 0x800) {
+	    where = (layer[PLANE_S] + LAYER_MARGIN + xend);
+	    for(tx = xend; tx >= x; tx -= 8)
+	      {
+		if(tx > -8 && tx < width)
+		  draw_tile_sprite<INTERLACE>(bank, which, ty, where);
+		which += ysize;
+		where -= 8;
 	      }
-#ifdef WITH_DEBUG_VDP
-	      if (dgen_vdp_sprites_boxing) {
-		uint32_t color[2] = {
-		  (uint32_t)dgen_vdp_sprites_boxing_bg,
-		  (uint32_t)dgen_vdp_sprites_boxing_fg
-		};
-		int ph;
-		int fx;
-
-		if ((ph = 0, (y == line)) ||
-		    (ph = 1, ((y + info.h - 1) == line)))
-		  for (fx = (ant[front] ^ ph); (fx < info.w); fx += 2)
-		    draw_pixel(this->bmap, (info.x + fx),
-			       line, color[info.prio]);
-		else
-		  draw_pixel(this->bmap,
-			     (((line & 1) == ant[front]) ?
-			      (info.x + info.w - 1) : info.x),
-			     line, color[info.prio]);
+	  }
+	  else {
+	    where = (layer[PLANE_S] + LAYER_MARGIN + x);
+	    for(tx = x; tx <= xend; tx += 8)
+	      {
+		if(tx > -8 && tx < width)
+		  draw_tile_sprite<INTERLACE>(bank, which, ty, where);
+		which += ysize;
+		where += 8;
 	      }
-#endif
-	    }
+	  }
 	}
-      dots = 0;
     }
 }
 
+#ifdef WITH_DEBUG_VDP
+// Draw boxes around sprites, directly to the destination
+void md_vdp::draw_sprites_boxing(int line)
+{
+  static int ant;
+  static unsigned long ant_last;
+  unsigned long ant_cur;
+  int i;
+
+  if (line == 0) {
+    ant_cur = pd_usecs();
+    if ((ant_cur - ant_last) > 100000) {
+      ant_last = ant_cur;
+      ant ^= 1;
+    }
+  }
+  for (i = masking_sprite_index_cache; i >= 0; --i)
+    {
+      sprite_info info;
+      uint32_t color[2] = {
+	(uint32_t)dgen_vdp_sprites_boxing_bg,
+	(uint32_t)dgen_vdp_sprites_boxing_fg
+      };
+      int y;
+      int ph;
+      int fx;
+
+      get_sprite_info(info, sprite_order[sprite_line[line][i]]);
+      y = info.y;
+      if ((line < y) || (line >= (y + info.h)))
+	continue;
+      if ((ph = 0, (y == line)) ||
+	  (ph = 1, ((y + info.h - 1) == line)))
+	for (fx = (ant ^ ph); (fx < info.w); fx += 2)
+	  draw_pixel(this->bmap, (info.x + fx),
+		     line, color[info.prio]);
+      else
+	draw_pixel(this->bmap,
+		   (((line & 1) == ant) ?
+		    (info.x + info.w - 1) : info.x),
+		   line, color[info.prio]);
+    }
+}
+#endif
+
 // The body for the next few functions is in an extraneous header file.
 // Phil, I hope I left enough in this file for GLOBAL to hack it right. ;)
 // Thanks to John Stiles for this trick :)
 
-void md_vdp::draw_plane_back0(int line)
+template <unsigned int MODE, bool INTERLACE>
+void md_vdp::draw_plane0(int line)
 {
-#define FRONT 0
 #define PLANE 0
 #include "ras-drawplane.h"
 #undef PLANE
-#undef FRONT
 }
 
-void md_vdp::draw_plane_back1(int line)
+template <unsigned int MODE, bool INTERLACE>
+void md_vdp::draw_plane1(int line)
 {
-#define FRONT 0
 #define PLANE 1
 #include "ras-drawplane.h"
 #undef PLANE
-#undef FRONT
 }
 
-void md_vdp::draw_plane_front0(int line)
+#ifdef RAS_SSE2
+// Select b where m is set, a elsewhere
+static inline __m128i merge_select(__m128i a, __m128i b, __m128i m)
 {
-#define FRONT 1
-#define PLANE 0
-#include "ras-drawplane.h"
-#undef PLANE
-#undef FRONT
+	return _mm_or_si128(_mm_andnot_si128(m, a), _mm_and_si128(m, b));
 }
+#endif
 
-void md_vdp::draw_plane_front1(int line)
+// Merge the layers into the visible part of the destination, as highpal
+// indices.
+// From the bottom up: the backdrop, planes B, A and W without the priority
+// bit, sprites without it, then planes B, A and W with it and sprites with
+// it. In shadow/highlight mode, dots are shadowed unless plane B, A or W has
+// the priority bit set, sprites with it set are never shadowed, and sprite
+// colors 62 and 63 highlight or shadow whatever is below instead of being
+// drawn.
+template <unsigned int BPP, unsigned int MODE>
+void md_vdp::draw_merge()
 {
-#define FRONT 1
-#define PLANE 1
-#include "ras-drawplane.h"
-#undef PLANE
-#undef FRONT
+  // Both multiples of 16
+  const int start = display_mode<MODE>::merge_start;
+  const int end = display_mode<MODE>::merge_end;
+  const uint8_t *b = (layer[PLANE_B] + LAYER_MARGIN);
+  const uint8_t *a = (layer[PLANE_A] + LAYER_MARGIN);
+  const uint8_t *w = (layer[PLANE_W] + LAYER_MARGIN);
+  const uint8_t *s = (layer[PLANE_S] + LAYER_MARGIN);
+  unsigned int back = (reg[7] & 0x3f);
+  bool sh = (reg[12] & 0x08);
+  uint8_t dots[448];
+  int x;
+
+#ifdef RAS_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi8(-1);
+  const __m128i color = _mm_set1_epi8(0x0f);
+  const __m128i index = _mm_set1_epi8(0x3f);
+  const __m128i backdrop = _mm_set1_epi8(back);
+
+  for (x = start; (x != end); x += 16)
+    {
+      __m128i db = _mm_loadu_si128((const __m128i *)&b[x]);
+      __m128i da = _mm_loadu_si128((const __m128i *)&a[x]);
+      __m128i dw = _mm_loadu_si128((const __m128i *)&w[x]);
+      __m128i ds = _mm_loadu_si128((const __m128i *)&s[x]);
+      // Transparent dots and priority bits
+      __m128i tb = _mm_cmpeq_epi8(_mm_and_si128(db, color), zero);
+      __m128i ta = _mm_cmpeq_epi8(_mm_and_si128(da, color), zero);
+      __m128i tw = _mm_cmpeq_epi8(_mm_and_si128(dw, color), zero);
+      __m128i ts = _mm_cmpeq_epi8(_mm_and_si128(ds, color), zero);
+      __m128i pb = _mm_cmplt_epi8(db, zero);
+      __m128i pa = _mm_cmplt_epi8(da, zero);
+      __m128i pw = _mm_cmplt_epi8(dw, zero);
+      __m128i ps = _mm_cmplt_epi8(ds, zero);
+      // Opaque high priority plane dots
+      __m128i hb = _mm_andnot_si128(tb, pb);
+      __m128i ha = _mm_andnot_si128(ta, pa);
+      __m128i hw = _mm_andnot_si128(tw, pw);
+      __m128i hi = _mm_or_si128(hb, _mm_or_si128(ha, hw));
+      __m128i spr;
+      __m128i out;
+
+      out = backdrop;
+      out = merge_select(out, db, _mm_andnot_si128(_mm_or_si128(tb, pb), ones));
+      out = merge_select(out, da, _mm_andnot_si128(_mm_or_si128(ta, pa), ones));
+      out = merge_select(out, dw, _mm_andnot_si128(_mm_or_si128(tw, pw), ones));
+      out = merge_select(out, db, hb);
+      out = merge_select(out, da, ha);
+      out = merge_select(out, dw, hw);
+      // Sprites go above low priority planes, or above all of them
+      spr = _mm_andnot_si128(ts, _mm_or_si128(ps, _mm_andnot_si128(hi, ones)));
+      if (sh)
+	{
+	  __m128i shadow = _mm_andnot_si128(_mm_or_si128(pb, _mm_or_si128(pa, pw)), ones);
+	  __m128i sc = _mm_and_si128(ds, index);
+	  __m128i op_hi = _mm_and_si128(spr, _mm_cmpeq_epi8(sc, _mm_set1_epi8(0x3e)));
+	  __m128i op_sh = _mm_and_si128(spr, _mm_cmpeq_epi8(sc, _mm_set1_epi8(0x3f)));
+	  __m128i level;
+
+	  spr = _mm_andnot_si128(_mm_or_si128(op_hi, op_sh), spr);
+	  out = merge_select(out, ds, spr);
+	  level = _mm_and_si128(shadow, _mm_set1_epi8(0x40));
+	  level = _mm_andnot_si128(_mm_and_si128(spr, ps), level);
+	  level = merge_select(level, _mm_andnot_si128(shadow, _mm_set1_epi8(0x80)), op_hi);
+	  level = merge_select(level, _mm_set1_epi8(0x40), op_sh);
+	  out = _mm_or_si128(_mm_and_si128(out, index), level);
+	}
+      else
+	out = _mm_and_si128(merge_select(out, ds, spr), index);
+      _mm_storeu_si128((__m128i *)&dots[x], out);
+    }
+#else
+  for (x = start; (x != end); ++x)
+    {
+      unsigned int db = b[x], da = a[x], dw = w[x], ds = s[x];
+      unsigned int dot = back;
+      unsigned int level = 0;
+      bool hi = false;
+
+      if ((db & 0x0f) && !(db & 0x80)) dot = db;
+      if ((da & 0x0f) && !(da & 0x80)) dot = da;
+      if ((dw & 0x0f) && !(dw & 0x80)) dot = dw;
+      if ((db & 0x0f) && (db & 0x80)) dot = db, hi = true;
+      if ((da & 0x0f) && (da & 0x80)) dot = da, hi = true;
+      if ((dw & 0x0f) && (dw & 0x80)) dot = dw, hi = true;
+      if ((sh) && !((db | da | dw) & 0x80))
+	level = 0x40;
+      // Sprites go above low priority planes, or above all of them
+      if ((ds & 0x0f) && ((ds & 0x80) || !hi))
+	{
+	  if (!sh)
+	    dot = ds;
+	  else if ((ds & 0x3f) == 0x3e)
+	    level = (level ? 0x00 : 0x80);
+	  else if ((ds & 0x3f) == 0x3f)
+	    level = 0x40;
+	  else
+	    {
+	      dot = ds;
+	      if (ds & 0x80)
+		level = 0;
+	    }
+	}
+      dots[x] = ((dot & 0x3f) | level);
+    }
+#endif
+
+  // Look the colors up
+  switch (BPP)
+    {
+    case 1:
+      for (x = start; (x != end); ++x)
+	dest[x] = highpal[dots[x]];
+      break;
+    case 2:
+      for (x = start; (x != end); ++x)
+	((uint16_t *)dest)[x] = highpal[dots[x]];
+      break;
+    case 3:
+      for (x = start; (x != end); ++x)
+	u24cpy(&((uint24_t *)dest)[x], (uint24_t *)&highpal[dots[x]]);
+      break;
+    case 4:
+      for (x = start; (x != end); ++x)
+	((uint32_t *)dest)[x] = highpal[dots[x]];
+      break;
+    }
 }
 
 // Allow frame components to be hidden when WITH_DEBUG_VDP is defined.
@@ -1251,10 +718,223 @@ void md_vdp::draw_plane_front1(int line)
 #define vdp_hide_if(a, b) (void)(b)
 #endif
 
+// Draw each component of a displayed scanline in its layer, then merge them
+// into the destination
+template <unsigned int BPP, unsigned int MODE, bool INTERLACE>
+void md_vdp::render_line(int line)
+{
+  memset(layer, 0, sizeof(layer));
+  vdp_hide_if(dgen_vdp_hide_plane_b, (draw_plane1<MODE, INTERLACE>(line)));
+  vdp_hide_if(dgen_vdp_hide_plane_a, (draw_plane0<MODE, INTERLACE>(line)));
+  vdp_hide_if(dgen_vdp_hide_plane_w, (draw_window<MODE, INTERLACE>(line)));
+  // Hidden sprites are still drawn for the collision bit
+  draw_sprites<MODE, INTERLACE>(line);
+#ifdef WITH_DEBUG_VDP
+  if (dgen_vdp_hide_sprites)
+    memset(layer[PLANE_S], 0, sizeof(layer[PLANE_S]));
+#endif
+  draw_merge<BPP, MODE>();
+}
+
+#define RENDER_MODE(bpp, mode) \
+  { &md_vdp::render_line<bpp, mode, false>, \
+    &md_vdp::render_line<bpp, mode, true> }
+#define RENDER_BPP(bpp) \
+  { RENDER_MODE(bpp, DISPLAY_H32), \
+    RENDER_MODE(bpp, DISPLAY_H40), \
+    RENDER_MODE(bpp, DISPLAY_H56) }
+
+const md_vdp::render_func md_vdp::render_table[4][3][2] = {
+  RENDER_BPP(1), RENDER_BPP(2), RENDER_BPP(3), RENDER_BPP(4)
+};
+
+#undef RENDER_BPP
+#undef RENDER_MODE
+
+#define COLLIDE_MODE(mode) \
+  { &md_vdp::draw_sprites<mode, false>, \
+    &md_vdp::draw_sprites<mode, true> }
+
+const md_vdp::render_func md_vdp::collide_table[3][2] = {
+  COLLIDE_MODE(DISPLAY_H32),
+  COLLIDE_MODE(DISPLAY_H40),
+  COLLIDE_MODE(DISPLAY_H56)
+};
+
+#undef COLLIDE_MODE
+
+// Renderers and drawn scanlines depend on dgen_vdp_h56, which may change at
+// any time, start over when it does
+void md_vdp::render_h56_check()
+{
+  if (render_h56 == dgen_vdp_h56)
+    return;
+  render_h56 = dgen_vdp_h56;
+  render = NULL;
+  collide = NULL;
+  ++changes;
+}
+
+// Pick the renderer for the current display mode, interlace setting and
+// number of bytes per pixel, the latter only matters once known
+void md_vdp::render_select()
+{
+  unsigned int mode;
+  unsigned int il = ((reg[12] >> 1) & 1);
+
+  if (!(reg[12] & 1))
+    mode = DISPLAY_H32;
+  else if ((dgen_vdp_h56) && (reg[1] & 1))
+    mode = DISPLAY_H56;
+  else
+    mode = DISPLAY_H40;
+  collide = collide_table[mode][il];
+  if (Bpp != 0)
+    render = render_table[(Bpp - 1)][mode][il];
+}
+
+// Prepare sprites for a line, must be done for every line in order
+void md_vdp::sprite_line_update(int line)
+{
+  // Recalculate the sprite order, if it's dirty (VRAM, reg 5 or 12)
+  if((dirt[0x30] & 0x20) || (dirt[0x31] & 0x10) || (dirt[0x34] & 1))
+    {
+      unsigned next = 0;
+      // Max number of sprites per frame: 80 in H40, 64 in H32.
+      int max = ((reg[12] & 1) ? 80 : 64);
+      // Find the sprite base in VRAM
+      sprite_base = vram + (reg[5]<<9);
+      // Order the sprites
+      sprite_count = sprite_order[0] = 0;
+      do {
+	next = sprite_base[(next << 3) + 3];
+	sprite_order[++sprite_count] = next;
+      } while (next && sprite_count < max);
+      // Clean up the dirt
+      dirt[0x30] &= ~0x20; dirt[0x31] &= ~0x10; dirt[0x34] &= ~1;
+      // Find the sprites on each line
+      sprite_lines_generate();
+    }
+  // Calculate sprite masking and overflow.
+  sprite_masking_overflow(line);
+}
+
+// Go through a scanline without drawing it, only updating what the next
+// ones depend on and the status bits
+void md_vdp::skip_scanline(int line)
+{
+  if (reg[1] & 0x40)
+    sprite_line_update(line);
+}
+
+// Pack color channels (0-14, even values are the normal ones) for a depth
+static inline uint32_t pack_color(unsigned int bpp, unsigned int r,
+				  unsigned int g, unsigned int b)
+{
+	switch (bpp) {
+	case 24:
+#ifdef WORDS_BIGENDIAN
+		return ((r << 28) | (g << 20) | (b << 12));
+#else
+		return ((r << 4) | (g << 20) | (b << 12));
+#endif
+	case 32:
+		return ((r << 20) | (g << 12) | (b << 4));
+	case 16:
+		return ((r << 12) | (g << 7) | (b << 1));
+	case 15:
+		return ((r << 11) | (g << 6) | (b << 1));
+	}
+	return 0;
+}
+
+// Check whether a scanline prepared by skip_scanline() would come out
+// differently from the last time it was drawn at the same place, in which
+// case its state is kept for next time. Otherwise the sprite collision it
+// raised back then is raised again.
+bool md_vdp::scanline_changed(struct bmap *bits, int line)
+{
+  struct line_state *ls;
+  unsigned char *where;
+  unsigned int i, oldest = 0;
+
+  render_h56_check();
+  if ((unsigned int)line >= 256)
+    return true;
+  where = (bits->data + (bits->pitch * (line + 8)));
+  // Find what was drawn there, or replace the oldest drawing
+  for (i = 0; (i != LINE_STATE_BITMAPS); ++i)
+    {
+      if (drawn[line][i].dest == where)
+	break;
+      if (drawn[line][i].serial < drawn[line][oldest].serial)
+	oldest = i;
+    }
+  if (i == LINE_STATE_BITMAPS)
+    i = oldest;
+  drawn_last[line] = i;
+  ls = &drawn[line][i];
+#ifndef WITH_DEBUG_VDP
+  // Hidden components are not part of the state, always draw with them.
+  if ((dgen_render_skip) &&
+      (ls->dest == where) &&
+      (ls->bpp == bits->bpp) &&
+      (ls->changes == changes) &&
+      (ls->masking_sprite_index == masking_sprite_index_cache) &&
+      (ls->dots == dots_cache) &&
+      (memcmp(ls->reg, reg, sizeof(ls->reg)) == 0) &&
+      (memcmp(ls->vsram, vsram, sizeof(ls->vsram)) == 0))
+    {
+      status |= ls->collision;
+      return false;
+    }
+#endif
+  // Zero is never used
+  if (++drawn_serial == 0)
+    ++drawn_serial;
+  ls->dest = where;
+  ls->serial = drawn_serial;
+  ls->bpp = bits->bpp;
+  ls->changes = changes;
+  ls->masking_sprite_index = masking_sprite_index_cache;
+  ls->dots = dots_cache;
+  ls->collision = 0;
+  memcpy(ls->reg, reg, sizeof(ls->reg));
+  memcpy(ls->vsram, vsram, sizeof(ls->vsram));
+  return true;
+}
+
+// Identify what a bitmap holds for a scanline, the same number means the
+// same dots. Zero if unknown.
+unsigned int md_vdp::line_serial(const struct bmap *bits, int line)
+{
+  const unsigned char *where;
+  unsigned int i;
+
+  if ((unsigned int)line >= 256)
+    return 0;
+  where = (bits->data + (bits->pitch * (line + 8)));
+  for (i = 0; (i != LINE_STATE_BITMAPS); ++i)
+    if (drawn[line][i].dest == where)
+      return drawn[line][i].serial;
+  return 0;
+}
+
 // The main interface function, to generate a scanline
 void md_vdp::draw_scanline(struct bmap *bits, int line)
 {
-  unsigned *ptr, i;
+  skip_scanline(line);
+  render_scanline(bits, line);
+}
+
+// Draw a scanline prepared by skip_scanline()
+void md_vdp::render_scanline(struct bmap *bits, int line)
+{
+  uint8_t collided = (status & 0x20);
+  unsigned i;
+
+  // Only keep the collision bit raised by this line
+  status &= ~0x20;
   // Set the destination in the bmap
   bmap = bits;
   dest = bits->data + (bits->pitch * (line + 8) + 16);
@@ -1265,113 +945,79 @@ void md_vdp::draw_scanline(struct bmap *bits, int line)
       else if(bits->bpp <= 16) Bpp = 2;
       else if(bits->bpp <= 24) Bpp = 3;
       else		       Bpp = 4;
-      Bpp_times8 = Bpp << 3; // used for tile blitting
-#ifdef WITH_X86_TILES
-      asm_tiles_init(vram, reg, highpal); // pass these values to the asm tiles
-#endif
+      render = NULL;
     }
 
   // If the palette's been changed, update it
   if(dirt[0x34] & 2)
     {
-      ptr = highpal;
-      // What color depth are we?
-      switch(bits->bpp)
-        {
-	case 24:
-#ifdef WORDS_BIGENDIAN
-		for (i = 0; (i < 128); i += 2)
-			*ptr++ = (((cram[(i + 1)] & 0x0e) << 28) |
-				  ((cram[(i + 1)] & 0xe0) << 16) |
-				  ((cram[i] & 0x0e) << 12));
-		break;
-#else
-		for (i = 0; (i < 128); i += 2)
-			*ptr++ = (((cram[(i + 1)] & 0x0e) << 4) |
-				  ((cram[(i + 1)] & 0xe0) << 16) |
-				  ((cram[i] & 0x0e) << 12));
-		break;
-#endif
-	case 32:
-	  for(i = 0; i < 128; i += 2)
-	    *ptr++ = ((cram[i+1]&0x0e) << 20) |
-		     ((cram[i+1]&0xe0) << 8 ) |
-		     ((cram[i]  &0x0e) << 4 );
-	  break;
-	case 16:
-	  for(i = 0; i < 128; i += 2)
-	    *ptr++ = ((cram[i+1]&0x0e) << 12) |
-		     ((cram[i+1]&0xe0) << 3 ) |
-		     ((cram[i]  &0x0e) << 1 );
-	  break;
-	case 15:
-	  for(i = 0; i < 128; i += 2)
-	    *ptr++ = ((cram[i+1]&0x0e) << 11) |
-		     ((cram[i+1]&0xe0) << 2 ) |
-		     ((cram[i]  &0x0e) << 1 );
-	  break;
-	case 8:
-	default:
-	  // Let the hardware palette sort it out :P
-	  for(i = 0; i < 64; ++i) *ptr++ = i;
+      // Normal colors first, then shadowed and highlighted ones
+      for (i = 0; (i < 64); ++i)
+	{
+	  unsigned int r = (cram[((i << 1) + 1)] & 0x0e);
+	  unsigned int g = ((cram[((i << 1) + 1)] & 0xe0) >> 4);
+	  unsigned int b = (cram[(i << 1)] & 0x0e);
+
+	  // Let the hardware palette sort it out in 8bpp :P
+	  if (Bpp == 1)
+	    {
+	      highpal[i] = highpal[(i + 64)] = highpal[(i + 128)] = i;
+	      continue;
+	    }
+	  highpal[i] = pack_color(bits->bpp, r, g, b);
+	  highpal[(i + 64)] = pack_color(bits->bpp, (r >> 1), (g >> 1),
+					 (b >> 1));
+	  highpal[(i + 128)] = pack_color(bits->bpp, ((r >> 1) + 7),
+					  ((g >> 1) + 7), ((b >> 1) + 7));
 	}
       // Clean up the dirt
       dirt[0x34] &= ~2;
-      pal_dirty = 1;
+      pal_dirty = true;
     }
   // Render the screen if it's turned on
   if(reg[1] & 0x40)
     {
-      // Recalculate the sprite order, if it's dirty
-      if((dirt[0x30] & 0x20) || (dirt[0x34] & 1))
-	{
-	  unsigned next = 0;
-	  // Max number of sprites per frame: 80 in H40, 64 in H32.
-	  int max = ((reg[12] & 1) ? 80 : 64);
-	  // Find the sprite base in VRAM
-	  sprite_base = vram + (reg[5]<<9);
-	  // Order the sprites
-	  sprite_count = sprite_order[0] = 0;
-	  do {
-	    next = sprite_base[(next << 3) + 3];
-	    sprite_order[++sprite_count] = next;
-	  } while (next && sprite_count < max);
-	  // Clean up the dirt
-	  dirt[0x30] &= ~0x20; dirt[0x34] &= ~1;
-	  // Generate overlap mask for sprites with high priority bit
-	  sprite_mask_generate();
-	}
-      // Calculate sprite masking and overflow.
-      sprite_masking_overflow(line);
-      // Draw, from the bottom up
-      // Low priority
-      vdp_hide_if(dgen_vdp_hide_plane_b, draw_plane_back1(line));
-      vdp_hide_if(dgen_vdp_hide_plane_a, draw_plane_back0(line));
-      vdp_hide_if(dgen_vdp_hide_plane_w, draw_window(line, 0));
-      vdp_hide_if(dgen_vdp_hide_sprites, draw_sprites(line, 0));
-      // High priority
-      vdp_hide_if(dgen_vdp_hide_plane_b, draw_plane_front1(line));
-      vdp_hide_if(dgen_vdp_hide_plane_a, draw_plane_front0(line));
-      vdp_hide_if(dgen_vdp_hide_plane_w, draw_window(line, 1));
-      vdp_hide_if(dgen_vdp_hide_sprites, draw_sprites(line, 1));
+      // The renderer only changes along with the mode and depth
+      render_h56_check();
+      if (render == NULL)
+	render_select();
+      (this->*render)(line);
+#ifdef WITH_DEBUG_VDP
+      if (dgen_vdp_sprites_boxing)
+	draw_sprites_boxing(line);
+#endif
     } else {
       // The display is off, paint it black
       // Do it a dword at a time
       unsigned *destl = (unsigned*)dest;
-#if VDP_H56_MODE
-	  for (i = 0; i < (112 * Bpp); ++i) destl[i] = 0;
-#else
-      for(i = 0; i < (80 * Bpp); ++i) destl[i] = 0;
-#endif
+      unsigned n = ((dgen_vdp_h56 ? 112 : 80) * Bpp);
+      for(i = 0; i < n; ++i) destl[i] = 0;
     }
 
   // If we're in narrow (256) mode, cut off the messy edges
   if(!(reg[12] & 1))
     {
       unsigned *destl = (unsigned*)dest;
-      for(i = 0; i < Bpp_times8; ++i)
+      for(i = 0; i < (8 * Bpp); ++i)
         destl[i] = destl[i + (72 * Bpp)] = 0;
     }
+  if ((unsigned int)line < 256)
+    drawn[line][drawn_last[line]].collision = (status & 0x20);
+  status |= collided;
+}
+
+// Go through the sprites of a scanline prepared by skip_scanline() without
+// drawing it, only to raise the collision bit
+void md_vdp::collide_scanline(int line)
+{
+  // It takes two sprites to collide
+  if ((!(reg[1] & 0x40)) || (masking_sprite_index_cache < 1))
+    return;
+  render_h56_check();
+  if (collide == NULL)
+    render_select();
+  memset(layer[PLANE_S], 0, sizeof(layer[PLANE_S]));
+  (this->*collide)(line);
 }
 
 void md_vdp::draw_pixel(struct bmap *bits, int x, int y, uint32_t rgb)
@@ -113,6 +113,7 @@ RCVAR(dgen_autoload, 0);
 RCVAR(dgen_autosave, 0);
 RCVAR(dgen_autoconf, 1);
 RCVAR(dgen_frameskip, 1);
+RCVAR(dgen_frameskip_fixed, 0);
 RCVAR(dgen_show_carthead, 0);
 RCSTR(dgen_rom_path, "roms"); /* synchronize with romload.c */
 
@@ -123,6 +124,14 @@ RCVAR(dgen_soundsamples, 0);
 RCVAR(dgen_volume, 100);
 RCVAR(dgen_mjazz, 0);
 
+RCVAR(dgen_m68k_idle_skip, 0);
+RCVAR(dgen_z80_idle_skip, 1);
+RCVAR(dgen_dma_timing, 1);
+RCVAR(dgen_render_threads, 0);
+RCVAR(dgen_render_skip, 1);
+RCVAR(dgen_frame_buffers, 3);
+RCVAR(dgen_vdp_h56, 1);
+
 RCVAR(dgen_hz, 60);
 RCVAR(dgen_pal, 0);
 RCVAR(dgen_region, 0);
@@ -43,7 +43,11 @@ const char *scaling_names[] = {
 
 // CPU names, keep index in sync with rc-vars.h and enums in md.h
 const char *emu_z80_names[] = { "none", "mz80", "cz80", "drz80", NULL };
-const char *emu_m68k_names[] = { "none", "star", "musa", "cyclone", NULL };
+const char *emu_m68k_names[] = { "none", "star", "musa", "cyclone",
+#if defined(WITH_MUSA) && M68K_JIT
+				   "jit", // Only translates on x86-64 hosts
+#endif
+				   NULL };
 
 // The table of strings and the keysyms they map to.
 // The order is a bit weird, since this was originally a mapping for the SVGALib
@@ -764,6 +768,7 @@ struct rc_field rc_fields[RC_FIELDS_SIZE] = {
 	{ "bool_autosave", rc_boolean, &dgen_autosave },
 	{ "bool_autoconf", rc_boolean, &dgen_autoconf },
 	{ "bool_frameskip", rc_boolean, &dgen_frameskip },
+	{ "int_frameskip_fixed", rc_number, &dgen_frameskip_fixed },
 	{ "bool_show_carthead", rc_boolean, &dgen_show_carthead },
 	{ "str_rom_path", rc_rom_path,
 	  (intptr_t *)((void *)&dgen_rom_path) }, // SH
@@ -784,6 +789,13 @@ struct rc_field rc_fields[RC_FIELDS_SIZE] = {
 	{ "joy_volume_dec", rc_joypad, &dgen_volume_dec[RCBJ] },
 	{ "mou_volume_dec", rc_mouse, &dgen_volume_dec[RCBM] },
 	{ "bool_mjazz", rc_boolean, &dgen_mjazz }, // SH
+	{ "bool_m68k_idle_skip", rc_boolean, &dgen_m68k_idle_skip },
+	{ "bool_z80_idle_skip", rc_boolean, &dgen_z80_idle_skip },
+	{ "bool_dma_timing", rc_boolean, &dgen_dma_timing },
+	{ "int_render_threads", rc_number, &dgen_render_threads },
+	{ "bool_render_skip", rc_boolean, &dgen_render_skip },
+	{ "int_frame_buffers", rc_number, &dgen_frame_buffers },
+	{ "bool_vdp_h56", rc_boolean, &dgen_vdp_h56 },
 	{ "int_nice", rc_number, &dgen_nice },
 	{ "int_hz", rc_number, &dgen_hz }, // SH
 	{ "bool_pal", rc_boolean, &dgen_pal }, // SH
@@ -17,6 +17,7 @@ void md::m68k_state_dump()
 	switch (cpu_emu) {
 #ifdef WITH_MUSA
 	case CPU_EMU_MUSA:
+	case CPU_EMU_MUSA_JIT:
 		if (md_set_musa(true))
 			md_set_musa_sync(false);
 		md_set_musa(false);
@@ -47,6 +48,7 @@ void md::m68k_state_restore()
 	switch (cpu_emu) {
 #ifdef WITH_MUSA
 	case CPU_EMU_MUSA:
+	case CPU_EMU_MUSA_JIT:
 		if (md_set_musa(true))
 			md_set_musa_sync(true);
 		md_set_musa(false);
@@ -290,7 +292,7 @@ int md::import_gst(FILE *hand)
 	reset();
 	/* FIXME: VDP stuff */
 	/* PSG registers (8x16-bit, 16 bytes) */
-	SN76496_restore(0, &(*buf)[0x60]);
+	SN76496_restore(&ctx_sn76496, &(*buf)[0x60]);
 	/* M68K registers (19x32-bit, 1x16-bit, 90 bytes (padding: 12)) */
 	p = &(*buf)[0x80];
 	q = &(*buf)[0xa0];
@@ -318,12 +320,13 @@ int md::import_gst(FILE *hand)
 	fm_sel[0] = p[0];
 	fm_sel[1] = p[1];
 	p = &(*buf)[0x1e4];
-	YM2612_restore(0, p);
+	YM2612_restore(ctx_ym2612, 0, p);
 	fm_reg[0][0x24] = p[0x24];
 	fm_reg[0][0x25] = p[0x25];
 	fm_reg[0][0x26] = p[0x26];
 	fm_reg[0][0x27] = p[0x27];
-	dac_data[0] = p[0x2a];
+	dac_init();
+	dac_data = p[0x2a];
 	dac_enabled = (p[0x2b] >> 7);
 	memset(fm_ticker, 0, sizeof(fm_ticker));
 	/* Z80 registers (12x16-bit and 4x8-bit, 52 bytes (padding: 24)) */
@@ -359,10 +362,14 @@ int md::import_gst(FILE *hand)
 	memcpy(z80ram, &(*buf)[0x474], 0x2000);
 	/* RAM (65536 bytes), swapped */
 	swap16cpy(ram, &(*buf)[0x2478], 0x10000);
+#ifdef WITH_MUSA
+	m68k_decode_cache_flush(ctx_musa_dcache);
+#endif
 	/* VRAM (65536 bytes) */
 	memcpy(vdp.vram, &(*buf)[0x12478], 0x10000);
 	/* Mark everything as changed */
 	memset(vdp.dirt, 0xff, 0x35);
+	vdp.tile_cache_flush();
 	free(buf);
 	return 0;
 }
@@ -388,7 +395,7 @@ int md::export_gst(FILE *hand)
 	/* System ID */
 	(*buf)[0x52] = 0;
 	/* PSG registers (8x16-bit, 16 bytes) */
-	SN76496_dump(0, &(*buf)[0x60]);
+	SN76496_dump(&ctx_sn76496, &(*buf)[0x60]);
 	/* M68K registers (19x32-bit, 1x16-bit, 90 bytes (padding: 12)) */
 	m68k_state_dump();
 	p = &(*buf)[0x80];
@@ -415,7 +422,7 @@ int md::export_gst(FILE *hand)
 	p[0] = fm_sel[0];
 	p[1] = fm_sel[1];
 	p = &(*buf)[0x1e4];
-	YM2612_dump(0, p);
+	YM2612_dump(ctx_ym2612, 0, p);
 	p[0x24] = (uint8_t)fm_reg[0][0x24];
 	p[0x25] = (uint8_t)fm_reg[0][0x25];
 	p[0x26] = (uint8_t)fm_reg[0][0x26];
@@ -460,3 +467,54 @@ int md::export_gst(FILE *hand)
 		return -1;
 	return 0;
 }
+
+/**
+ * Compute a hash of the emulated machine state.
+ * Covers what a GST save would restore: RAM, Z80 RAM, the VDP memories and
+ * registers, M68K and Z80 registers, Z80 bus state and the PSG and YM2612
+ * registers. Only meaningful between builds that share the same memory
+ * layout (see ROM_BYTESWAP).
+ * @return 64-bit FNV-1a hash.
+ */
+uint64_t md::state_hash()
+{
+	uint8_t z80_bus[] = { (uint8_t)z80_st_reset, (uint8_t)z80_st_busreq };
+	uint8_t psg[16];
+	uint8_t fm[512];
+	const struct {
+		const void *data;
+		size_t size;
+	} area[] = {
+		{ ram, 0x10000 },
+		{ z80ram, 0x2000 },
+		{ vdp.vram, VRAM_SIZE },
+		{ vdp.cram, 0x80 },
+		{ vdp.vsram, 0x50 },
+		{ vdp.reg, sizeof(vdp.reg) },
+		// Not the whole structures, they may have padding
+		{ m68k_state.d, sizeof(m68k_state.d) },
+		{ m68k_state.a, sizeof(m68k_state.a) },
+		{ &m68k_state.pc, sizeof(m68k_state.pc) },
+		{ &m68k_state.sr, sizeof(m68k_state.sr) },
+		{ &z80_state, sizeof(z80_state) },
+		{ z80_bus, sizeof(z80_bus) },
+		{ &z80_bank68k, sizeof(z80_bank68k) },
+		{ psg, sizeof(psg) },
+		{ fm_sel, sizeof(fm_sel) },
+		{ fm_reg, sizeof(fm_reg) },
+		{ &dac_enabled, sizeof(dac_enabled) },
+	};
+	uint64_t hash = FNV1A64_INIT;
+	unsigned int i;
+
+	m68k_state_dump();
+	z80_state_dump();
+	SN76496_dump(&ctx_sn76496, psg);
+	for (i = 0; (i != elemof(area)); ++i)
+		hash = fnv1a64(hash, area[i].data, area[i].size);
+	for (i = 0; (i != fm_chips); ++i) {
+		YM2612_dump(ctx_ym2612, i, fm);
+		hash = fnv1a64(hash, fm, sizeof(fm));
+	}
+	return hash;
+}
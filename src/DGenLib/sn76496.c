@@ -10,19 +10,34 @@
   layout is unknown. It can be set for either period or white noise; again,
   the details are unknown.
 
+  Instead of stepping the chip once per output sample, each change of its
+  output (tone or noise transitions, volume writes) is recorded as a delta
+  at the time it happens, then turned into samples through a band-limited
+  step. The chip only does work when its output changes and high tones
+  don't alias.
+
 ***************************************************************************/
 
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
 #include "system.h"
 #include "sn76496.h"
 
 
 #define MAX_OUTPUT 0x7fff
-#define AUDIO_CONV(A) (A)
 
 #define STEP 0x10000
 
+/* Band-limited step, one impulse per fraction of a sample (phase) where */
+/* the output can change. Impulses sum to 1 << BLIP_SHIFT. */
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+#define BLIP_WIDTH SN76496_BLIP_WIDTH
+#define BLIP_SHIFT 13
+
+static int blip_kernel[BLIP_PHASES][BLIP_WIDTH];
+
 
 /* Formulas for noise generator */
 /* bit0 = output */
@@ -42,28 +57,64 @@
 #define NG_PRESET 0x0f35
 
 
-struct SN76496
+/* Compute blip_kernel[], a Blackman windowed sinc cut off a bit below */
+/* the Nyquist frequency. Must be called once before any chip is used. */
+void SN76496_init_tables(void)
 {
-    int Channel;
-    int SampleRate;
-    unsigned int UpdateStep;
-    int VolTable[16];   /* volume table         */
-    int Register[8];    /* registers */
-    int LastRegister;   /* last register written */
-    int Volume[4];      /* volume of voice 0-2 and noise */
-    unsigned int RNG;       /* noise generator      */
-    int NoiseFB;        /* noise feedback mask */
-    unsigned int Period[4];
-    int Count[4];
-    int Output[4];
-};
-
-
-static struct SN76496 sn[MAX_76496];
-
-void SN76496_dump(int chip, uint8_t buf[16])
+	const double pi = 3.14159265358979323846;
+	const double cutoff = 0.9; /* of the Nyquist frequency */
+	unsigned int p, i;
+
+	for (p = 0; (p < BLIP_PHASES); ++p) {
+		double impulse[BLIP_WIDTH];
+		double sum = 0.0;
+		int total = 0;
+		unsigned int peak = 0;
+
+		for (i = 0; (i < BLIP_WIDTH); ++i) {
+			double x = (((double)i - (BLIP_WIDTH / 2) + 1) -
+				    ((double)p / BLIP_PHASES));
+			double w = (x / (BLIP_WIDTH / 2));
+			double v = cutoff;
+
+			if (x != 0.0)
+				v = (sin(pi * cutoff * x) / (pi * x));
+			v *= (0.42 + (0.5 * cos(pi * w)) +
+			      (0.08 * cos(2.0 * pi * w)));
+			impulse[i] = v;
+			sum += v;
+		}
+		for (i = 0; (i < BLIP_WIDTH); ++i) {
+			int v = floor(((impulse[i] / sum) *
+				       (1 << BLIP_SHIFT)) + 0.5);
+
+			blip_kernel[p][i] = v;
+			total += v;
+			if (v > blip_kernel[p][peak])
+				peak = i;
+		}
+		/* Rounding must not leave a DC offset behind. */
+		blip_kernel[p][peak] += ((1 << BLIP_SHIFT) - total);
+	}
+}
+
+/* Record an output change at a given time (see SN76496Run()) */
+static void blip_delta(struct SN76496 *R, unsigned int time, int delta)
+{
+	const int *k = blip_kernel[((time >> (16 - BLIP_PHASE_BITS)) &
+				    (BLIP_PHASES - 1))];
+	int *out = &R->Blip[(time >> 16)];
+	unsigned int i;
+
+	if (delta == 0)
+		return;
+	for (i = 0; (i < BLIP_WIDTH); ++i)
+		out[i] += (delta * k[i]);
+}
+
+
+void SN76496_dump(struct SN76496 *R, uint8_t buf[16])
 {
-	struct SN76496 *R = &sn[chip];
 	uint16_t tmp;
 	unsigned int i;
 
@@ -73,9 +124,8 @@ void SN76496_dump(int chip, uint8_t buf[16])
 	}
 }
 
-void SN76496_restore(int chip, uint8_t buf[16])
+void SN76496_restore(struct SN76496 *R, uint8_t buf[16])
 {
-	struct SN76496 *R = &sn[chip];
 	uint16_t tmp;
 	unsigned int i;
 
@@ -85,9 +135,8 @@ void SN76496_restore(int chip, uint8_t buf[16])
 	}
 }
 
-void SN76496Write(int chip,int data)
+void SN76496Write(struct SN76496 *R, int data)
 {
-    struct SN76496 *R = &sn[chip];
 
 
     /* update the output buffer before changing the registers */
@@ -119,6 +168,8 @@ void SN76496Write(int chip,int data)
             case 3: /* tone 1 : volume */
             case 5: /* tone 2 : volume */
             case 7: /* noise  : volume */
+                if (R->Output[c])
+                    blip_delta(R, R->Time, (R->VolTable[data & 0x0f] - R->Volume[c]));
                 R->Volume[c] = R->VolTable[data & 0x0f];
                 break;
             case 6: /* noise  : frequency, mode */
@@ -131,6 +182,8 @@ void SN76496Write(int chip,int data)
 
                     /* reset noise shifter */
                     R->RNG = NG_PRESET;
+                    if (R->Output[3] != (int)(R->RNG & 1))
+                        blip_delta(R, R->Time, (R->Output[3] ? -R->Volume[3] : R->Volume[3]));
                     R->Output[3] = R->RNG & 1;
                 }
                 break;
@@ -161,36 +214,111 @@ void SN76496Write(int chip,int data)
 }
 
 
-void SN76496_0_w(int offset, int data) { (void)offset; SN76496Write(0, data); }
-void SN76496_1_w(int offset, int data) { (void)offset; SN76496Write(1, data); }
-void SN76496_2_w(int offset, int data) { (void)offset; SN76496Write(2, data); }
-void SN76496_3_w(int offset, int data) { (void)offset; SN76496Write(3, data); }
-
-
-
-void SN76496Update_8_2(int chip,void *buffer,int length)
+/*
+ * Run the chip up to a given time, recording its output changes.
+ * Time is counted in samples (16.16 fixed point) from the first one
+ * SN76496Update_16_2() will return next, which is where register writes
+ * take effect.
+ */
+void SN76496Run(struct SN76496 *R, unsigned int time)
 {
-#define DATATYPE unsigned char
-#define DATACONV(A) AUDIO_CONV((A) / (STEP * 256))
-#include "sn76496u.c"
-#undef DATATYPE
-#undef DATACONV
+	unsigned int i;
+
+	if (time > (SN76496_BLIP_SAMPLES << 16))
+		time = (SN76496_BLIP_SAMPLES << 16);
+	if (time <= R->Time)
+		return;
+	for (i = 0; (i < 3); ++i) {
+		unsigned int t = R->Time;
+		unsigned int left = (time - t);
+
+		if (R->Volume[i] == 0) {
+			/* Nothing to hear, only keep the square wave going. */
+			if ((unsigned int)R->Count[i] <= left) {
+				unsigned int n = (((left - R->Count[i]) /
+						   R->Period[i]) + 1);
+
+				R->Output[i] ^= (n & 1);
+				R->Count[i] += (n * R->Period[i]);
+			}
+			R->Count[i] -= left;
+			continue;
+		}
+		/* Period[i] is the half period of the square wave. */
+		while ((unsigned int)R->Count[i] <= left) {
+			t += R->Count[i];
+			left -= R->Count[i];
+			R->Output[i] ^= 1;
+			blip_delta(R, t, (R->Output[i] ?
+					  R->Volume[i] : -R->Volume[i]));
+			R->Count[i] = R->Period[i];
+		}
+		R->Count[i] -= left;
+	}
+	{
+		unsigned int t = R->Time;
+		unsigned int left = (time - t);
+
+		while ((unsigned int)R->Count[3] <= left) {
+			int output;
+
+			t += R->Count[3];
+			left -= R->Count[3];
+			if (R->RNG & 1)
+				R->RNG ^= R->NoiseFB;
+			R->RNG >>= 1;
+			output = (R->RNG & 1);
+			if (output != R->Output[3]) {
+				R->Output[3] = output;
+				blip_delta(R, t, (output ?
+						  R->Volume[3] : -R->Volume[3]));
+			}
+			R->Count[3] = R->Period[3];
+		}
+		R->Count[3] -= left;
+	}
+	R->Time = time;
 }
 
-void SN76496Update_16_2(int chip,void *buffer,int length)
+void SN76496Update_16_2(struct SN76496 *R, void *buffer,int length)
 {
-#define DATATYPE unsigned short
-#define DATACONV(A) ((A) / STEP)
-#include "sn76496u.c"
-#undef DATATYPE
-#undef DATACONV
+	int16_t *buf = (int16_t *)buffer;
+
+	while (length > 0) {
+		unsigned int n = length;
+		unsigned int used;
+		unsigned int i;
+
+		if (n > SN76496_BLIP_SAMPLES)
+			n = SN76496_BLIP_SAMPLES;
+		SN76496Run(R, (n << 16));
+		for (i = 0; (i < n); ++i) {
+			int out;
+
+			R->BlipSum += R->Blip[i];
+			out = (R->BlipSum >> BLIP_SHIFT);
+			if (out > MAX_OUTPUT)
+				out = MAX_OUTPUT;
+			else if (out < -MAX_OUTPUT)
+				out = -MAX_OUTPUT;
+			out = ((out * 3) >> 3); /* Dave: a bit quieter */
+			/* Both channels */
+			*(buf++) = out;
+			*(buf++) = out;
+		}
+		/* Keep the ends of steps that go past these samples. */
+		used = ((R->Time >> 16) + BLIP_WIDTH);
+		memmove(&R->Blip[0], &R->Blip[n], ((used - n) * sizeof(R->Blip[0])));
+		memset(&R->Blip[(used - n)], 0, (n * sizeof(R->Blip[0])));
+		R->Time -= (n << 16);
+		length -= n;
+	}
 }
 
 
 
-void SN76496_set_clock(int chip,int clock)
+void SN76496_set_clock(struct SN76496 *R, int clock)
 {
-    struct SN76496 *R = &sn[chip];
 
 
     /* the base clock for the tone generators is the chip clock divided by 16; */
@@ -204,9 +332,8 @@ void SN76496_set_clock(int chip,int clock)
 
 
 
-static void SN76496_set_volume(int chip,int volume,int gain)
+static void SN76496_set_volume(struct SN76496 *R, int volume,int gain)
 {
-    struct SN76496 *R = &sn[chip];
     int i;
     double out;
 
@@ -235,10 +362,9 @@ static void SN76496_set_volume(int chip,int volume,int gain)
 
 
 
-int SN76496_init(int chip,int clock,int sample_rate,int sample_bits)
+int SN76496_init(struct SN76496 *R, int clock,int sample_rate,int sample_bits)
 {
     int i;
-    struct SN76496 *R = &sn[chip];
     /* char name[40]; */
 
     (void)sample_bits;
@@ -252,8 +378,8 @@ int SN76496_init(int chip,int clock,int sample_rate,int sample_bits)
         return 1;
 
     R->SampleRate = sample_rate;
-    SN76496_set_clock(chip,clock);
-    SN76496_set_volume(chip,255,0);
+    SN76496_set_clock(R,clock);
+    SN76496_set_volume(R,255,0);
 
     for (i = 0;i < 4;i++) R->Volume[i] = 0;
 
@@ -272,6 +398,10 @@ int SN76496_init(int chip,int clock,int sample_rate,int sample_bits)
     R->RNG = NG_PRESET;
     R->Output[3] = R->RNG & 1;
 
+    R->Time = 0;
+    R->BlipSum = 0;
+    memset(R->Blip, 0, sizeof(R->Blip));
+
     return 0;
 }
 
@@ -0,0 +1,131 @@
+// DGen sound ring
+// Sound is handed from the emulation thread to the audio callback through a
+// lock-free ring, resampled on the way so that the ring stays near a small
+// fill level.
+//
+// There is a single writer (the emulation thread) and a single reader (the
+// audio callback), each only moving its own index, so neither ever waits for
+// the other.
+//
+// Emulation and the sound device run on different clocks, the ring would
+// slowly fill up or run dry. The writer measures the fill level and adjusts
+// the output rate by up to SOUND_RING_RATE_MAX to bring it back to the
+// target, which is too small a change to be heard.
+
+#include <string.h>
+#include "sound_ring.h"
+
+/**
+ * Allocate the ring.
+ * @param size Minimum number of stereo samples it holds.
+ * @param target Number of stereo samples to keep in it.
+ */
+md_sound_ring::md_sound_ring(unsigned int size, unsigned int target):
+	pos(0), underrun_last(0), head(0), tail(0), underrun_count(0),
+	overrun_count(0), rate(0)
+{
+	unsigned int n = 1;
+
+	while (n < size)
+		n <<= 1;
+	if (target >= n)
+		target = (n / 2);
+	mask = (n - 1);
+	target_fill = target;
+	data.resize(n * 2);
+	last[0] = 0;
+	last[1] = 0;
+}
+
+/**
+ * Resample and queue sound, from the emulation thread.
+ * Samples that don't fit are dropped.
+ * @param lr Interleaved stereo samples.
+ * @param len Number of stereo samples.
+ */
+void md_sound_ring::write(const int16_t *lr, unsigned int len)
+{
+	unsigned int h = head.load(std::memory_order_acquire);
+	unsigned int t = tail.load(std::memory_order_relaxed);
+	unsigned int underruns = underrun_count.load(std::memory_order_relaxed);
+	bool overrun = false;
+	double error;
+	uint32_t step;
+
+	if (len == 0)
+		return;
+	// After running dry, start again from the target with silence
+	// instead of hovering around empty.
+	if (underruns != underrun_last) {
+		underrun_last = underruns;
+		while ((t - h) < target_fill) {
+			data[((t & mask) * 2)] = 0;
+			data[(((t & mask) * 2) + 1)] = 0;
+			++t;
+		}
+	}
+	// Produce more below the target, less above it.
+	error = (((double)target_fill - (double)(t - h)) / target_fill);
+	if (error > 1.0)
+		error = 1.0;
+	else if (error < -1.0)
+		error = -1.0;
+	rate.store((int)(error * SOUND_RING_RATE_MAX * 1000000.0),
+		   std::memory_order_relaxed);
+	// Input samples per output sample (16.16)
+	step = (uint32_t)(65536.0 / (1.0 + (error * SOUND_RING_RATE_MAX)));
+	// Linear interpolation, position 0 being the previous input sample.
+	while (pos < (len << 16)) {
+		unsigned int i = (pos >> 16);
+		int frac = ((pos & 0xffff) >> 1);
+		const int16_t *a = ((i == 0) ? last : &lr[((i - 1) * 2)]);
+		const int16_t *b = &lr[(i * 2)];
+
+		pos += step;
+		if ((t - h) > mask) {
+			// Full, unless the reader made room since.
+			h = head.load(std::memory_order_acquire);
+			if ((t - h) > mask) {
+				overrun = true;
+				continue;
+			}
+		}
+		data[((t & mask) * 2)] = (a[0] + (((b[0] - a[0]) * frac) >> 15));
+		data[(((t & mask) * 2) + 1)] =
+			(a[1] + (((b[1] - a[1]) * frac) >> 15));
+		++t;
+	}
+	pos -= (len << 16);
+	last[0] = lr[((len - 1) * 2)];
+	last[1] = lr[(((len - 1) * 2) + 1)];
+	tail.store(t, std::memory_order_release);
+	if (overrun)
+		overrun_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Dequeue sound, from the audio callback. Missing samples are silent.
+ * @param[out] lr Interleaved stereo samples.
+ * @param len Number of stereo samples.
+ */
+void md_sound_ring::read(int16_t *lr, unsigned int len)
+{
+	unsigned int h = head.load(std::memory_order_relaxed);
+	unsigned int t = tail.load(std::memory_order_acquire);
+	unsigned int n = (t - h);
+	unsigned int first;
+
+	if (n > len)
+		n = len;
+	// Copy up to the end of the ring, then from its start.
+	first = ((mask + 1) - (h & mask));
+	if (first > n)
+		first = n;
+	memcpy(lr, &data[((h & mask) * 2)], (first * 2 * sizeof(lr[0])));
+	memcpy(&lr[(first * 2)], &data[0], ((n - first) * 2 * sizeof(lr[0])));
+	head.store((h + n), std::memory_order_release);
+	if (n != len) {
+		memset(&lr[(n * 2)], 0, ((len - n) * 2 * sizeof(lr[0])));
+		underrun_count.fetch_add(1, std::memory_order_relaxed);
+	}
+}
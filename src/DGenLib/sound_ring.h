@@ -0,0 +1,46 @@
+// DGen sound ring
+// Sound is handed from the emulation thread to the audio callback through a
+// lock-free ring, resampled on the way so that the ring stays near a small
+// fill level.
+
+#ifndef SOUND_RING_H_
+#define SOUND_RING_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/** Largest output rate adjustment, as a fraction of the nominal rate. */
+#define SOUND_RING_RATE_MAX	0.005
+
+class md_sound_ring
+{
+public:
+	md_sound_ring(unsigned int size, unsigned int target);
+	void write(const int16_t *lr, unsigned int len);
+	void read(int16_t *lr, unsigned int len);
+	/** Stereo samples waiting to be played. */
+	unsigned int fill() const { return (tail.load() - head.load()); }
+	unsigned int target() const { return target_fill; }
+	unsigned int underruns() const { return underrun_count.load(); }
+	unsigned int overruns() const { return overrun_count.load(); }
+	/** Current output rate adjustment, in parts per million. */
+	int rate_ppm() const { return rate.load(); }
+
+private:
+	std::vector<int16_t> data; // Interleaved stereo samples
+	unsigned int mask; // Stereo samples in data, minus one
+	unsigned int target_fill;
+	// Producer side
+	uint32_t pos; // Input position (16.16), from the previous sample
+	int16_t last[2]; // Previous input sample
+	unsigned int underrun_last; // Underrun count when last writing
+	// Shared, counters only grow and wrap around
+	std::atomic<unsigned int> head; // Stereo samples read
+	std::atomic<unsigned int> tail; // Stereo samples written
+	std::atomic<unsigned int> underrun_count; // Reads that ran short
+	std::atomic<unsigned int> overrun_count; // Writes that didn't fit
+	std::atomic<int> rate;
+};
+
+#endif // SOUND_RING_H_
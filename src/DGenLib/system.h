@@ -110,6 +110,20 @@ static __inline uint24_t *u24cpy(uint24_t *dst, const uint24_t *src)
 	return dst;
 }
 
+#define FNV1A64_INIT 0xcbf29ce484222325ULL
+
+/* Add data to a 64-bit FNV-1a hash, start from FNV1A64_INIT. */
+static __inline uint64_t fnv1a64(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	while (size--) {
+		hash ^= *(p++);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
 extern uint8_t *load(void **context,
 		     size_t *file_size, FILE *file, size_t max_size);
 extern void load_finish(void **context);
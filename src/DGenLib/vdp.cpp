@@ -24,16 +24,21 @@ void md_vdp::reset()
 	rw_addr = 0;
 	rw_dma = 0;
 	memset(mem, 0, sizeof(mem));
+	tile_cache_flush();
 	memset(reg, 0, 0x20);
 	memset(dirt, 0xff, 0x35); // mark everything as changed
 	memset(highpal, 0, sizeof(highpal));
+	memset(layer, 0, sizeof(layer));
 	memset(sprite_order, 0, sizeof(sprite_order));
-	memset(sprite_mask, 0xff, sizeof(sprite_mask));
+	memset(sprite_line_count, 0, sizeof(sprite_line_count));
+	memset(drawn, 0, sizeof(drawn));
+	memset(drawn_last, 0, sizeof(drawn_last));
 	sprite_base = NULL;
 	sprite_count = 0;
 	masking_sprite_index_cache = -1;
 	dots_cache = 0;
 	sprite_overflow_line = INT_MIN;
+	status = 0;
 	dest = NULL;
 	bmap = NULL;
 }
@@ -56,7 +61,11 @@ md_vdp::md_vdp(md& md): belongs(md)
 	dirt = (mem + 0x10100); // VRAM/CRAM/Reg dirty buffer bitfield
 #endif
 	// Also in 0x34 are global dirt flags (inclduing VSRAM this time)
-	Bpp = Bpp_times8 = 0;
+	Bpp = 0;
+	changes = 0;
+	drawn_serial = 0;
+	render_h56 = -1;
+	pal_dirty = false;
 	reset();
 }
 
@@ -95,6 +104,40 @@ unsigned char md_vdp::dma_mem_read(int addr)
   return belongs.misc_readbyte(addr);
 }
 
+/**
+ * Do a M68K to VDP DMA transfer.
+ * ROM and RAM are read directly a whole area at a time, anything else goes
+ * through dma_mem_read().
+ *
+ * @param addr Address where to read from.
+ * @param len Number of words to transfer.
+ */
+void md_vdp::dma_68k(uint32_t addr, unsigned int len)
+{
+  while (len)
+  {
+    const uint8_t *src;
+    unsigned int n, swap, i;
+
+    src = belongs.dma_source(addr, &n, &swap);
+    if (src == NULL)
+    {
+      unsigned short val;
+      val= dma_mem_read(addr++); val<<=8;
+      val|=dma_mem_read(addr++); putword(val);
+      --len;
+      continue;
+    }
+    n >>= 1;
+    if (n > len)
+      n = len;
+    for (i = 0; (i != (n << 1)); i += 2)
+      putword((src[(i ^ swap)] << 8) | src[((i + 1) ^ swap)]);
+    addr += (n << 1);
+    len -= n;
+  }
+}
+
 /**
  * Set value in VRAM.
  * Must go through these calls to update the dirty flags.
@@ -118,10 +161,31 @@ int md_vdp::poke_vram(int addr,unsigned char d)
     byt=addr>>8; bit=byt&7; byt>>=3; byt&=0x1f;
     dirt[0x00+byt]|=(1<<bit); dirt[0x34]|=1;
     vram[addr]=d;
+    // The decoded tile must be updated
+    tile_valid[(addr >> 5)] = 0;
+    // So must the render threads copy and scanlines using it
+    log_vram[(addr >> 11)] |= (1 << ((addr >> 8) & 7));
+    ++changes;
   }
   return 0;
 }
 
+/**
+ * Invalidate all decoded tiles, copies of VRAM and CRAM, drawn scanlines and
+ * the selected renderers.
+ * Must be called after modifying VRAM, CRAM or registers without
+ * poke_vram(), poke_cram() or write_reg().
+ */
+void md_vdp::tile_cache_flush()
+{
+  memset(tile_valid, 0, sizeof(tile_valid));
+  memset(log_vram, 0xff, sizeof(log_vram));
+  log_cram = true;
+  ++changes;
+  render = NULL;
+  collide = NULL;
+}
+
 /**
  * Set value in CRAM.
  *
@@ -139,6 +203,8 @@ int md_vdp::poke_cram(int addr,unsigned char d)
     byt=addr; bit=byt&7; byt>>=3; byt&=0x0f;
     dirt[0x20+byt]|=(1<<bit); dirt[0x34]|=2;
     cram[addr]=d;
+    log_cram = true;
+    ++changes;
   }
 
   return 0;
@@ -351,12 +417,9 @@ int md_vdp::command(uint16_t cmd)
     switch (mode)
     {
       case 0: case 1:
-        for (i=0;i<len;i++)
-        {
-          unsigned short val;
-          val= dma_mem_read(s++); val<<=8;
-          val|=dma_mem_read(s++); putword(val);
-        }
+        dma_68k(s, len);
+        // The M68K can't run while its bus is in use
+        belongs.dma_start((len * 2), true);
       break;
       case 2:
         // Done later on (VRAM fill I believe)
@@ -368,6 +431,8 @@ int md_vdp::command(uint16_t cmd)
           val= vram[(s++)&0xffff]; val<<=8;
           val|=vram[(s++)&0xffff]; putword(val);
         }
+        // Each byte is read then written
+        belongs.dma_start((len * 4), false);
       break;
     }
   }
@@ -393,6 +458,7 @@ int md_vdp::writeword(unsigned short d)
       len=dma_len();
       for (i=0;i<len;i++)
         putword(d);
+      belongs.dma_start(len, false);
       return 0;
     }
   }
@@ -422,6 +488,7 @@ int md_vdp::writebyte(unsigned char d)
       len=dma_len();
       for (i=0;i<len;i++)
         putbyte(d);
+      belongs.dma_start(len, false);
       return 0;
     }
   }
@@ -452,6 +519,11 @@ void md_vdp::write_reg(uint8_t addr, uint8_t data)
 		byt &= 0x03;
 		dirt[(0x30 + byt)] |= (1 << bit);
 		dirt[0x34] |= 8;
+		// The display mode may have changed
+		if ((addr == 1) || (addr == 12)) {
+			render = NULL;
+			collide = NULL;
+		}
 	}
 	reg[addr] = data;
 	// "Writing to a VDP register will clear the code register."
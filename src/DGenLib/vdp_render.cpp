@@ -0,0 +1,260 @@
+// DGen threaded renderer
+// The emulation thread logs the VDP state each scanline needs, render
+// threads replay that log in their own copy of the VDP and draw their share
+// of the scanlines while emulation goes on.
+//
+// Every render thread applies all logs in order so that its copy stays in
+// sync, only drawing lines whose number modulo the number of threads
+// matches its own. Raster effects are preserved since each log holds the
+// state at the time its line would have been drawn synchronously.
+//
+// Sprite masking depends on previous lines, which aren't logged when they
+// didn't change or when the frame is skipped, so it is logged as computed
+// by the emulation thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "md.h"
+#include "vdp_render.h"
+
+/**
+ * Start render threads.
+ * @param megad MD object whose VDP is logged.
+ * @param threads Number of render threads.
+ */
+md_vdp_render::md_vdp_render(md &megad, unsigned int threads):
+	lines(VDP_RENDER_LINES), vram(VDP_RENDER_VRAM), vram_used(0),
+	workers(threads), bm(NULL), frame(0), count(0), quit(false)
+{
+	unsigned int i;
+
+	// The first log must hold everything.
+	megad.vdp.tile_cache_flush();
+	for (i = 0; (i != workers.size()); ++i) {
+		workers[i].vdp = new md_vdp(megad);
+		workers[i].frame = 0;
+		workers[i].done = 0;
+	}
+	for (i = 0; (i != workers.size()); ++i)
+		workers[i].thread = std::thread(&md_vdp_render::work, this, i);
+}
+
+/**
+ * Stop render threads.
+ */
+md_vdp_render::~md_vdp_render()
+{
+	unsigned int i;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		quit = true;
+	}
+	work_cond.notify_all();
+	for (i = 0; (i != workers.size()); ++i) {
+		workers[i].thread.join();
+		delete workers[i].vdp;
+	}
+}
+
+/**
+ * Wait until render threads have processed all logged lines.
+ * @param lock Lock on mutex.
+ */
+void md_vdp_render::wait(std::unique_lock<std::mutex> &lock)
+{
+	unsigned int i = 0;
+
+	// Nothing to wait for if no line has been logged yet.
+	if (count == 0)
+		return;
+	while (i != workers.size()) {
+		if ((workers[i].frame == frame) && (workers[i].done == count)) {
+			++i;
+			continue;
+		}
+		done_cond.wait(lock);
+	}
+}
+
+/**
+ * Start logging a new frame.
+ * @param bm Where render threads draw it.
+ */
+void md_vdp_render::frame_start(struct bmap *bm)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	wait(lock);
+	this->bm = bm;
+	count = 0;
+	++frame;
+}
+
+/**
+ * Log the VDP state for a scanline and have it drawn.
+ * @param vdp VDP being emulated.
+ * @param line Scanline number.
+ */
+void md_vdp_render::line(md_vdp &vdp, int line)
+{
+	struct line_log *log;
+	unsigned int blocks = 0;
+	unsigned int i;
+
+	if (count == lines.size())
+		return;
+	for (i = 0; (i != sizeof(vdp.log_vram)); ++i)
+		if (vdp.log_vram[i])
+			blocks += 8;
+	// When there is no room left for changed VRAM, wait until render
+	// threads are done with what was logged so far.
+	if ((vram_used + blocks) > vram.size()) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		wait(lock);
+		vram_used = 0;
+	}
+	log = &lines[count];
+	log->line = line;
+	memcpy(log->reg, vdp.reg, sizeof(log->reg));
+	memcpy(log->vsram, vdp.vsram, sizeof(log->vsram));
+	log->cram_changed = vdp.log_cram;
+	if (vdp.log_cram) {
+		memcpy(log->cram, vdp.cram, sizeof(log->cram));
+		// Render threads only mark their own copy.
+		vdp.pal_dirty = true;
+	}
+	vdp.log_cram = false;
+	log->masking_sprite_index = vdp.masking_sprite_index_cache;
+	log->dots = vdp.dots_cache;
+	log->vram_first = vram_used;
+	for (i = 0; (i != sizeof(vdp.log_vram)); ++i) {
+		unsigned int bit;
+
+		if (vdp.log_vram[i] == 0)
+			continue;
+		for (bit = 0; (bit != 8); ++bit) {
+			unsigned int block = ((i << 3) | bit);
+
+			if (!(vdp.log_vram[i] & (1 << bit)))
+				continue;
+			vram[vram_used].block = block;
+			memcpy(vram[vram_used].data, &vdp.vram[(block << 8)],
+			       sizeof(vram[vram_used].data));
+			++vram_used;
+		}
+		vdp.log_vram[i] = 0;
+	}
+	log->vram_count = (vram_used - log->vram_first);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		++count;
+	}
+	work_cond.notify_all();
+}
+
+/**
+ * Wait until the frame is drawn.
+ * @param vdp VDP being emulated, which learns the sprite collisions raised
+ * by each line for when they are not drawn again.
+ * @return Status bits raised while drawing it (sprite collision).
+ */
+uint8_t md_vdp_render::frame_end(md_vdp &vdp)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	uint8_t status = 0;
+	unsigned int i;
+
+	wait(lock);
+	for (i = 0; (i != workers.size()); ++i) {
+		status |= workers[i].vdp->status;
+		workers[i].vdp->status = 0;
+	}
+	for (i = 0; (i != count); ++i) {
+		unsigned int line = lines[i].line;
+		md_vdp *drawer = workers[(line % workers.size())].vdp;
+
+		if (line < 256)
+			vdp.drawn[line][vdp.drawn_last[line]].collision =
+				drawer->drawn[line]
+				[drawer->drawn_last[line]].collision;
+	}
+	// Sprite overflow is already known by the emulation thread.
+	return (status & 0x20);
+}
+
+/**
+ * Bring a VDP copy to the state logged for a scanline.
+ * @param vdp VDP copy.
+ * @param log Line log.
+ */
+void md_vdp_render::apply(md_vdp &vdp, const struct line_log &log)
+{
+	unsigned int i;
+
+	for (i = 0; (i != sizeof(log.reg)); ++i)
+		if (vdp.reg[i] != log.reg[i])
+			vdp.write_reg(i, log.reg[i]);
+	if (memcmp(vdp.vsram, log.vsram, sizeof(log.vsram))) {
+		memcpy(vdp.vsram, log.vsram, sizeof(log.vsram));
+		vdp.dirt[0x34] |= 4;
+	}
+	if (log.cram_changed) {
+		memcpy(vdp.cram, log.cram, sizeof(log.cram));
+		vdp.dirt[0x34] |= 2;
+	}
+	for (i = 0; (i != log.vram_count); ++i) {
+		const struct vram_log *v = &vram[(log.vram_first + i)];
+
+		memcpy(&vdp.vram[(v->block << 8)], v->data, sizeof(v->data));
+		memset(&vdp.tile_valid[(v->block << 3)], 0, 8);
+		vdp.dirt[0x34] |= 1;
+	}
+}
+
+/**
+ * Render thread.
+ * @param id Worker number.
+ */
+void md_vdp_render::work(unsigned int id)
+{
+	struct worker *w = &workers[id];
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (!quit) {
+		struct bmap *bits;
+		unsigned int i, end;
+
+		if (w->frame != frame) {
+			w->frame = frame;
+			w->done = 0;
+		}
+		if (w->done == count) {
+			work_cond.wait(lock);
+			continue;
+		}
+		bits = bm;
+		end = count;
+		lock.unlock();
+		for (i = w->done; (i != end); ++i) {
+			const struct line_log *log = &lines[i];
+
+			apply(*w->vdp, *log);
+			if (((unsigned int)log->line % workers.size()) != id)
+				continue;
+			// Update sprite lists, then use the logged masking.
+			w->vdp->skip_scanline(log->line);
+			w->vdp->masking_sprite_index_cache =
+				log->masking_sprite_index;
+			w->vdp->dots_cache = log->dots;
+			w->vdp->render_scanline(bits, log->line);
+		}
+		lock.lock();
+		w->done = end;
+		done_cond.notify_all();
+	}
+}
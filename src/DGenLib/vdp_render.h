@@ -0,0 +1,75 @@
+// DGen threaded renderer
+// The emulation thread logs the VDP state each scanline needs, render
+// threads replay that log in their own copy of the VDP and draw their share
+// of the scanlines while emulation goes on.
+
+#ifndef VDP_RENDER_H_
+#define VDP_RENDER_H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "md.h"
+
+/** Maximum number of scanlines logged per frame. */
+#define VDP_RENDER_LINES		256
+/** Number of changed 256 bytes VRAM blocks that can be logged at once. */
+#define VDP_RENDER_VRAM			((VRAM_SIZE >> 8) * 2)
+
+class md_vdp_render
+{
+public:
+	md_vdp_render(md &megad, unsigned int threads);
+	~md_vdp_render();
+	unsigned int threads() const { return workers.size(); }
+	void frame_start(struct bmap *bm);
+	void line(md_vdp &vdp, int line);
+	uint8_t frame_end(md_vdp &vdp);
+
+private:
+	/** VDP state for a scanline, changes since the previous one. */
+	struct line_log {
+		int		line; /**< Scanline to draw. */
+		uint8_t		reg[0x20]; /**< All registers. */
+		uint8_t		vsram[0x80]; /**< All of VSRAM. */
+		uint8_t		cram[0x80]; /**< All of CRAM, if cram_changed. */
+		bool		cram_changed;
+		/** Sprite masking, see md_vdp::sprite_masking_overflow(). */
+		int		masking_sprite_index;
+		int		dots;
+		unsigned int	vram_first; /**< First vram_log entry. */
+		unsigned int	vram_count; /**< Number of vram_log entries. */
+	};
+	/** 256 bytes of VRAM that changed. */
+	struct vram_log {
+		unsigned int	block; /**< VRAM address >> 8. */
+		uint8_t		data[0x100];
+	};
+	/** Render thread. */
+	struct worker {
+		md_vdp		*vdp; /**< Copy of the VDP, only used here. */
+		std::thread	thread;
+		unsigned int	frame; /**< Frame being drawn. */
+		unsigned int	done; /**< Number of line logs processed. */
+	};
+	std::vector<struct line_log> lines;
+	std::vector<struct vram_log> vram;
+	unsigned int vram_used;
+	std::vector<struct worker> workers;
+	// Shared with render threads
+	std::mutex mutex;
+	std::condition_variable work_cond; // More lines or quitting
+	std::condition_variable done_cond; // Lines processed
+	struct bmap *bm;
+	unsigned int frame;
+	unsigned int count; // Number of lines logged for this frame
+	bool quit;
+
+	void apply(md_vdp &vdp, const struct line_log &log);
+	void wait(std::unique_lock<std::mutex> &lock);
+	void work(unsigned int id);
+};
+
+#endif // VDP_RENDER_H_